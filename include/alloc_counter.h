@@ -0,0 +1,20 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+// Heap allocation counting
+// Built with `make ALLOC_COUNT=1`, malloc, calloc, realloc and the aligned
+// allocators are wrapped to count calls per thread and in total, so that
+// --alloc-check can show the request path makes none once warmed up.
+// Otherwise nothing is wrapped and the counts stay 0.
+#ifdef VAANI_ALLOC_COUNT
+#define ALLOC_COUNTING 1
+#else
+#define ALLOC_COUNTING 0
+#endif
+
+// Allocations made by the calling thread
+unsigned long thread_allocations(void);
+// Allocations made by every thread
+unsigned long total_allocations(void);
+
+#endif // ALLOC_COUNTER_H
@@ -0,0 +1,28 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Bump allocator over one preallocated block
+// Scratch memory for a single request is taken from an arena and dropped all
+// at once with arena_reset, so the steady-state path never calls malloc.
+#define ARENA_ALIGNMENT 16
+
+typedef struct {
+    unsigned char *base;
+    size_t size;
+    size_t used;
+    size_t peak;                // Most bytes in use since arena_init
+} Arena;
+
+// Allocate size bytes up front. Returns false if out of memory.
+bool arena_init(Arena *arena, size_t size);
+void arena_release(Arena *arena);
+// ARENA_ALIGNMENT-aligned block, or NULL when the arena is exhausted
+void *arena_alloc(Arena *arena, size_t bytes);
+void arena_reset(Arena *arena);
+// True if ptr was returned by arena_alloc on arena
+bool arena_owns(const Arena *arena, const void *ptr);
+
+#endif // ARENA_H
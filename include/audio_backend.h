@@ -0,0 +1,82 @@
+#ifndef AUDIO_BACKEND_H
+#define AUDIO_BACKEND_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "speech_processor.h"
+
+// Audio backends
+// A source feeds the capture pipeline and a sink plays synthesized speech.
+// Every source hands frames to an AudioFrameHandler straight from its own
+// buffer (the DMA area for ALSA mmap), so resampling, silence detection and
+// conditioning are the same whatever the audio comes from.
+//
+// Source specs:
+//   alsa[:DEVICE]   Microphone; DEVICE defaults to the first USB or capture card
+//                   (kept open between recordings, reopened after an error)
+//   wav:PATH        WAV file, replayed in real time for every recording
+//   wav-fast:PATH   Same, as fast as the pipeline takes it
+//   stdin           Raw s16le SAMPLE_RATE mono on standard input
+//   fifo:PATH       Same from a named pipe, reopened when the writer closes it
+//   null            Silence in real time
+//   loopback        Whatever is played on the loopback sink (both sides must use it)
+// Sink specs:
+//   alsa[:DEVICE]   Speaker; DEVICE defaults to "default"
+//   null            Discards audio
+//   loopback        Feeds the loopback source
+#define AUDIO_SOURCE_PERIOD_FRAMES (SAMPLE_RATE * CAPTURE_PERIOD_MS / 1000)  // Frames per delivery, non-ALSA sources
+#define AUDIO_SINK_LATENCY_US 100000              // ALSA playback buffer
+#define AUDIO_LOOPBACK_SECONDS 30                 // Played audio held for the loopback source
+#define AUDIO_DEFAULT_SOURCE "alsa"
+#define AUDIO_DEFAULT_SINK NULL                   // Festival plays through its own audio output
+
+typedef struct AudioSource AudioSource;
+typedef struct AudioSink AudioSink;
+
+struct AudioSource {
+    const char *name;
+    // Prepare one recording and report the format run will deliver
+    // (interleaved 16-bit). config carries the device settings (periods);
+    // sources without a device ignore it. Returns 0, or -1 with a message on stderr.
+    int (*open)(AudioSource *source, const CaptureConfig *config, unsigned int *rate, unsigned int *channels);
+    // Deliver frames on the calling thread until handler returns non-zero or
+    // the input ends (0), or on error (negative errno or ALSA code). Recovered
+    // overruns are added to xruns.
+    int (*run)(AudioSource *source, AudioFrameHandler handler, void *user, unsigned long *xruns);
+    // End the recording; a source may keep its device open for the next one
+    void (*close)(AudioSource *source);
+    void (*destroy)(AudioSource *source);
+    bool finished;                  // Input has ended for good (stdin at EOF)
+    void *state;
+};
+
+struct AudioSink {
+    const char *name;
+    // Play SAMPLE_RATE mono samples, returning once they have been played
+    // (or queued, for loopback). Returns 0, or -1 on failure.
+    int (*play)(AudioSink *sink, const int16_t *samples, size_t count);
+    void (*destroy)(AudioSink *sink);
+    void *state;
+};
+
+// Create the source and sink for the given specs. A NULL source spec uses
+// AUDIO_DEFAULT_SOURCE; a NULL sink spec leaves *sink NULL, meaning Festival
+// speaks directly. Returns false with a message if either cannot be created.
+bool open_audio_backends(const char *source_spec, const char *sink_spec,
+                         AudioSource **source, AudioSink **sink);
+AudioSource *create_audio_source(const char *spec);
+AudioSink *create_audio_sink(const char *spec);
+// Connected pair: audio played on sink is captured by source
+bool create_audio_loopback(AudioSource **source, AudioSink **sink);
+void destroy_audio_source(AudioSource *source);
+void destroy_audio_sink(AudioSink *sink);
+
+// Decode a WAV file with read_wav_file and play it on sink
+int audio_sink_play_file(AudioSink *sink, const char *path);
+
+// ALSA backends (alsa_backend.c); device NULL picks the default
+AudioSource *create_alsa_source(const char *device);
+AudioSink *create_alsa_sink(const char *device);
+
+#endif // AUDIO_BACKEND_H
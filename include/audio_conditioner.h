@@ -0,0 +1,43 @@
+#ifndef AUDIO_CONDITIONER_H
+#define AUDIO_CONDITIONER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming conditioning stage
+// Audio is processed in hops of CONDITIONER_HOP samples with a fixed cost per
+// hop: DC-blocking high-pass, optional spectral-subtraction noise suppression
+// and a look-ahead AGC. Output trails input by a constant latency.
+#define CONDITIONER_HOP 128                // 8 ms at 16 kHz
+#define CONDITIONER_FFT_SIZE (2 * CONDITIONER_HOP)
+#define CONDITIONER_NOISE_SUPPRESSION 1    // Set to 0 to skip spectral subtraction
+
+#define DC_BLOCK_POLE 0.995f               // One-pole high-pass, ~13 Hz corner at 16 kHz
+#define AGC_TARGET_PEAK 16384.0f           // Half of full scale
+#define AGC_MAX_GAIN 8.0f
+#define AGC_NOISE_FLOOR 300.0f             // Envelopes below this never raise the gain
+#define AGC_ATTACK_MS 5.0f
+#define AGC_RELEASE_MS 300.0f
+#define NS_INIT_FRAMES 10                  // Frames averaged for the first noise estimate
+#define NS_OVERSUBTRACTION 2.0f
+#define NS_SPECTRAL_FLOOR 0.1f             // Minimum per-bin gain
+
+typedef struct AudioConditioner AudioConditioner;
+
+AudioConditioner *conditioner_create(unsigned int sample_rate, bool noise_suppression);
+void conditioner_destroy(AudioConditioner *c);
+
+// Forget all filter, noise and gain state before a new utterance
+void conditioner_reset(AudioConditioner *c);
+
+// Condition count input samples. Writes the conditioned samples that became
+// available to out and returns how many were written. out may alias the
+// input stream as long as it does not run ahead of it (in-place use).
+size_t conditioner_process(AudioConditioner *c, const int16_t *in, size_t count, int16_t *out);
+
+// Emit the samples still held back by the pipeline latency.
+// Returns the number of samples written to out.
+size_t conditioner_flush(AudioConditioner *c, int16_t *out);
+
+#endif // AUDIO_CONDITIONER_H
@@ -0,0 +1,23 @@
+#ifndef BATCH_TRANSCRIBER_H
+#define BATCH_TRANSCRIBER_H
+
+#include <stddef.h>
+#include "speech_processor.h"
+#include "intent_processor.h"
+
+// Offline batch mode
+// Transcribes recorded questions and matches them against the intents on
+// every core: each worker has its own recognizer on the shared model.
+// input is a directory of .wav files, a flight recorder manifest (.jsonl),
+// a single .wav file, or a text file listing one WAV path per line.
+// Results are written in input order as CSV, or as JSON lines when the
+// output name ends in .jsonl.
+#define BATCH_MAX_JOBS 64
+#define BATCH_MATCHES 3           // Matches per file in JSONL output (CSV has the best)
+
+// jobs 0 uses one worker per online CPU; output NULL or "-" writes to stdout.
+// Returns 0 if every file was processed, -1 if none could be, 1 otherwise.
+int run_batch_transcription(SpeechModel *model, IntentProcessor *intents,
+                            const char *input, const char *output, size_t jobs);
+
+#endif // BATCH_TRANSCRIBER_H
@@ -0,0 +1,64 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "speech_processor.h"
+#include "speculation.h"
+
+// Configuration file
+// INI-style settings with named profiles. Keys before the first [section]
+// apply to every profile; a [NAME] section holds the settings of profile
+// NAME, applied on top of them. The profile is chosen with --profile, or
+// with a top-level "profile = NAME" line. Every key of every section is
+// validated, so a typo in an unused profile is still reported.
+//
+//     # vaani.conf
+//     profile = noisy-site
+//     log.filter = info
+//
+//     [noisy-site]
+//     audio.silence_threshold = 900
+//     intent.min_similarity = 0.6
+//
+// Keys marked "restart" in config.c are read once at startup; the rest are
+// applied again when the file is reloaded (SIGHUP).
+#define CONFIG_DEFAULT_PATH "vaani.conf"    // Optional; an explicit --config must exist
+#define CONFIG_NAME_LENGTH 64
+#define CONFIG_PATH_LENGTH 256
+#define CONFIG_LINE_LENGTH 512
+#define CONFIG_START_DELAY_MS 3000          // Default pause after the greeting
+#define CONFIG_TURN_PAUSE_MS 2000           // Default pause between turns
+
+typedef struct {
+    char profile[CONFIG_NAME_LENGTH];       // Empty when no profile is in use
+    SpeechConfig speech;
+    TtsConfig tts;
+    float intent_min_similarity;
+    size_t intent_group_fanout;
+    char intents_csv[CONFIG_PATH_LENGTH];
+    bool speculation_enabled;
+    SpeculationConfig speculation;
+    size_t model_budget_mb;                 // 0: MODEL_MEMORY_BUDGET_PERCENT of RAM
+    size_t intents_budget_mb;               // 0: unlimited
+    size_t audio_budget_mb;                 // 0: unlimited
+    size_t tts_budget_mb;                   // 0: unlimited
+    size_t batch_jobs;                      // 0: one per CPU
+    unsigned int start_delay_ms;            // After the greeting
+    unsigned int turn_pause_ms;             // Between turns of the microphone loop
+    char log_filter[CONFIG_LINE_LENGTH];
+} VaaniConfig;
+
+void default_config(VaaniConfig *config);
+
+// Apply the settings of path (NULL for CONFIG_DEFAULT_PATH, which may be
+// missing) and profile (NULL for the one named in the file) to config.
+// On any error every problem is logged with its line and config is left
+// unchanged. Returns false on error.
+bool load_config(const char *path, const char *profile, VaaniConfig *config);
+
+// For a reload: copy the settings that are only read at startup from running
+// into loaded, warning about each one the file changed. Returns true if any did.
+bool keep_startup_settings(const VaaniConfig *running, VaaniConfig *loaded);
+
+#endif // CONFIG_H
@@ -0,0 +1,95 @@
+#ifndef EMBEDDING_MATCHER_H
+#define EMBEDDING_MATCHER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Optional semantic matcher: questions are embedded offline by
+// tools/build_embeddings (SIF-weighted average of word vectors), stored as
+// int8 vectors with an IVF coarse quantizer, and searched at runtime.
+// Both files live next to the CSV and are optional; without them
+// matching is TF-IDF only.
+#define EMBEDDING_MODEL_FILE "word_vectors.bin"
+#define EMBEDDING_MODEL_PATH "data/" EMBEDDING_MODEL_FILE
+#define EMBEDDING_INDEX_FILE "Intents.emb"
+#define EMBEDDING_INDEX_PATH "data/" EMBEDDING_INDEX_FILE
+
+#define EMBEDDING_MAX_DIM 512         // Largest supported vector dimension
+#define EMBEDDING_NPROBE 8            // IVF lists scanned per query
+#define EMBEDDING_CANDIDATES 32       // Candidates taken from each matcher before fusion
+#define EMBEDDING_FUSION_WEIGHT 0.35f // Share of the fused score from the embedding cosine
+#define EMBEDDING_SIF_A 1e-3f         // Smooth inverse frequency constant
+
+// File formats (little-endian, all sections 16-byte aligned).
+// Word vectors: header, uint32 word_offsets[count + 1] into a string blob of
+// sorted lowercase words, float scales[count], float weights[count],
+// int8 vectors[count * dim_padded].
+// Intent embeddings: header, float centroids[lists * dim_padded],
+// uint32 list_offsets[lists + 1], uint32 list_rows[rows],
+// float scales[rows], int8 vectors[rows * dim_padded] in row order.
+#define WORD_VECTORS_MAGIC 0x31565756u      // "VWV1"
+#define EMBEDDING_INDEX_MAGIC 0x31454956u   // "VIE1"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t dim;            // Real dimension
+    uint32_t dim_padded;     // dim rounded up to a multiple of 16 (zero filled)
+    uint32_t count;          // Words, or rows for an embedding index
+    uint32_t lists;          // IVF lists (0 for word vectors)
+    uint32_t blob_size;      // String blob bytes (0 for an embedding index)
+    uint64_t fingerprint;    // Hash of the CSV questions the index was built from
+} EmbeddingFileHeader;
+
+typedef struct WordVectors WordVectors;
+typedef struct EmbeddingIndex EmbeddingIndex;
+
+// Query vector quantized the same way as the stored rows
+typedef struct {
+    int8_t values[EMBEDDING_MAX_DIM];
+    float scale;
+} QueryEmbedding;
+
+typedef struct {
+    uint32_t row;
+    float similarity;
+} EmbeddingHit;
+
+// Map a word vector file; NULL if missing or invalid
+WordVectors* load_word_vectors(const char* path);
+void free_word_vectors(WordVectors* model);
+// Mapped file plus bookkeeping; 0 for NULL
+size_t word_vectors_bytes(const WordVectors* model);
+size_t word_vectors_dim(const WordVectors* model);
+size_t word_vectors_padded_dim(const WordVectors* model);
+
+// L2-normalized SIF-weighted average of the known words in text
+// out holds word_vectors_padded_dim() floats. Returns false if no word is known.
+bool embed_text(const WordVectors* model, const char* text, float* out);
+
+// Quantize a normalized float vector to int8 with one scale; returns the scale
+float quantize_embedding(const float* in, size_t dim, int8_t* out);
+
+// Hash of the question texts in row order, stored in the index file so a
+// stale index is never used against an edited CSV
+uint64_t embedding_fingerprint(uint64_t hash, const char* question);
+#define EMBEDDING_FINGERPRINT_SEED 14695981039346656037ull
+
+// Map an embedding index built for rows questions with the given fingerprint;
+// NULL (with a message) if missing, stale or built with another model
+EmbeddingIndex* load_embedding_index(const char* path, const WordVectors* model,
+                                     size_t rows, uint64_t fingerprint);
+void free_embedding_index(EmbeddingIndex* index);
+size_t embedding_index_bytes(const EmbeddingIndex* index);
+
+// Embed and quantize text; false if none of its words are in the model
+bool encode_query(const EmbeddingIndex* index, const char* text, QueryEmbedding* query);
+
+// Cosine between the query and one stored row
+float embedding_similarity(const EmbeddingIndex* index, const QueryEmbedding* query, size_t row);
+
+// Best k rows over the nprobe closest IVF lists, best first
+size_t embedding_search(const EmbeddingIndex* index, const QueryEmbedding* query,
+                        size_t nprobe, EmbeddingHit* hits, size_t k);
+
+#endif // EMBEDDING_MATCHER_H
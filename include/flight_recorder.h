@@ -0,0 +1,51 @@
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "speech_processor.h"
+#include "intent_processor.h"
+
+// Flight recorder
+// Opt-in log of every turn for replaying field problems: the conditioned
+// audio (IMA ADPCM WAV, 4:1), the transcript, the top matches and stage
+// timings. A background thread does the encoding and file I/O, so recording
+// a turn costs one memcpy; if the writer falls behind, turns are dropped
+// rather than delaying the caller.
+//
+// Layout of the log directory:
+//   turn-<seq>.wav    one file per turn, playable and decodable by any WAV reader
+//   manifest.jsonl    one JSON object per turn (manifest.1.jsonl after rotation)
+// Oldest turns are deleted to keep the directory under max_bytes.
+#define FLIGHT_RECORDER_DIR "flight"
+#define FLIGHT_RECORDER_MAX_BYTES (64UL << 20)
+#define FLIGHT_RECORDER_SLOTS 4             // Turns buffered for the writer
+#define FLIGHT_MAX_MATCHES 3
+#define FLIGHT_MAX_STAGES 8
+#define FLIGHT_MANIFEST_FILE "manifest.jsonl"
+
+typedef struct FlightRecorder FlightRecorder;
+typedef struct FlightRecord FlightRecord;
+
+// Start the writer for dir (created if missing); NULL on failure
+FlightRecorder *start_flight_recorder(const char *dir, size_t max_bytes);
+
+// Write out queued turns and stop the writer
+void stop_flight_recorder(FlightRecorder *recorder);
+
+// Take a free record for a new turn; NULL if every slot is still queued
+// (the turn is then not recorded)
+FlightRecord *flight_record_begin(FlightRecorder *recorder);
+
+// Fill in a record; the audio is copied, up to BUFFER_SIZE samples
+void flight_record_audio(FlightRecord *record, const int16_t *samples, size_t count);
+void flight_record_transcript(FlightRecord *record, const char *text);
+void flight_record_matches(FlightRecord *record, IntentProcessor *intents, const char *text);
+void flight_record_stage(FlightRecord *record, const char *name, double ms);
+
+// Queue the record for writing (or discard it); either way the slot returns
+// to the recorder once written
+void flight_record_commit(FlightRecorder *recorder, FlightRecord *record);
+void flight_record_discard(FlightRecorder *recorder, FlightRecord *record);
+
+#endif // FLIGHT_RECORDER_H
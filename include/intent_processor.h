@@ -2,11 +2,40 @@
 #define INTENT_PROCESSOR_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 #define MAX_QUESTION_LENGTH 1024
 #define MAX_ANSWER_LENGTH 2048
 #define MAX_INTENT_LENGTH 256
 
+// Intent data source
+#define INTENTS_CSV_DIR "data"
+#define INTENTS_CSV_FILE "Intents.csv"
+#define INTENTS_CSV_PATH INTENTS_CSV_DIR "/" INTENTS_CSV_FILE
+
+// Hot reload: rebuild the index in the background whenever the CSV changes
+#define INTENT_HOT_RELOAD 1
+#define INTENT_RELOAD_SETTLE_MS 200   // Wait for writes to settle before reloading
+
+// Two-stage retrieval: score one centroid per Intent label, then rank only
+// the questions of the best fanout intents. It is approximate (a question
+// outside those intents can be missed), so it is off unless a fanout is set
+// with set_intent_group_fanout; tables under INTENT_GROUP_MIN_QUESTIONS rows
+// are always scored exactly. Query scratch is sized for
+// INTENT_GROUP_FANOUT_TYPICAL.
+#define INTENT_GROUP_FANOUT 0
+#define INTENT_GROUP_FANOUT_TYPICAL 8
+#define INTENT_GROUP_MIN_QUESTIONS 2000
+
+// Cosine similarity a match needs before find_matching_answer answers with it
+#define INTENT_MIN_SIMILARITY 0.5f
+
+// Queries take their scratch memory from slots preallocated with the index.
+// Up to INTENT_QUERY_SCRATCH_SLOTS concurrent queries asking for at most
+// INTENT_QUERY_MAX_K matches run without calling malloc.
+#define INTENT_QUERY_SCRATCH_SLOTS 8
+#define INTENT_QUERY_MAX_K 64
+
 // Structure to hold a single intent entry
 typedef struct {
     char question[MAX_QUESTION_LENGTH];
@@ -14,14 +43,58 @@ typedef struct {
     char intent[MAX_INTENT_LENGTH];
 } IntentEntry;
 
-// Initialize the intent processor with data from CSV
-bool initialize_intent_processor(void);
+// A scored candidate returned by find_top_matches
+typedef struct {
+    size_t index;              // Row in the intent table
+    float similarity;          // Cosine similarity, 1.0 for an exact match
+    bool exact;                // Question matched the text exactly (case-insensitive)
+    const IntentEntry* entry;
+} IntentMatch;
+
+// Handle to one loaded intent data set. Every function below is thread-safe;
+// queries never block each other or a background reload.
+typedef struct IntentProcessor IntentProcessor;
+
+// Initialize the intent processor with data from a CSV
+// csv_path NULL uses INTENTS_CSV_PATH. Returns NULL on failure.
+IntentProcessor* initialize_intent_processor(const char* csv_path);
 
 // Clean up intent processor resources
-void cleanup_intent_processor(void);
+void cleanup_intent_processor(IntentProcessor* ip);
 
 // Find matching answer for a given text
-// Returns NULL if no match found
-const char* find_matching_answer(const char* text);
+// The answer is copied into answer (so it survives a reload).
+// Returns answer, or NULL if no match found
+const char* find_matching_answer(IntentProcessor* ip, const char* text, char* answer, size_t answer_size);
+
+// True if find_matching_answer would answer with match (an exact match or
+// one above its similarity threshold)
+bool intent_match_accepted(IntentProcessor* ip, const IntentMatch* match);
+
+// Find the k best matching questions for text, best first
+// Returns the number of matches written to matches (at most k).
+// Entries point into the current intent table; hold intent_read_lock
+// across the call and any use of them if the CSV may be reloaded.
+size_t find_top_matches(IntentProcessor* ip, const char* text, IntentMatch* matches, size_t k);
+
+// Rows of the current intent table, for offline tools
+// Hold intent_read_lock while using the returned entry.
+size_t get_intent_count(IntentProcessor* ip);
+const IntentEntry* get_intent_entry(IntentProcessor* ip, size_t index);
+
+// Set how many intents are re-ranked in two-stage retrieval (0 disables it)
+void set_intent_group_fanout(IntentProcessor* ip, size_t fanout);
+
+// Set the similarity an answer needs (INTENT_MIN_SIMILARITY by default)
+void set_intent_min_similarity(IntentProcessor* ip, float similarity);
+
+// Rebuild the index from the CSV and publish it atomically
+// Queries already running keep using the previous table until they finish
+bool reload_intents(IntentProcessor* ip);
+
+// Read-side section: entries returned by find_top_matches stay valid until the
+// matching unlock, even across a reload. Never blocks; may nest.
+unsigned int intent_read_lock(IntentProcessor* ip);
+void intent_read_unlock(IntentProcessor* ip, unsigned int token);
 
 #endif // INTENT_PROCESSOR_H 
\ No newline at end of file
@@ -0,0 +1,83 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdbool.h>
+
+// Leveled, asynchronous logging
+// log_* format the message into a slot of a lock-free ring and return; a
+// background thread writes the slots to stderr. A full ring drops messages
+// (and counts them) rather than making capture or matching wait. Before
+// start_logging and after stop_logging messages are written directly.
+//
+// Each source file sets its module before including this header:
+//     #define LOG_MODULE LOG_MODULE_AUDIO
+//     #include "log.h"
+#define LOG_RING_SLOTS 1024                 // Power of two
+#define LOG_MESSAGE_LENGTH 256              // Longer messages are truncated
+#define LOG_DRAIN_INTERVAL_MS 20            // How often the writer thread looks for messages
+
+typedef enum {
+    LOG_LEVEL_DEBUG,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_OFF,
+} LogLevel;
+
+typedef enum {
+    LOG_MODULE_MAIN,
+    LOG_MODULE_AUDIO,
+    LOG_MODULE_SPEECH,
+    LOG_MODULE_INTENT,
+    LOG_MODULE_MODELS,
+    LOG_MODULE_SERVICE,
+    LOG_MODULE_RECORDER,
+    LOG_MODULE_BATCH,
+    LOG_MODULE_CONFIG,
+    LOG_MODULE_COUNT,
+} LogModule;
+
+// Levels below this are compiled out. Release builds keep info and above;
+// build with `make LOG_DEBUG=1` to keep debug messages.
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_INFO
+#endif
+
+// Runtime level of every module until changed
+#define LOG_DEFAULT_LEVEL LOG_LEVEL_INFO
+
+#ifndef LOG_MODULE
+#define LOG_MODULE LOG_MODULE_MAIN
+#endif
+
+#define LOG_AT(level, ...) \
+    do { \
+        if ((level) >= LOG_COMPILE_LEVEL && log_enabled(LOG_MODULE, (level))) { \
+            log_write(LOG_MODULE, (level), __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define log_debug(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define log_info(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define log_warn(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define log_error(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+// Start the writer thread. Returns false (and keeps logging synchronously)
+// if it cannot be started.
+bool start_logging(void);
+// Write out what is queued and stop the writer thread
+void stop_logging(void);
+
+// Apply a filter such as "info", "debug", or "warn,audio=debug,intent=off":
+// a bare level sets every module, module=level sets one. Returns false if
+// spec has an unknown module or level (the valid parts are still applied).
+bool set_log_filter(const char *spec);
+// True if set_log_filter would accept spec; changes nothing
+bool check_log_filter(const char *spec);
+void set_log_level(LogModule module, LogLevel level);
+
+bool log_enabled(LogModule module, LogLevel level);
+void log_write(LogModule module, LogLevel level, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+#endif // LOG_H
@@ -0,0 +1,49 @@
+#ifndef MEMORY_ACCOUNTING_H
+#define MEMORY_ACCOUNTING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Memory accounting
+// Each subsystem reports the memory it holds for long periods (models,
+// intent index snapshots, audio buffers, prepared answers), so the footprint
+// can be broken down without a heap profiler. A subsystem can have a budget:
+// loads that would exceed it are refused (memory_reserve returns false) and
+// counted. Counters are process-wide and lock-free, so any thread can update
+// them.
+#define MEMORY_REPORT_LENGTH 1024
+
+typedef enum {
+    MEMORY_MODELS,          // Loaded Vosk models (budget: the model manager's)
+    MEMORY_INTENTS,         // Intent tables, TF-IDF index, embeddings and word vectors
+    MEMORY_AUDIO,           // Recording buffers, file sources and the loopback ring
+    MEMORY_TTS,             // Prepared answers waiting in TTS_PREPARE_DIR
+    MEMORY_SUBSYSTEM_COUNT,
+} MemorySubsystem;
+
+typedef struct {
+    size_t current;
+    size_t peak;
+    size_t budget;          // 0: unlimited
+    unsigned long refused;  // Reservations turned down by the budget
+} MemoryUsage;
+
+// Count bytes against subsystem whatever its budget
+void memory_charge(MemorySubsystem subsystem, size_t bytes);
+void memory_release(MemorySubsystem subsystem, size_t bytes);
+// Count bytes unless that would take subsystem over its budget. Returns
+// false, counting the refusal, if it would.
+bool memory_reserve(MemorySubsystem subsystem, size_t bytes);
+
+// bytes 0 removes the budget; applies to later reservations
+void set_memory_budget(MemorySubsystem subsystem, size_t bytes);
+void get_memory_usage(MemorySubsystem subsystem, MemoryUsage *usage);
+const char *memory_subsystem_name(MemorySubsystem subsystem);
+
+// Current and peak use of every subsystem, then the process resident set
+// and the largest Festival or aplay child, one line each. Returns the length.
+size_t format_memory_report(char *out, size_t size);
+// Write the report to the log
+void log_memory_report(const char *reason);
+
+#endif // MEMORY_ACCOUNTING_H
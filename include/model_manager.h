@@ -0,0 +1,73 @@
+#ifndef MODEL_MANAGER_H
+#define MODEL_MANAGER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "speech_processor.h"
+
+// Model manager
+// Knows one Vosk model per language, loads each on first use and keeps the
+// loaded set under a memory budget by unloading the least recently used
+// model that no session is using. A model that does not fit while every
+// other model is in use is replaced by the fallback model when possible,
+// and acquire_model says so; with no fallback it is not loaded.
+// The stock en-in model takes about 1 GB, so the default budget is a share
+// of RAM rather than a fixed size.
+#define MODEL_MEMORY_BUDGET_PERCENT 75          // Of physical memory, when no budget is given
+#define MODEL_MAX_LANGUAGES 8
+#define MODEL_LANGUAGE_LENGTH 16
+#define MODEL_DEFAULT_LANGUAGE "en-in"
+#define MODEL_FALLBACK_LANGUAGE "en-small"     // Used when the requested model does not fit
+
+// Directories searched for the model directories named below
+#define MODEL_SEARCH_DIRS { "/usr/local/share/vosk-models", "/opt/vosk-models", \
+                            "/usr/share/vosk-models", ".", NULL }
+#define MODEL_DIR_EN_IN "vosk-model-en-in-0.5"
+#define MODEL_DIR_HI "vosk-model-hi-0.22"
+#define MODEL_DIR_EN_SMALL "vosk-model-small-en-in-0.4"
+
+// Language identification
+// The small English model decodes the first MODEL_LID_WINDOW_MS of an
+// utterance; confident words mean English, anything else MODEL_LID_OTHER.
+// The small model stays loaded once language identification has been used.
+#define MODEL_LID_LANGUAGE MODEL_FALLBACK_LANGUAGE
+#define MODEL_LID_OTHER "hi"
+#define MODEL_LID_WINDOW_MS 2000
+#define MODEL_LID_MIN_CONFIDENCE 0.75f
+
+typedef struct ModelManager ModelManager;
+
+// budget_bytes 0 means MODEL_MEMORY_BUDGET_PERCENT of physical memory
+ModelManager *create_model_manager(size_t budget_bytes);
+// Every acquired model must have been released
+void destroy_model_manager(ModelManager *manager);
+
+// Make language available from the model directory at path. Nothing is
+// loaded until the language is first acquired. Returns false if path is not
+// a directory or the table is full.
+bool register_model(ModelManager *manager, const char *language, const char *path);
+
+// Register the en-in, hi and en-small models found in MODEL_SEARCH_DIRS
+// (a local vosk-model directory also counts as en-in), skipping languages
+// already registered. Returns the number of these languages available.
+size_t register_default_models(ModelManager *manager);
+
+bool has_language(const ModelManager *manager, const char *language);
+
+// Model for language (NULL means MODEL_DEFAULT_LANGUAGE), loaded if needed.
+// Release it when the sessions using it are gone. NULL if no model could be
+// loaded within the budget. If actual is not NULL it is set to the language
+// of the returned model, which is MODEL_FALLBACK_LANGUAGE when the requested
+// one did not fit.
+SpeechModel *acquire_model(ModelManager *manager, const char *language, const char **actual);
+void release_model(ModelManager *manager, SpeechModel *model);
+
+// Language of an utterance: MODEL_DEFAULT_LANGUAGE or MODEL_LID_OTHER.
+// Without both of those and the LID model registered, returns the default.
+const char *identify_language(ModelManager *manager, const int16_t *samples, size_t count);
+
+// Print the registered models, their state and memory use
+void print_model_stats(ModelManager *manager);
+
+#endif // MODEL_MANAGER_H
@@ -0,0 +1,33 @@
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <stddef.h>
+#include <sched.h>
+
+// Real-time scheduling configuration
+// Priorities are SCHED_FIFO priorities (1-99); 0 keeps the default scheduler.
+// CPU numbers pin a thread to that core; -1 leaves it free to migrate.
+// On a 4-core board, keeping capture on its own core away from decode and
+// Festival avoids the scheduler delays that cause capture overruns.
+#define CAPTURE_RT_PRIORITY 70
+#define CAPTURE_CPU 3
+#define DECODE_CPU -1
+#define TTS_CPU -1
+
+// Apply SCHED_FIFO with the given priority to the calling thread
+// Returns 0 on success, -1 if the priority could not be applied
+int set_thread_realtime(int priority);
+
+// Pin the calling thread to a single CPU, saving the previous mask in saved
+// (saved may be NULL). Returns 0 on success, -1 on failure or if cpu < 0
+int pin_thread_to_cpu(int cpu, cpu_set_t *saved);
+
+// Restore an affinity mask previously saved by pin_thread_to_cpu
+void restore_thread_affinity(const cpu_set_t *saved);
+
+// Allocate a page-aligned buffer and lock it into RAM so capture never
+// takes a page fault. Falls back to an unlocked buffer if mlock is refused.
+void *alloc_locked_buffer(size_t bytes);
+void free_locked_buffer(void *buffer, size_t bytes);
+
+#endif // REALTIME_H
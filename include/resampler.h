@@ -0,0 +1,30 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Taps per polyphase branch (must be a multiple of 8 for the SIMD kernels)
+#define RESAMPLER_TAPS 64
+// Input frames downmixed and filtered per internal block
+#define RESAMPLER_BLOCK 1024
+
+// Fixed-ratio polyphase resampler with built-in downmix to mono.
+// Coefficients are Q15 so the inner loop is a 16-bit multiply-accumulate,
+// implemented with NEON on ARM and SSE2 on x86 with a scalar fallback.
+typedef struct Resampler Resampler;
+
+// Create a resampler converting interleaved in_rate/channels audio to mono out_rate
+Resampler *resampler_create(unsigned int in_rate, unsigned int out_rate, unsigned int channels);
+void resampler_destroy(Resampler *rs);
+
+// Reset filter history, e.g. between recordings
+void resampler_reset(Resampler *rs);
+
+// Convert frames of interleaved input, writing at most max_out mono samples.
+// Input beyond what max_out samples need is discarded.
+// Returns the number of samples written to out.
+size_t resampler_process(Resampler *rs, const int16_t *in, size_t frames,
+                         int16_t *out, size_t max_out);
+
+#endif // RESAMPLER_H
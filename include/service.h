@@ -0,0 +1,57 @@
+#ifndef SERVICE_H
+#define SERVICE_H
+
+#include <stdint.h>
+#include "speech_processor.h"
+#include "intent_processor.h"
+#include "model_manager.h"
+
+// Local service API
+// Other processes on the device (e.g. the kiosk UI) talk to the running
+// Vaani instance over a Unix domain socket and share its loaded models.
+// The default socket lives in the service's runtime directory (systemd's
+// RuntimeDirectory=vaani, found through $RUNTIME_DIRECTORY), not in a
+// world-writable one where another user could take the name first.
+#define VAANI_SOCKET_PATH "/run/vaani/vaani.sock"
+#define VAANI_SOCKET_NAME "vaani.sock"  // Within $RUNTIME_DIRECTORY when set
+#define VAANI_SOCKET_MODE 0660
+#define SERVICE_MAX_PAYLOAD (1 << 20)   // Largest accepted message payload
+#define SERVICE_MAX_TOP_K 16
+#define SERVICE_BACKLOG 8
+
+// Wire format: every message is a 5-byte header followed by its payload
+//   uint32 length  payload size in bytes, little-endian
+//   uint8  type    one of the MSG_* codes below
+// Strings are UTF-8 and not NUL-terminated; their length is implied by the
+// payload or given by a little-endian uint16 prefix.
+
+// Requests
+#define MSG_INTENT_QUERY 'Q'    // uint8 k, text
+#define MSG_AUDIO_BEGIN  'A'    // uint32 sample rate (must equal SAMPLE_RATE),
+                                // optional language (default MODEL_DEFAULT_LANGUAGE)
+#define MSG_AUDIO_DATA   'D'    // s16le mono samples (even length)
+#define MSG_AUDIO_END    'E'    // empty
+#define MSG_TTS          'S'    // text to speak
+#define MSG_MEMORY_QUERY 'M'    // empty
+
+// Responses
+#define MSG_INTENT_RESULT 'R'   // uint8 count, then per match: float32 similarity,
+                                // uint32 row index, u16-prefixed intent, question, answer
+#define MSG_PARTIAL       'P'   // partial transcript, sent when it changes
+#define MSG_TRANSCRIPT    'T'   // final transcript, sent after MSG_AUDIO_END
+#define MSG_OK            'K'   // acknowledges MSG_TTS (empty) and MSG_AUDIO_BEGIN (the
+                                // language transcribing the stream, MODEL_FALLBACK_LANGUAGE
+                                // if the requested model did not fit)
+#define MSG_MEMORY_REPORT 'U'   // memory use per subsystem, one line each (as logged on SIGUSR1)
+#define MSG_ERROR         'X'   // error message
+
+// Serve requests on socket_path from a background thread
+// Clients share models and intents, which must outlive the service.
+// Returns 0 on success, -1 if the socket could not be created
+int start_service(const char *socket_path, ModelManager *models, IntentProcessor *intents);
+
+// Serve requests on socket_path from the calling thread (does not return
+// unless the listening socket fails)
+int run_service(const char *socket_path, ModelManager *models, IntentProcessor *intents);
+
+#endif // SERVICE_H
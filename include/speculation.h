@@ -0,0 +1,49 @@
+#ifndef SPECULATION_H
+#define SPECULATION_H
+
+#include <stdbool.h>
+#include "speech_processor.h"
+#include "intent_processor.h"
+
+// Speculative matching
+// Intent matching runs on every partial result while the user is speaking.
+// Once the top intent has been confident and unchanged for prepare_ms of
+// audio its answer is synthesized in the background; after endpoint_ms
+// capture ends without waiting for trailing silence. The final transcript is
+// always matched again, and the prepared answer is only played if it agrees.
+#define SPECULATION_MIN_SIMILARITY 0.7f   // Top match needed to speculate (exact matches always qualify)
+#define SPECULATION_MIN_MARGIN 0.1f       // Lead over the best match of any other intent
+#define SPECULATION_PREPARE_MS 300        // Stable this long: start synthesizing the answer
+#define SPECULATION_ENDPOINT_MS 800       // Stable this long: end capture (0 disables)
+
+typedef struct {
+    float min_similarity;
+    float min_margin;
+    double prepare_ms;
+    double endpoint_ms;
+} SpeculationConfig;
+
+typedef struct Speculation Speculation;
+
+void default_speculation_config(SpeculationConfig *config);
+
+// config NULL uses the defaults above
+Speculation *create_speculation(IntentProcessor *intents, const SpeculationConfig *config);
+void destroy_speculation(Speculation *speculation);
+// Use config from the next partial result; call between turns
+void speculation_set_config(Speculation *speculation, const SpeculationConfig *config);
+
+// Forget the previous turn, discarding any answer that was prepared
+void speculation_reset(Speculation *speculation);
+
+// PartialHandler for speech_to_text_with_partials (user is the Speculation)
+int speculation_on_partial(const char *partial, double audio_ms, void *user);
+
+// True if the last turn's capture was ended by speculation
+bool speculation_endpointed(const Speculation *speculation);
+
+// Speak answer on sink (see speak_text), using the prepared audio if it was
+// synthesized for the same text. Returns true if the prepared audio was used.
+bool speculation_speak(Speculation *speculation, AudioSink *sink, const char *answer);
+
+#endif // SPECULATION_H
@@ -3,15 +3,36 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <vosk_api.h>
+#include <alsa/asoundlib.h>
 
 // Constants
+// Values marked "default" can be changed at runtime (CaptureConfig, SpeechConfig,
+// TtsConfig below), normally from a config file profile
 #define SAMPLE_RATE 16000
-#define RECORDING_TIME_SEC 5
+#define RECORDING_TIME_SEC 5                      // Longest recording; sizes the audio buffers
 #define FRAME_SIZE 8000
 #define BUFFER_SIZE (SAMPLE_RATE * RECORDING_TIME_SEC)
-#define SILENCE_THRESHOLD 500
+#define SILENCE_THRESHOLD 500                     // Default mean level of a silent window
+#define SILENCE_TIMEOUT_MS 1000                   // Default trailing silence that ends a recording
+#define CAPTURE_CHUNK_FRAMES (SAMPLE_RATE / 4)  // Frames per capture read (250 ms)
+
+// Low-latency capture configuration
+// With mmap enabled the device wakes us every period (20 ms) and frames are
+// read straight out of the DMA area; set to 0 to force read/write access.
+#define CAPTURE_USE_MMAP 1
+#define CAPTURE_PERIOD_MS 20                      // Default period length at any rate
+#define CAPTURE_PERIODS 8                         // Default periods in the ring buffer
+
+// Native-rate capture
+// Open hw: at the device's own rate and channel count and convert to
+// SAMPLE_RATE mono in-process instead of through ALSA's plug layer.
+// Falls back to plughw: if the device cannot be opened this way.
+#define CAPTURE_NATIVE_RATE 1
+#define CAPTURE_NATIVE_RATE_HINT 48000            // Preferred rate when the device offers several
 #define MAX_TEXT_LENGTH 1024
+#define PARTIAL_INTERVAL_MS 100                   // Default audio between partial results passed to a PartialHandler
 
 // TTS Voice Configuration
 // Available female voices (recommended for clarity):
@@ -20,28 +41,166 @@
 // - "voice_us2_mbrola"  : US2 MBROLA (high quality female)
 // - "voice_us3_mbrola"  : US3 MBROLA (alternative female)
 // - "voice_cmu_us_slt_arctic_hts" : CMU SLT Arctic (very clear, natural female)
-#define TTS_VOICE "voice_cmu_us_slt_arctic_hts"
+#define TTS_VOICE "voice_cmu_us_slt_arctic_hts"  // Default voice
+#define TTS_VOICE_LENGTH 64
+#define TTS_PREPARE_DIR "/tmp"                    // Where pre-synthesized answers are rendered
+#define TTS_BYTES_PER_CHAR 2200                   // Estimated WAV size per character of text, until rendered
+
+// Runtime capture settings of an AudioCapture, read at the start of each recording
+typedef struct {
+    unsigned int recording_ms;      // Longest recording, up to RECORDING_TIME_SEC
+    int silence_threshold;          // Mean |sample| below which a 250 ms window is silent
+    unsigned int silence_ms;        // Trailing silence that ends a recording
+    unsigned int period_ms;         // ALSA mmap period
+    unsigned int periods;           // ALSA mmap periods in the ring buffer
+    bool noise_suppression;         // Spectral subtraction in the conditioner
+    int rt_priority;                // SCHED_FIFO priority of the capture thread, 0 for none
+    int capture_cpu;                // Core for the capture thread, -1 for any
+} CaptureConfig;
+
+// Runtime settings of a SpeechSession
+typedef struct {
+    CaptureConfig capture;
+    unsigned int partial_interval_ms;   // Audio between partial results
+    int decode_cpu;                     // Core for decoding, -1 for any
+} SpeechConfig;
+
+// Text-to-speech settings; they apply to the whole process, as Festival does
+typedef struct {
+    char voice[TTS_VOICE_LENGTH];
+    int cpu;                        // Core for synthesis and playback, -1 for any
+} TtsConfig;
+
+// Capture statistics, accumulated across recordings
+typedef struct {
+    unsigned long recordings;       // Number of completed recordings
+    unsigned long frames_captured;  // Total frames delivered by the device
+    unsigned long xruns;            // Overruns recovered during capture
+    unsigned long allocations;      // Heap allocations on the capture thread (ALLOC_COUNT builds)
+} CaptureStats;
+
+// Consumer for captured frames (interleaved, in the device's channel layout).
+// frames may point into the device's DMA area and is only valid for the
+// duration of the call. Return non-zero to stop capture.
+typedef int (*AudioFrameHandler)(const int16_t *frames, size_t count, void *user);
 
-// Global Vosk model
-extern VoskModel *g_vosk_model;
+// Receives the current partial hypothesis while speech_to_text_with_partials
+// is recording, every PARTIAL_INTERVAL_MS of audio; audio_ms is the audio
+// decoded so far. Runs on the decoding thread. Return non-zero to end capture.
+typedef int (*PartialHandler)(const char *partial, double audio_ms, void *user);
+
+// Stage timings of the last speech_to_text call on a session
+typedef struct {
+    double capture_ms;              // Recording, with decoding overlapped
+    double finalize_ms;             // Final decode after capture ended
+} SpeechTimings;
+
+// Context handles
+// A SpeechModel is loaded once and shared read-only by any number of threads.
+// A SpeechSession owns a recognizer, capture resources and result buffers; it
+// is used by one thread at a time, so give each thread or client its own.
+typedef struct SpeechModel SpeechModel;
+typedef struct SpeechSession SpeechSession;
+typedef struct AudioCapture AudioCapture;
+typedef struct AudioSource AudioSource;     // Defined in audio_backend.h
+typedef struct AudioSink AudioSink;
 
 // Function declarations for model initialization
-int initialize_vosk_model(void);
-void cleanup_vosk_model(void);
+// path NULL searches the standard model locations
+SpeechModel *load_speech_model(const char *path);
+void free_speech_model(SpeechModel *model);
+
+// Function declarations for sessions
+SpeechSession *create_speech_session(SpeechModel *model);
+void destroy_speech_session(SpeechSession *session);
+void default_speech_config(SpeechConfig *config);
+// Use config from the next speech_to_text call on session
+void set_speech_session_config(SpeechSession *session, const SpeechConfig *config);
+// Start a new utterance (recognizer state and results are cleared)
+void reset_speech_session(SpeechSession *session);
+// Decode SAMPLE_RATE mono samples; returns 1 when a segment was finalized
+// (its text is then available from speech_session_result)
+int speech_session_accept(SpeechSession *session, const int16_t *samples, size_t count);
+// Text of the current partial hypothesis, last finalized segment, or the
+// final result (which ends the utterance). Valid until the next call on session.
+const char *speech_session_partial(SpeechSession *session);
+const char *speech_session_result(SpeechSession *session);
+const char *speech_session_final(SpeechSession *session);
+// Conditioned audio and timings of the last speech_to_text call, kept until
+// the next one on session
+const int16_t *speech_session_audio(const SpeechSession *session, size_t *samples);
+void get_speech_timings(const SpeechSession *session, SpeechTimings *timings);
+// Record from source (not owned; NULL for the default microphone) from the
+// next speech_to_text call on
+void set_speech_session_source(SpeechSession *session, AudioSource *source);
 
 // Function declarations for text-to-speech
+void default_tts_config(TtsConfig *config);
+// Applies to speech started after the call
+void set_tts_config(const TtsConfig *config);
 void text_to_speech(const char *text);
+// Speak text on sink; NULL lets Festival play it through its own output
+void speak_text(AudioSink *sink, const char *text);
+
+// Pre-synthesized speech
+// tts_prepare starts rendering text to a WAV file on a background thread
+// (Festival's text2wave) so that playback can start as soon as it is needed.
+// Clips count against the MEMORY_TTS budget until played or discarded;
+// tts_prepare returns NULL rather than exceed it.
+typedef struct TtsClip TtsClip;
+TtsClip *tts_prepare(const char *text);            // NULL on failure
+const char *tts_clip_text(const TtsClip *clip);
+int tts_clip_done(const TtsClip *clip);            // 1 once synthesis has finished
+// Wait for synthesis and play the clip on sink (NULL plays it with aplay);
+// returns 0, or -1 if synthesis or playback failed. The clip is freed either way.
+int tts_play(TtsClip *clip, AudioSink *sink);
+// Wait for synthesis and free the clip without playing it
+void tts_discard(TtsClip *clip);
 
 // Function declarations for speech-to-text
-// Returns the recognized text or NULL if recognition failed
-const char* speech_to_text(void);
+// Records from the session's audio source and decodes on session.
+// Returns the recognized text (owned by session) or NULL if recognition failed
+const char* speech_to_text(SpeechSession *session);
+// Like speech_to_text, passing partial results to handler (may be NULL)
+const char* speech_to_text_with_partials(SpeechSession *session, PartialHandler handler, void *user);
+// Decode recorded SAMPLE_RATE mono audio as one utterance on session.
+// confidence (may be NULL) receives the mean word confidence, 0 without words.
+// Returns the text (owned by session) or NULL if nothing was recognized.
+const char *transcribe_audio(SpeechSession *session, const int16_t *samples, size_t count,
+                             float *confidence);
+
+// Extract the string value of key ("text", "partial") from a Vosk JSON result
+// Returns the number of characters copied to out (0 if missing or empty)
+size_t extract_result_text(const char *json, const char *key, char *out, size_t out_size);
 
 // Function declarations for audio processing
-char* find_usb_audio_device(void);
-int16_t *record_audio(size_t *out_nsamps);
-void normalize_audio(int16_t *buffer, size_t samples);
-void remove_dc_offset(int16_t *buffer, size_t samples);
-int is_silence(const int16_t *buffer, size_t samples);
+// Writes the capture device name to device_name; returns 0, or -1 if none found
+int find_usb_audio_device(char *device_name, size_t size);
+// source is not owned; NULL creates the default ALSA source
+AudioCapture *create_audio_capture(AudioSource *source);
+void destroy_audio_capture(AudioCapture *capture);
+void default_capture_config(CaptureConfig *config);
+// Use config from the next recording on capture
+void set_audio_capture_config(AudioCapture *capture, const CaptureConfig *config);
+int16_t *record_audio(AudioCapture *capture, size_t *out_nsamps);
+// Record like record_audio while passing conditioned audio to consumer (on the
+// calling thread) as soon as it is available. A non-zero return ends capture.
+int16_t *record_audio_stream(AudioCapture *capture, size_t *out_nsamps,
+                             AudioFrameHandler consumer, void *user);
+// Record like record_audio_stream into a preallocated buffer of capacity
+// samples (at most recording_ms of audio). Returns 0, or -1 if nothing could be recorded.
+int record_audio_into(AudioCapture *capture, int16_t *buffer, size_t capacity, size_t *out_nsamps,
+                      AudioFrameHandler consumer, void *user);
+int16_t *alloc_audio_buffer(void);
+void free_audio_buffer(int16_t *buffer);
+void get_capture_stats(const AudioCapture *capture, CaptureStats *stats);
+
+// Function declarations for mmap capture
+int configure_mmap_capture(snd_pcm_t *handle, const CaptureConfig *config,
+                           unsigned int *rate, unsigned int *channels,
+                           snd_pcm_uframes_t *period_frames);
+int run_mmap_capture(snd_pcm_t *handle, snd_pcm_uframes_t period_frames,
+                     AudioFrameHandler handler, void *user, unsigned long *xruns);
 
 // Menu functions
 void clear_input_buffer(void);
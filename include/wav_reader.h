@@ -0,0 +1,16 @@
+#ifndef WAV_READER_H
+#define WAV_READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// WAV file input
+// Reads 16-bit PCM (any rate and channel count) and mono IMA ADPCM, the
+// format written by the flight recorder, and converts to SAMPLE_RATE mono.
+#define WAV_MAX_SECONDS 600     // Longer files are refused
+
+// Read path into a malloc'd buffer of SAMPLE_RATE mono samples (free with
+// free()). Returns NULL with a message on stderr if the file cannot be used.
+int16_t *read_wav_file(const char *path, size_t *out_samples);
+
+#endif // WAV_READER_H
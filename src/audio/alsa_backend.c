@@ -0,0 +1,311 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <alsa/asoundlib.h>
+#include "../../include/audio_backend.h"
+
+#define LOG_MODULE LOG_MODULE_AUDIO
+#include "../../include/log.h"
+
+// The PCM stays open and configured between recordings (close only stops
+// it), because opening and configuring it allocates. It is reopened when
+// the period settings change or after a capture error.
+typedef struct {
+    char device[64];            // Empty: search for a capture card when opening
+    snd_pcm_t *handle;          // NULL until the first open
+    bool use_mmap;
+    snd_pcm_uframes_t period_frames;
+    unsigned int rate;          // Format the handle was configured with
+    unsigned int channels;
+    unsigned int period_ms;     // Settings the handle was configured with
+    unsigned int periods;
+    bool failed;                // Last run ended with an error
+    int16_t *period;            // Read/write access reads here before delivery
+} AlsaSource;
+
+typedef struct {
+    char device[64];
+} AlsaSink;
+
+// Configure the device for read/write access with a FRAME_SIZE buffer
+static int configure_rw_capture(snd_pcm_t *capture_handle) {
+    snd_pcm_hw_params_t *hw_params;
+    int err;
+
+    // Allocate hardware parameters object
+    snd_pcm_hw_params_alloca(&hw_params);
+
+    // Fill with default values
+    if ((err = snd_pcm_hw_params_any(capture_handle, hw_params)) < 0) {
+        log_error("Cannot initialize hardware parameter structure: %s", snd_strerror(err));
+        return err;
+    }
+
+    // Set access type
+    if ((err = snd_pcm_hw_params_set_access(capture_handle, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0) {
+        log_error("Cannot set access type: %s", snd_strerror(err));
+        return err;
+    }
+
+    // Set sample format
+    if ((err = snd_pcm_hw_params_set_format(capture_handle, hw_params, SND_PCM_FORMAT_S16_LE)) < 0) {
+        log_error("Cannot set sample format: %s", snd_strerror(err));
+        return err;
+    }
+
+    // Set sample rate
+    unsigned int actual_rate = SAMPLE_RATE;
+    if ((err = snd_pcm_hw_params_set_rate_near(capture_handle, hw_params, &actual_rate, 0)) < 0) {
+        log_error("Cannot set sample rate: %s", snd_strerror(err));
+        return err;
+    }
+
+    // Set channels
+    if ((err = snd_pcm_hw_params_set_channels(capture_handle, hw_params, 1)) < 0) {
+        log_error("Cannot set channel count: %s", snd_strerror(err));
+        return err;
+    }
+
+    // Set buffer size
+    snd_pcm_uframes_t buffer_size = FRAME_SIZE;
+    if ((err = snd_pcm_hw_params_set_buffer_size_near(capture_handle, hw_params, &buffer_size)) < 0) {
+        log_error("Cannot set buffer size: %s", snd_strerror(err));
+        return err;
+    }
+
+    // Apply hardware parameters
+    if ((err = snd_pcm_hw_params(capture_handle, hw_params)) < 0) {
+        log_error("Cannot set parameters: %s", snd_strerror(err));
+        return err;
+    }
+
+    return 0;
+}
+
+// Open the hw: counterpart of a plughw: device at its native format with
+// mmap access; the capture pipeline converts it to SAMPLE_RATE mono.
+// Returns the open handle, or NULL so the caller can fall back to plughw:
+static snd_pcm_t *open_native_capture(AlsaSource *alsa, const char *plug_device, const CaptureConfig *config,
+                                      unsigned int *rate, unsigned int *channels) {
+    snd_pcm_t *handle;
+    char hw_device[sizeof(alsa->device)];
+
+    *rate = CAPTURE_NATIVE_RATE_HINT;
+    *channels = 1;
+
+    if (strncmp(plug_device, "plug", 4) != 0) {
+        return NULL;
+    }
+    snprintf(hw_device, sizeof(hw_device), "%s", plug_device + 4);
+
+    if (snd_pcm_open(&handle, hw_device, SND_PCM_STREAM_CAPTURE, 0) < 0) {
+        return NULL;
+    }
+
+    if (configure_mmap_capture(handle, config, rate, channels, &alsa->period_frames) < 0) {
+        snd_pcm_close(handle);
+        return NULL;
+    }
+
+    log_debug("Capturing natively from %s", hw_device);
+    alsa->use_mmap = true;
+    return handle;
+}
+
+static void close_alsa_handle(AlsaSource *alsa) {
+    if (alsa->handle) {
+        snd_pcm_close(alsa->handle);
+        alsa->handle = NULL;
+    }
+}
+
+static int alsa_source_open(AudioSource *source, const CaptureConfig *config,
+                            unsigned int *rate, unsigned int *channels) {
+    AlsaSource *alsa = source->state;
+    char audio_device[64];
+    int err;
+
+    if (alsa->handle && !alsa->failed &&
+        alsa->period_ms == config->period_ms && alsa->periods == config->periods) {
+        *rate = alsa->rate;
+        *channels = alsa->channels;
+        goto prepare;
+    }
+    close_alsa_handle(alsa);
+    alsa->failed = false;
+
+    // Automatically find USB audio device
+    if (alsa->device[0]) {
+        snprintf(audio_device, sizeof(audio_device), "%s", alsa->device);
+    } else if (find_usb_audio_device(audio_device, sizeof(audio_device)) < 0) {
+        log_error("No suitable audio device found");
+        return -1;
+    }
+
+    alsa->use_mmap = false;
+    alsa->handle = CAPTURE_NATIVE_RATE ? open_native_capture(alsa, audio_device, config, rate, channels) : NULL;
+
+    if (!alsa->handle) {
+        // Open the audio device
+        if ((err = snd_pcm_open(&alsa->handle, audio_device, SND_PCM_STREAM_CAPTURE, 0)) < 0) {
+            log_error("Cannot open audio device %s: %s", audio_device, snd_strerror(err));
+            alsa->handle = NULL;
+            return -1;
+        }
+
+        // Prefer the low-latency mmap path, fall back to read/write access
+        *rate = SAMPLE_RATE;
+        *channels = 1;
+        if (CAPTURE_USE_MMAP &&
+            configure_mmap_capture(alsa->handle, config, rate, channels, &alsa->period_frames) == 0 &&
+            *rate == SAMPLE_RATE && *channels == 1) {
+            alsa->use_mmap = true;
+        } else if (configure_rw_capture(alsa->handle) < 0) {
+            close_alsa_handle(alsa);
+            return -1;
+        }
+        *rate = SAMPLE_RATE;
+        *channels = 1;
+    }
+    alsa->rate = *rate;
+    alsa->channels = *channels;
+    alsa->period_ms = config->period_ms;
+    alsa->periods = config->periods;
+
+prepare:
+    // Start recording
+    if ((err = snd_pcm_prepare(alsa->handle)) < 0) {
+        log_error("Cannot prepare audio interface: %s", snd_strerror(err));
+        close_alsa_handle(alsa);
+        return -1;
+    }
+    return 0;
+}
+
+static int alsa_source_run(AudioSource *source, AudioFrameHandler handler, void *user, unsigned long *xruns) {
+    AlsaSource *alsa = source->state;
+
+    if (alsa->use_mmap) {
+        int err = run_mmap_capture(alsa->handle, alsa->period_frames, handler, user, xruns);
+        alsa->failed = err < 0;
+        return err;
+    }
+
+    for (;;) {
+        snd_pcm_sframes_t rc = snd_pcm_readi(alsa->handle, alsa->period, CAPTURE_CHUNK_FRAMES);
+        if (rc < 0) {
+            if (rc == -EPIPE || rc == -ESTRPIPE) {
+                // Overrun: count it so it shows up in the log, then recover
+                (*xruns)++;
+                if (snd_pcm_recover(alsa->handle, (int)rc, 1) == 0) {
+                    continue;
+                }
+            }
+            alsa->failed = true;
+            return (int)rc;
+        }
+
+        if (handler(alsa->period, rc, user)) {
+            return 0;
+        }
+    }
+}
+
+// Stop capturing but keep the configured handle for the next recording; a
+// handle that failed (e.g. the USB card was unplugged) is closed instead
+static void alsa_source_close(AudioSource *source) {
+    AlsaSource *alsa = source->state;
+    if (alsa->failed) {
+        close_alsa_handle(alsa);
+    } else if (alsa->handle) {
+        snd_pcm_drop(alsa->handle);
+    }
+}
+
+static void alsa_source_destroy(AudioSource *source) {
+    AlsaSource *alsa = source->state;
+    close_alsa_handle(alsa);
+    free(alsa->period);
+    free(alsa);
+}
+
+AudioSource *create_alsa_source(const char *device) {
+    AudioSource *source = calloc(1, sizeof(AudioSource));
+    AlsaSource *alsa = calloc(1, sizeof(AlsaSource));
+    int16_t *period = malloc(CAPTURE_CHUNK_FRAMES * sizeof(int16_t));
+    if (!source || !alsa || !period) {
+        free(source);
+        free(alsa);
+        free(period);
+        return NULL;
+    }
+    if (device) {
+        snprintf(alsa->device, sizeof(alsa->device), "%s", device);
+    }
+    alsa->period = period;
+
+    source->name = "alsa";
+    source->open = alsa_source_open;
+    source->run = alsa_source_run;
+    source->close = alsa_source_close;
+    source->destroy = alsa_source_destroy;
+    source->state = alsa;
+    return source;
+}
+
+// The device is opened per clip, so other programs can use it between answers
+static int alsa_sink_play(AudioSink *sink, const int16_t *samples, size_t count) {
+    AlsaSink *alsa = sink->state;
+    snd_pcm_t *handle;
+    int err;
+
+    if ((err = snd_pcm_open(&handle, alsa->device, SND_PCM_STREAM_PLAYBACK, 0)) < 0) {
+        log_error("Cannot open playback device %s: %s", alsa->device, snd_strerror(err));
+        return -1;
+    }
+    if ((err = snd_pcm_set_params(handle, SND_PCM_FORMAT_S16_LE, SND_PCM_ACCESS_RW_INTERLEAVED,
+                                  1, SAMPLE_RATE, 1, AUDIO_SINK_LATENCY_US)) < 0) {
+        log_error("Cannot configure playback: %s", snd_strerror(err));
+        snd_pcm_close(handle);
+        return -1;
+    }
+
+    size_t written = 0;
+    while (written < count) {
+        snd_pcm_sframes_t rc = snd_pcm_writei(handle, samples + written, count - written);
+        if (rc < 0) {
+            // Underrun: recover and keep going
+            if ((err = snd_pcm_recover(handle, (int)rc, 1)) < 0) {
+                log_error("Playback error: %s", snd_strerror(err));
+                break;
+            }
+            continue;
+        }
+        written += rc;
+    }
+    snd_pcm_drain(handle);
+    snd_pcm_close(handle);
+    return written == count ? 0 : -1;
+}
+
+static void alsa_sink_destroy(AudioSink *sink) {
+    free(sink->state);
+}
+
+AudioSink *create_alsa_sink(const char *device) {
+    AudioSink *sink = calloc(1, sizeof(AudioSink));
+    AlsaSink *alsa = calloc(1, sizeof(AlsaSink));
+    if (!sink || !alsa) {
+        free(sink);
+        free(alsa);
+        return NULL;
+    }
+    snprintf(alsa->device, sizeof(alsa->device), "%s", device ? device : "default");
+
+    sink->name = "alsa";
+    sink->play = alsa_sink_play;
+    sink->destroy = alsa_sink_destroy;
+    sink->state = alsa;
+    return sink;
+}
@@ -0,0 +1,464 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "../../include/audio_backend.h"
+#include "../../include/wav_reader.h"
+#include "../../include/memory_accounting.h"
+
+#define LOG_MODULE LOG_MODULE_AUDIO
+#include "../../include/log.h"
+
+#define PERIOD_FRAMES AUDIO_SOURCE_PERIOD_FRAMES
+
+// WAV file source: the whole file is decoded up front and delivered from memory
+typedef struct {
+    int16_t *samples;
+    size_t count;
+    bool paced;
+} FileSource;
+
+// stdin or FIFO source
+typedef struct {
+    char path[256];             // Empty for stdin
+    int fd;
+    int16_t period[PERIOD_FRAMES];
+} StreamSource;
+
+// Shared by the two ends of a loopback pair
+typedef struct {
+    pthread_mutex_t lock;
+    int16_t *ring;
+    size_t capacity;
+    size_t head;                // Oldest queued sample
+    size_t count;
+    int refs;                   // Ends still alive
+    int16_t period[PERIOD_FRAMES];  // Source side only
+} Loopback;
+
+static const int16_t silent_period[PERIOD_FRAMES];
+
+// Sleep until the next period is due, so file and synthetic sources arrive
+// at the rate a microphone would deliver them
+static void wait_for_next_period(struct timespec *due) {
+    due->tv_nsec += CAPTURE_PERIOD_MS * 1000000L;
+    if (due->tv_nsec >= 1000000000L) {
+        due->tv_sec++;
+        due->tv_nsec -= 1000000000L;
+    }
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, due, NULL) == EINTR) {
+    }
+}
+
+static int open_mono(AudioSource *source, const CaptureConfig *config,
+                     unsigned int *rate, unsigned int *channels) {
+    (void)source;
+    (void)config;
+    *rate = SAMPLE_RATE;
+    *channels = 1;
+    return 0;
+}
+
+static void close_nothing(AudioSource *source) {
+    (void)source;
+}
+
+static AudioSource *new_source(const char *name, void *state) {
+    AudioSource *source = calloc(1, sizeof(AudioSource));
+    if (!source) {
+        return NULL;
+    }
+    source->name = name;
+    source->open = open_mono;
+    source->close = close_nothing;
+    source->state = state;
+    return source;
+}
+
+static int file_source_run(AudioSource *source, AudioFrameHandler handler, void *user, unsigned long *xruns) {
+    FileSource *file = source->state;
+    struct timespec due;
+
+    (void)xruns;
+    clock_gettime(CLOCK_MONOTONIC, &due);
+    for (size_t offset = 0; offset < file->count; offset += PERIOD_FRAMES) {
+        size_t frames = file->count - offset < PERIOD_FRAMES ? file->count - offset : PERIOD_FRAMES;
+        if (file->paced) {
+            wait_for_next_period(&due);
+        }
+        if (handler(file->samples + offset, frames, user)) {
+            break;
+        }
+    }
+    return 0;
+}
+
+static void file_source_destroy(AudioSource *source) {
+    FileSource *file = source->state;
+    memory_release(MEMORY_AUDIO, file->count * sizeof(int16_t));
+    free(file->samples);
+    free(file);
+}
+
+static AudioSource *create_file_source(const char *path, bool paced) {
+    FileSource *file = calloc(1, sizeof(FileSource));
+    if (!file || !(file->samples = read_wav_file(path, &file->count))) {
+        free(file);
+        return NULL;
+    }
+    file->paced = paced;
+    if (!memory_reserve(MEMORY_AUDIO, file->count * sizeof(int16_t))) {
+        log_error("%s would exceed the audio memory budget", path);
+        free(file->samples);
+        free(file);
+        return NULL;
+    }
+
+    AudioSource *source = new_source(paced ? "wav" : "wav-fast", file);
+    if (!source) {
+        memory_release(MEMORY_AUDIO, file->count * sizeof(int16_t));
+        free(file->samples);
+        free(file);
+        return NULL;
+    }
+    source->run = file_source_run;
+    source->destroy = file_source_destroy;
+    return source;
+}
+
+static int stream_source_open(AudioSource *source, const CaptureConfig *config,
+                              unsigned int *rate, unsigned int *channels) {
+    StreamSource *stream = source->state;
+
+    if (source->finished) {
+        return -1;
+    }
+    if (stream->fd < 0) {
+        // Blocks until a writer opens the FIFO
+        log_info("Waiting for audio on %s", stream->path);
+        if ((stream->fd = open(stream->path, O_RDONLY)) < 0) {
+            log_error("Cannot open %s: %s", stream->path, strerror(errno));
+            return -1;
+        }
+    }
+    return open_mono(source, config, rate, channels);
+}
+
+static int stream_source_run(AudioSource *source, AudioFrameHandler handler, void *user, unsigned long *xruns) {
+    StreamSource *stream = source->state;
+    char *bytes = (char *)stream->period;
+    size_t filled = 0;
+
+    (void)xruns;
+    for (;;) {
+        ssize_t rc = read(stream->fd, bytes + filled, sizeof(stream->period) - filled);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        filled += rc;
+
+        if (rc == 0) {
+            // Writer went away: deliver what is left, then wait for the next
+            // writer (FIFO) or end the input (stdin)
+            if (stream->path[0]) {
+                close(stream->fd);
+                stream->fd = -1;
+            } else {
+                source->finished = true;
+            }
+            if (filled >= sizeof(int16_t)) {
+                handler(stream->period, filled / sizeof(int16_t), user);
+            }
+            return 0;
+        }
+
+        if (filled == sizeof(stream->period)) {
+            if (handler(stream->period, PERIOD_FRAMES, user)) {
+                return 0;
+            }
+            filled = 0;
+        }
+    }
+}
+
+static void stream_source_destroy(AudioSource *source) {
+    StreamSource *stream = source->state;
+    if (stream->path[0] && stream->fd >= 0) {
+        close(stream->fd);
+    }
+    free(stream);
+}
+
+// path NULL reads stdin
+static AudioSource *create_stream_source(const char *path) {
+    StreamSource *stream = calloc(1, sizeof(StreamSource));
+    if (!stream) {
+        return NULL;
+    }
+    stream->fd = path ? -1 : STDIN_FILENO;
+    if (path) {
+        snprintf(stream->path, sizeof(stream->path), "%s", path);
+    }
+
+    AudioSource *source = new_source(path ? "fifo" : "stdin", stream);
+    if (!source) {
+        free(stream);
+        return NULL;
+    }
+    source->open = stream_source_open;
+    source->run = stream_source_run;
+    source->destroy = stream_source_destroy;
+    return source;
+}
+
+static int null_source_run(AudioSource *source, AudioFrameHandler handler, void *user, unsigned long *xruns) {
+    struct timespec due;
+
+    (void)source;
+    (void)xruns;
+    clock_gettime(CLOCK_MONOTONIC, &due);
+    do {
+        wait_for_next_period(&due);
+    } while (!handler(silent_period, PERIOD_FRAMES, user));
+    return 0;
+}
+
+static void null_source_destroy(AudioSource *source) {
+    (void)source;
+}
+
+static int null_sink_play(AudioSink *sink, const int16_t *samples, size_t count) {
+    (void)sink;
+    (void)samples;
+    (void)count;
+    return 0;
+}
+
+static void null_sink_destroy(AudioSink *sink) {
+    (void)sink;
+}
+
+static void release_loopback(Loopback *loopback) {
+    pthread_mutex_lock(&loopback->lock);
+    bool last = --loopback->refs == 0;
+    pthread_mutex_unlock(&loopback->lock);
+    if (last) {
+        memory_release(MEMORY_AUDIO, loopback->capacity * sizeof(int16_t));
+        pthread_mutex_destroy(&loopback->lock);
+        free(loopback->ring);
+        free(loopback);
+    }
+}
+
+// Real-time like a microphone: queued audio first, silence when there is none
+static int loopback_source_run(AudioSource *source, AudioFrameHandler handler, void *user, unsigned long *xruns) {
+    Loopback *loopback = source->state;
+    struct timespec due;
+
+    (void)xruns;
+    clock_gettime(CLOCK_MONOTONIC, &due);
+    do {
+        wait_for_next_period(&due);
+        pthread_mutex_lock(&loopback->lock);
+        size_t frames = loopback->count < PERIOD_FRAMES ? loopback->count : PERIOD_FRAMES;
+        for (size_t i = 0; i < frames; i++) {
+            loopback->period[i] = loopback->ring[(loopback->head + i) % loopback->capacity];
+        }
+        loopback->head = (loopback->head + frames) % loopback->capacity;
+        loopback->count -= frames;
+        pthread_mutex_unlock(&loopback->lock);
+        memset(loopback->period + frames, 0, (PERIOD_FRAMES - frames) * sizeof(int16_t));
+    } while (!handler(loopback->period, PERIOD_FRAMES, user));
+    return 0;
+}
+
+static void loopback_source_destroy(AudioSource *source) {
+    release_loopback(source->state);
+}
+
+// Queue for the source; the oldest audio is dropped once the ring is full
+static int loopback_sink_play(AudioSink *sink, const int16_t *samples, size_t count) {
+    Loopback *loopback = sink->state;
+
+    pthread_mutex_lock(&loopback->lock);
+    for (size_t i = 0; i < count; i++) {
+        if (loopback->count == loopback->capacity) {
+            loopback->head = (loopback->head + 1) % loopback->capacity;
+            loopback->count--;
+        }
+        loopback->ring[(loopback->head + loopback->count++) % loopback->capacity] = samples[i];
+    }
+    pthread_mutex_unlock(&loopback->lock);
+    return 0;
+}
+
+static void loopback_sink_destroy(AudioSink *sink) {
+    release_loopback(sink->state);
+}
+
+bool create_audio_loopback(AudioSource **source, AudioSink **sink) {
+    Loopback *loopback = calloc(1, sizeof(Loopback));
+    *source = NULL;
+    *sink = NULL;
+    if (!loopback) {
+        return false;
+    }
+    loopback->capacity = (size_t)SAMPLE_RATE * AUDIO_LOOPBACK_SECONDS;
+    loopback->ring = malloc(loopback->capacity * sizeof(int16_t));
+    pthread_mutex_init(&loopback->lock, NULL);
+
+    *source = new_source("loopback", loopback);
+    *sink = calloc(1, sizeof(AudioSink));
+    if (!loopback->ring || !*source || !*sink) {
+        pthread_mutex_destroy(&loopback->lock);
+        free(loopback->ring);
+        free(loopback);
+        free(*source);
+        free(*sink);
+        *source = NULL;
+        *sink = NULL;
+        return false;
+    }
+    loopback->refs = 2;
+    memory_charge(MEMORY_AUDIO, loopback->capacity * sizeof(int16_t));
+
+    (*source)->run = loopback_source_run;
+    (*source)->destroy = loopback_source_destroy;
+    (*sink)->name = "loopback";
+    (*sink)->play = loopback_sink_play;
+    (*sink)->destroy = loopback_sink_destroy;
+    (*sink)->state = loopback;
+    return true;
+}
+
+// Split "name:argument"; returns the argument or NULL if there is none
+static const char *spec_argument(const char *spec, const char *name) {
+    size_t length = strlen(name);
+    if (strncmp(spec, name, length) != 0) {
+        return NULL;
+    }
+    return spec[length] == ':' && spec[length + 1] ? spec + length + 1 : NULL;
+}
+
+static bool spec_is(const char *spec, const char *name) {
+    size_t length = strlen(name);
+    return strncmp(spec, name, length) == 0 && (spec[length] == '\0' || spec[length] == ':');
+}
+
+AudioSource *create_audio_source(const char *spec) {
+    AudioSource *source = NULL;
+    const char *argument;
+
+    if (!spec) {
+        spec = AUDIO_DEFAULT_SOURCE;
+    }
+
+    if (spec_is(spec, "alsa")) {
+        source = create_alsa_source(spec_argument(spec, "alsa"));
+    } else if ((argument = spec_argument(spec, "wav"))) {
+        source = create_file_source(argument, true);
+    } else if ((argument = spec_argument(spec, "wav-fast"))) {
+        source = create_file_source(argument, false);
+    } else if (strcmp(spec, "stdin") == 0) {
+        source = create_stream_source(NULL);
+    } else if ((argument = spec_argument(spec, "fifo"))) {
+        source = create_stream_source(argument);
+    } else if (strcmp(spec, "null") == 0) {
+        if ((source = new_source("null", NULL))) {
+            source->run = null_source_run;
+            source->destroy = null_source_destroy;
+        }
+    } else if (strcmp(spec, "loopback") == 0) {
+        log_error("The loopback source needs the loopback sink");
+        return NULL;
+    } else {
+        log_error("Unknown audio source %s", spec);
+        return NULL;
+    }
+
+    if (!source) {
+        log_error("Cannot open audio source %s", spec);
+    }
+    return source;
+}
+
+AudioSink *create_audio_sink(const char *spec) {
+    AudioSink *sink = NULL;
+
+    if (!spec) {
+        return NULL;
+    }
+    if (spec_is(spec, "alsa")) {
+        sink = create_alsa_sink(spec_argument(spec, "alsa"));
+    } else if (strcmp(spec, "null") == 0) {
+        if ((sink = calloc(1, sizeof(AudioSink)))) {
+            sink->name = "null";
+            sink->play = null_sink_play;
+            sink->destroy = null_sink_destroy;
+        }
+    } else if (strcmp(spec, "loopback") == 0) {
+        log_error("The loopback sink needs the loopback source");
+        return NULL;
+    } else {
+        log_error("Unknown audio sink %s", spec);
+        return NULL;
+    }
+
+    if (!sink) {
+        log_error("Cannot open audio sink %s", spec);
+    }
+    return sink;
+}
+
+bool open_audio_backends(const char *source_spec, const char *sink_spec,
+                         AudioSource **source, AudioSink **sink) {
+    *source = NULL;
+    *sink = NULL;
+
+    if (source_spec && sink_spec && strcmp(source_spec, "loopback") == 0 &&
+        strcmp(sink_spec, "loopback") == 0) {
+        return create_audio_loopback(source, sink);
+    }
+
+    if (!(*source = create_audio_source(source_spec))) {
+        return false;
+    }
+    if (sink_spec && !(*sink = create_audio_sink(sink_spec))) {
+        destroy_audio_source(*source);
+        *source = NULL;
+        return false;
+    }
+    return true;
+}
+
+void destroy_audio_source(AudioSource *source) {
+    if (!source) return;
+    source->close(source);
+    source->destroy(source);
+    free(source);
+}
+
+void destroy_audio_sink(AudioSink *sink) {
+    if (!sink) return;
+    sink->destroy(sink);
+    free(sink);
+}
+
+int audio_sink_play_file(AudioSink *sink, const char *path) {
+    size_t samples;
+    int16_t *audio = read_wav_file(path, &samples);
+    if (!audio) {
+        return -1;
+    }
+    int rc = sink->play(sink, audio, samples);
+    free(audio);
+    return rc;
+}
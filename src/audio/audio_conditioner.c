@@ -0,0 +1,291 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../../include/audio_conditioner.h"
+
+#define FFT_BINS (CONDITIONER_FFT_SIZE / 2 + 1)
+
+struct AudioConditioner {
+    unsigned int sample_rate;
+    bool noise_suppression;
+
+    // Input staging
+    float hop_in[CONDITIONER_HOP];
+    size_t hop_fill;
+    size_t pending_skip;        // Priming samples still to drop from the output
+    size_t consumed;            // Input samples accepted
+    size_t emitted;             // Output samples written
+
+    // DC blocker state
+    bool dc_primed;
+    float dc_prev_in;
+    float dc_prev_out;
+
+    // Noise suppression state
+    float window[CONDITIONER_FFT_SIZE];     // sqrt-Hann, used for analysis and synthesis
+    float twiddle_re[CONDITIONER_FFT_SIZE / 2];
+    float twiddle_im[CONDITIONER_FFT_SIZE / 2];
+    float ns_prev_hop[CONDITIONER_HOP];
+    float ns_overlap[CONDITIONER_HOP];
+    float noise_psd[FFT_BINS];
+    int ns_frames;
+
+    // AGC state
+    float agc_pending[CONDITIONER_HOP];
+    float agc_pending_peak;
+    bool agc_primed;
+    float gain;
+    float attack_coef;
+    float release_coef;
+};
+
+// In-place iterative radix-2 FFT (inverse when inverse is true, unscaled)
+static void fft(const AudioConditioner *c, float *re, float *im, bool inverse) {
+    const int n = CONDITIONER_FFT_SIZE;
+
+    for (int i = 1, j = 0; i < n; i++) {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            float t = re[i]; re[i] = re[j]; re[j] = t;
+            t = im[i]; im[i] = im[j]; im[j] = t;
+        }
+    }
+
+    for (int len = 2; len <= n; len <<= 1) {
+        int stride = n / len;
+        for (int i = 0; i < n; i += len) {
+            for (int k = 0; k < len / 2; k++) {
+                float wr = c->twiddle_re[k * stride];
+                float wi = inverse ? -c->twiddle_im[k * stride] : c->twiddle_im[k * stride];
+                int a = i + k;
+                int b = i + k + len / 2;
+                float xr = re[b] * wr - im[b] * wi;
+                float xi = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - xr;
+                im[b] = im[a] - xi;
+                re[a] += xr;
+                im[a] += xi;
+            }
+        }
+    }
+}
+
+AudioConditioner *conditioner_create(unsigned int sample_rate, bool noise_suppression) {
+    AudioConditioner *c = calloc(1, sizeof(AudioConditioner));
+    if (!c) {
+        return NULL;
+    }
+
+    c->sample_rate = sample_rate;
+    c->noise_suppression = noise_suppression;
+
+    for (int i = 0; i < CONDITIONER_FFT_SIZE; i++) {
+        c->window[i] = sqrtf(0.5f - 0.5f * cosf(2.0f * (float)M_PI * i / CONDITIONER_FFT_SIZE));
+    }
+    for (int k = 0; k < CONDITIONER_FFT_SIZE / 2; k++) {
+        c->twiddle_re[k] = cosf(2.0f * (float)M_PI * k / CONDITIONER_FFT_SIZE);
+        c->twiddle_im[k] = -sinf(2.0f * (float)M_PI * k / CONDITIONER_FFT_SIZE);
+    }
+
+    c->attack_coef = 1.0f - expf(-1000.0f / (AGC_ATTACK_MS * sample_rate));
+    c->release_coef = 1.0f - expf(-1000.0f / (AGC_RELEASE_MS * sample_rate));
+
+    conditioner_reset(c);
+    return c;
+}
+
+void conditioner_destroy(AudioConditioner *c) {
+    free(c);
+}
+
+void conditioner_reset(AudioConditioner *c) {
+    c->hop_fill = 0;
+    c->consumed = 0;
+    c->emitted = 0;
+    c->dc_primed = false;
+    c->dc_prev_in = 0.0f;
+    c->dc_prev_out = 0.0f;
+    memset(c->ns_prev_hop, 0, sizeof(c->ns_prev_hop));
+    memset(c->ns_overlap, 0, sizeof(c->ns_overlap));
+    memset(c->noise_psd, 0, sizeof(c->noise_psd));
+    c->ns_frames = 0;
+    c->agc_primed = false;
+    c->agc_pending_peak = 0.0f;
+    c->gain = 1.0f;
+
+    // One hop of look-ahead in the AGC, one more for overlap-add
+    c->pending_skip = CONDITIONER_HOP * (c->noise_suppression ? 2 : 1);
+}
+
+static void dc_block(AudioConditioner *c, float *hop) {
+    // Start from the first sample so a mic's standing offset is not seen as a step
+    if (!c->dc_primed) {
+        c->dc_prev_in = hop[0];
+        c->dc_primed = true;
+    }
+
+    for (int i = 0; i < CONDITIONER_HOP; i++) {
+        float x = hop[i];
+        float y = x - c->dc_prev_in + DC_BLOCK_POLE * c->dc_prev_out;
+        c->dc_prev_in = x;
+        c->dc_prev_out = y;
+        hop[i] = y;
+    }
+}
+
+// Spectral subtraction over a 50%-overlapped sqrt-Hann frame made of the
+// previous and current hop. Writes the hop completed by overlap-add to out.
+static void suppress_noise(AudioConditioner *c, const float *hop, float *out) {
+    float re[CONDITIONER_FFT_SIZE];
+    float im[CONDITIONER_FFT_SIZE];
+    float power[FFT_BINS];
+    float frame_power = 0.0f;
+    float noise_power = 0.0f;
+
+    for (int i = 0; i < CONDITIONER_HOP; i++) {
+        re[i] = c->ns_prev_hop[i] * c->window[i];
+        re[i + CONDITIONER_HOP] = hop[i] * c->window[i + CONDITIONER_HOP];
+    }
+    memset(im, 0, sizeof(im));
+    memcpy(c->ns_prev_hop, hop, sizeof(c->ns_prev_hop));
+
+    fft(c, re, im, false);
+
+    for (int k = 0; k < FFT_BINS; k++) {
+        power[k] = re[k] * re[k] + im[k] * im[k];
+        frame_power += power[k];
+        noise_power += c->noise_psd[k];
+    }
+
+    // Noise estimate: average of the first frames, then track quiet frames
+    if (c->ns_frames < NS_INIT_FRAMES) {
+        c->ns_frames++;
+        for (int k = 0; k < FFT_BINS; k++) {
+            c->noise_psd[k] += (power[k] - c->noise_psd[k]) / c->ns_frames;
+        }
+    } else if (frame_power < 2.0f * noise_power) {
+        for (int k = 0; k < FFT_BINS; k++) {
+            c->noise_psd[k] = 0.95f * c->noise_psd[k] + 0.05f * power[k];
+        }
+    }
+
+    for (int k = 0; k < FFT_BINS; k++) {
+        float g = 1.0f;
+        if (power[k] > 0.0f) {
+            g = 1.0f - NS_OVERSUBTRACTION * c->noise_psd[k] / power[k];
+            g = g > NS_SPECTRAL_FLOOR * NS_SPECTRAL_FLOOR ? sqrtf(g) : NS_SPECTRAL_FLOOR;
+        }
+        re[k] *= g;
+        im[k] *= g;
+        if (k > 0 && k < CONDITIONER_FFT_SIZE / 2) {
+            re[CONDITIONER_FFT_SIZE - k] = re[k];
+            im[CONDITIONER_FFT_SIZE - k] = -im[k];
+        }
+    }
+
+    fft(c, re, im, true);
+
+    for (int i = 0; i < CONDITIONER_HOP; i++) {
+        out[i] = c->ns_overlap[i] + re[i] * c->window[i] / CONDITIONER_FFT_SIZE;
+        c->ns_overlap[i] = re[i + CONDITIONER_HOP] * c->window[i + CONDITIONER_HOP] / CONDITIONER_FFT_SIZE;
+    }
+}
+
+static float hop_peak(const float *hop) {
+    float peak = 0.0f;
+    for (int i = 0; i < CONDITIONER_HOP; i++) {
+        float a = fabsf(hop[i]);
+        if (a > peak) {
+            peak = a;
+        }
+    }
+    return peak;
+}
+
+// Look-ahead AGC: the gain for the held hop is chosen knowing the peak of the
+// hop that follows it, so attack starts before a loud onset reaches the output
+static void apply_agc(AudioConditioner *c, const float *hop, float *out) {
+    float next_peak = hop_peak(hop);
+    float envelope = c->agc_pending_peak > next_peak ? c->agc_pending_peak : next_peak;
+    float target = c->gain;
+
+    if (envelope >= AGC_NOISE_FLOOR) {
+        target = AGC_TARGET_PEAK / envelope;
+        if (target > AGC_MAX_GAIN) target = AGC_MAX_GAIN;
+        if (target < 1.0f) target = 1.0f;
+        // Never push the look-ahead window into clipping
+        if (envelope * target > 32767.0f) target = 32767.0f / envelope;
+    }
+
+    float coef = target < c->gain ? c->attack_coef : c->release_coef;
+    for (int i = 0; i < CONDITIONER_HOP; i++) {
+        c->gain += coef * (target - c->gain);
+        out[i] = c->agc_pending[i] * c->gain;
+    }
+
+    memcpy(c->agc_pending, hop, sizeof(c->agc_pending));
+    c->agc_pending_peak = next_peak;
+}
+
+// Run one full hop through the pipeline and write its output to out,
+// honouring the priming skip and never emitting more than was consumed
+static size_t process_hop(AudioConditioner *c, int16_t *out) {
+    float stage[CONDITIONER_HOP];
+    float result[CONDITIONER_HOP];
+    const float *agc_input = c->hop_in;
+    size_t written = 0;
+
+    dc_block(c, c->hop_in);
+    if (c->noise_suppression) {
+        suppress_noise(c, c->hop_in, stage);
+        agc_input = stage;
+    }
+    apply_agc(c, agc_input, result);
+
+    for (int i = 0; i < CONDITIONER_HOP && c->emitted < c->consumed; i++) {
+        if (c->pending_skip > 0) {
+            c->pending_skip--;
+            continue;
+        }
+        float v = result[i];
+        if (v > 32767.0f) v = 32767.0f;
+        if (v < -32768.0f) v = -32768.0f;
+        out[written++] = (int16_t)lrintf(v);
+        c->emitted++;
+    }
+
+    c->hop_fill = 0;
+    return written;
+}
+
+size_t conditioner_process(AudioConditioner *c, const int16_t *in, size_t count, int16_t *out) {
+    size_t written = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        c->hop_in[c->hop_fill++] = in[i];
+        c->consumed++;
+        if (c->hop_fill == CONDITIONER_HOP) {
+            written += process_hop(c, out + written);
+        }
+    }
+
+    return written;
+}
+
+size_t conditioner_flush(AudioConditioner *c, int16_t *out) {
+    size_t written = 0;
+
+    // Push silence through until every consumed sample has been emitted
+    while (c->emitted < c->consumed) {
+        memset(c->hop_in + c->hop_fill, 0, (CONDITIONER_HOP - c->hop_fill) * sizeof(float));
+        c->hop_fill = CONDITIONER_HOP;
+        written += process_hop(c, out + written);
+    }
+
+    return written;
+}
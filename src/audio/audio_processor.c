@@ -1,24 +1,80 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
 #include <alsa/asoundlib.h>
 #include "../../include/speech_processor.h"
+#include "../../include/realtime.h"
+#include "../../include/resampler.h"
+#include "../../include/audio_conditioner.h"
+#include "../../include/audio_backend.h"
+#include "../../include/alloc_counter.h"
+#include "../../include/memory_accounting.h"
+
+#define LOG_MODULE LOG_MODULE_AUDIO
+#include "../../include/log.h"
+
+#define CHUNK_MS (CAPTURE_CHUNK_FRAMES * 1000 / SAMPLE_RATE)  // Length of a silence window
+
+// One recording, shared between record_audio_into and the capture thread
+typedef struct {
+    AudioSource *source;
+    Resampler *resampler;   // Converts native-rate frames, NULL if already SAMPLE_RATE mono
+    int16_t *buffer;
+    size_t capacity;
+    size_t frames_read;
+    long window_sum;        // Sum of |sample| over the current silence window
+    size_t window_frames;   // Frames accumulated in the current silence window
+    int silence_count;      // Consecutive silent windows
+    int silence_threshold;
+    int silence_windows;    // Silent windows that end the recording
+    int rt_priority;
+    int cpu;
+    AudioConditioner *conditioner;
+    size_t conditioned;     // Leading samples of buffer that are conditioned (guarded by lock)
+    bool done;              // Capture thread has finished (guarded by lock)
+    bool stop_requested;    // Consumer asked to end capture (guarded by lock)
+    bool pending;           // Waiting for the capture thread to start it (guarded by lock)
+    pthread_mutex_t lock;
+    pthread_cond_t ready;   // Signals the consumer: more conditioned audio, or done
+    unsigned long xruns;
+    unsigned long allocations;  // Made on the capture thread (counting builds)
+    int error;
+} CaptureJob;
+
+// Capture resources owned by one session and reused across its recordings
+struct AudioCapture {
+    CaptureStats stats;                 // Accumulated across recordings
+    AudioSource *source;
+    bool owns_source;                   // Default ALSA source created for this capture
+    Resampler *resampler;               // Native-rate converter, kept while the source format is unchanged
+    unsigned int resampler_rate;
+    unsigned int resampler_channels;
+    AudioConditioner *conditioner;      // Streaming conditioning, reset at the start of every recording
+    CaptureConfig config;
+    CaptureJob job;                     // Current recording; its lock also guards the fields below
+    pthread_t thread;                   // Capture thread, alive as long as the capture
+    bool thread_started;
+    pthread_cond_t start;               // Signals the capture thread: job is pending, or quit
+    bool quit;
+};
 
 // Function to find USB audio device automatically
-char* find_usb_audio_device(void) {
+// Writes the plughw: name to device_name; returns 0 on success, -1 if none
+int find_usb_audio_device(char *device_name, size_t size) {
     FILE *cards_file;
     char line[256];
     int card_num = -1;
-    static char device_name[32];
     
     // Read /proc/asound/cards to find USB audio devices
     cards_file = fopen("/proc/asound/cards", "r");
     if (!cards_file) {
-        fprintf(stderr, "Cannot open /proc/asound/cards\n");
-        return NULL;
+        log_error("Cannot open /proc/asound/cards");
+        return -1;
     }
     
-    printf("Searching for USB audio devices...\n");
+    log_debug("Searching for USB audio devices...");
     
     while (fgets(line, sizeof(line), cards_file)) {
         // Look for lines containing card numbers and USB-Audio driver
@@ -26,9 +82,9 @@ char* find_usb_audio_device(void) {
             // Extract card number from the beginning of the line
             if (sscanf(line, " %d [", &card_num) == 1) {
                 fclose(cards_file);
-                snprintf(device_name, sizeof(device_name), "plughw:%d,0", card_num);
-                printf("Found USB audio device: %s\n", device_name);
-                return device_name;
+                snprintf(device_name, size, "plughw:%d,0", card_num);
+                log_debug("Found USB audio device: %s", device_name);
+                return 0;
             }
         }
     }
@@ -36,7 +92,7 @@ char* find_usb_audio_device(void) {
     fclose(cards_file);
     
     // If no USB audio device found, try to find any capture device
-    printf("No USB audio device found, searching for any capture device...\n");
+    log_debug("No USB audio device found, searching for any capture device...");
     
     snd_ctl_t *handle;
     snd_ctl_card_info_t *info;
@@ -67,182 +123,387 @@ char* find_usb_audio_device(void) {
         
         if (snd_ctl_pcm_info(handle, pcminfo) >= 0) {
             snd_ctl_close(handle);
-            snprintf(device_name, sizeof(device_name), "plughw:%d,0", card);
-            printf("Found capture device: %s (%s)\n", device_name, snd_ctl_card_info_get_name(info));
-            return device_name;
+            snprintf(device_name, size, "plughw:%d,0", card);
+            log_debug("Found capture device: %s (%s)", device_name, snd_ctl_card_info_get_name(info));
+            return 0;
         }
         
         snd_ctl_close(handle);
     }
     
-    fprintf(stderr, "No suitable audio capture device found\n");
-    return NULL;
+    log_error("No suitable audio capture device found");
+    return -1;
 }
 
-void normalize_audio(int16_t *buffer, size_t samples) {
-    // Find maximum amplitude
-    int16_t max_amp = 0;
-    for (size_t i = 0; i < samples; i++) {
-        int16_t abs_amp = abs(buffer[i]);
-        if (abs_amp > max_amp) {
-            max_amp = abs_amp;
-        }
+void default_capture_config(CaptureConfig *config) {
+    config->recording_ms = RECORDING_TIME_SEC * 1000;
+    config->silence_threshold = SILENCE_THRESHOLD;
+    config->silence_ms = SILENCE_TIMEOUT_MS;
+    config->period_ms = CAPTURE_PERIOD_MS;
+    config->periods = CAPTURE_PERIODS;
+    config->noise_suppression = CONDITIONER_NOISE_SUPPRESSION;
+    config->rt_priority = CAPTURE_RT_PRIORITY;
+    config->capture_cpu = CAPTURE_CPU;
+}
+
+int16_t *alloc_audio_buffer(void) {
+    if (!memory_reserve(MEMORY_AUDIO, BUFFER_SIZE * sizeof(int16_t))) {
+        log_error("Audio buffer would exceed the audio memory budget");
+        return NULL;
     }
+    int16_t *buffer = alloc_locked_buffer(BUFFER_SIZE * sizeof(int16_t));
+    if (!buffer) {
+        memory_release(MEMORY_AUDIO, BUFFER_SIZE * sizeof(int16_t));
+    }
+    return buffer;
+}
 
-    // Normalize if the maximum amplitude is too low
-    if (max_amp > 0 && max_amp < 16384) {  // 16384 is half of INT16_MAX
-        float scale = 16384.0f / max_amp;
-        for (size_t i = 0; i < samples; i++) {
-            buffer[i] = (int16_t)(buffer[i] * scale);
-        }
+void free_audio_buffer(int16_t *buffer) {
+    if (buffer) {
+        memory_release(MEMORY_AUDIO, BUFFER_SIZE * sizeof(int16_t));
     }
+    free_locked_buffer(buffer, BUFFER_SIZE * sizeof(int16_t));
 }
 
-void remove_dc_offset(int16_t *buffer, size_t samples) {
-    // Calculate mean (DC offset)
-    long long sum = 0;
-    for (size_t i = 0; i < samples; i++) {
-        sum += buffer[i];
+static void *capture_thread_main(void *arg);
+
+AudioCapture *create_audio_capture(AudioSource *source) {
+    AudioCapture *capture = calloc(1, sizeof(AudioCapture));
+    if (!capture) {
+        return NULL;
+    }
+    capture->source = source;
+    if (!source) {
+        capture->source = create_audio_source(AUDIO_DEFAULT_SOURCE);
+        capture->owns_source = true;
+    }
+    default_capture_config(&capture->config);
+    capture->conditioner = conditioner_create(SAMPLE_RATE, capture->config.noise_suppression);
+    pthread_mutex_init(&capture->job.lock, NULL);
+    pthread_cond_init(&capture->job.ready, NULL);
+    pthread_cond_init(&capture->start, NULL);
+    if (!capture->source || !capture->conditioner) {
+        log_error("Failed to create audio capture");
+        destroy_audio_capture(capture);
+        return NULL;
     }
-    int16_t dc_offset = (int16_t)(sum / samples);
 
-    // Remove DC offset
-    for (size_t i = 0; i < samples; i++) {
-        buffer[i] -= dc_offset;
+    int err = pthread_create(&capture->thread, NULL, capture_thread_main, capture);
+    if (err != 0) {
+        log_error("Cannot start capture thread: %s", strerror(err));
+        destroy_audio_capture(capture);
+        return NULL;
     }
+    capture->thread_started = true;
+    return capture;
 }
 
-int is_silence(const int16_t *buffer, size_t samples) {
-    long sum = 0;
-    for (size_t i = 0; i < samples; i++) {
-        sum += abs(buffer[i]);
+void destroy_audio_capture(AudioCapture *capture) {
+    if (!capture) return;
+    if (capture->thread_started) {
+        pthread_mutex_lock(&capture->job.lock);
+        capture->quit = true;
+        pthread_cond_signal(&capture->start);
+        pthread_mutex_unlock(&capture->job.lock);
+        pthread_join(capture->thread, NULL);
+    }
+    pthread_cond_destroy(&capture->start);
+    pthread_cond_destroy(&capture->job.ready);
+    pthread_mutex_destroy(&capture->job.lock);
+    if (capture->owns_source) {
+        destroy_audio_source(capture->source);
     }
-    return (sum / samples) < SILENCE_THRESHOLD;
+    resampler_destroy(capture->resampler);
+    conditioner_destroy(capture->conditioner);
+    free(capture);
 }
 
-int16_t *record_audio(size_t *out_nsamps) {
-    snd_pcm_t *capture_handle;
-    snd_pcm_hw_params_t *hw_params;
-    int err;
-    size_t nsamples = BUFFER_SIZE;
-    int16_t *buffer = malloc(nsamples * sizeof(int16_t));
-    
-    if (!buffer) {
-        fprintf(stderr, "Failed to allocate memory for audio buffer\n");
-        return NULL;
-    }
+// Changing noise suppression replaces the conditioner, so call between recordings
+void set_audio_capture_config(AudioCapture *capture, const CaptureConfig *config) {
+    bool noise_suppression = capture->config.noise_suppression;
 
-    // Automatically find USB audio device
-    char* audio_device = find_usb_audio_device();
-    if (!audio_device) {
-        fprintf(stderr, "No suitable audio device found\n");
-        free(buffer);
-        return NULL;
+    if (config->noise_suppression != noise_suppression) {
+        AudioConditioner *conditioner = conditioner_create(SAMPLE_RATE, config->noise_suppression);
+        if (conditioner) {
+            conditioner_destroy(capture->conditioner);
+            capture->conditioner = conditioner;
+            noise_suppression = config->noise_suppression;
+        } else {
+            log_error("Cannot change noise suppression, keeping the current setting");
+        }
     }
+    capture->config = *config;
+    capture->config.noise_suppression = noise_suppression;
+}
 
-    // Open the audio device
-    if ((err = snd_pcm_open(&capture_handle, audio_device, SND_PCM_STREAM_CAPTURE, 0)) < 0) {
-        fprintf(stderr, "Cannot open audio device %s: %s\n", audio_device, snd_strerror(err));
-        free(buffer);
-        return NULL;
+void get_capture_stats(const AudioCapture *capture, CaptureStats *stats) {
+    if (capture && stats) {
+        *stats = capture->stats;
     }
+}
 
-    // Allocate hardware parameters object
-    snd_pcm_hw_params_alloca(&hw_params);
+// Publish conditioned samples to the consumer waiting in record_audio_stream
+static bool publish_conditioned(CaptureJob *job, size_t produced, bool done) {
+    bool stop;
 
-    // Fill with default values
-    if ((err = snd_pcm_hw_params_any(capture_handle, hw_params)) < 0) {
-        fprintf(stderr, "Cannot initialize hardware parameter structure: %s\n", snd_strerror(err));
-        goto cleanup;
+    pthread_mutex_lock(&job->lock);
+    job->conditioned += produced;
+    job->done = done;
+    stop = job->stop_requested;
+    pthread_cond_signal(&job->ready);
+    pthread_mutex_unlock(&job->lock);
+
+    return stop;
+}
+
+// Account newly captured frames (already in job->buffer) for silence detection
+// and condition them in place. Silence is judged on the raw signal over
+// CAPTURE_CHUNK_FRAMES windows regardless of how many frames the device
+// delivers per wakeup. Returns 1 once capture should stop.
+static int track_captured_frames(CaptureJob *job, size_t frames) {
+    int16_t *samples = job->buffer + job->frames_read;
+
+    for (size_t i = 0; i < frames; i++) {
+        job->window_sum += abs(samples[i]);
+        if (++job->window_frames == CAPTURE_CHUNK_FRAMES) {
+            if (job->window_sum / (long)CAPTURE_CHUNK_FRAMES < job->silence_threshold) {
+                job->silence_count++;
+            } else {
+                job->silence_count = 0;
+            }
+            job->window_sum = 0;
+            job->window_frames = 0;
+        }
     }
 
-    // Set access type
-    if ((err = snd_pcm_hw_params_set_access(capture_handle, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0) {
-        fprintf(stderr, "Cannot set access type: %s\n", snd_strerror(err));
-        goto cleanup;
+    job->frames_read += frames;
+
+    size_t produced = conditioner_process(job->conditioner, samples, frames,
+                                          job->buffer + job->conditioned);
+    bool stop = publish_conditioned(job, produced, false);
+
+    // Consumer is satisfied, enough consecutive silent windows, or the buffer is full
+    return stop || job->silence_count >= job->silence_windows || job->frames_read >= job->capacity;
+}
+
+// Frame handler for every source: frames point into the source's own buffer
+// (the DMA area for ALSA mmap) and are copied or resampled into job->buffer
+static int store_source_frames(const int16_t *frames, size_t count, void *user) {
+    CaptureJob *job = user;
+    size_t room = job->capacity - job->frames_read;
+
+    if (job->resampler) {
+        size_t produced = resampler_process(job->resampler, frames, count,
+                                            job->buffer + job->frames_read, room);
+        // A whole period that yields nothing means room is too small for
+        // the next output: the buffer is as full as it gets
+        if (produced == 0 && count > 0) {
+            return 1;
+        }
+        return track_captured_frames(job, produced);
     }
 
-    // Set sample format
-    if ((err = snd_pcm_hw_params_set_format(capture_handle, hw_params, SND_PCM_FORMAT_S16_LE)) < 0) {
-        fprintf(stderr, "Cannot set sample format: %s\n", snd_strerror(err));
-        goto cleanup;
+    if (count > room) {
+        count = room;
     }
+    memcpy(job->buffer + job->frames_read, frames, count * sizeof(int16_t));
+    return track_captured_frames(job, count);
+}
 
-    // Set sample rate
-    unsigned int actual_rate = SAMPLE_RATE;
-    if ((err = snd_pcm_hw_params_set_rate_near(capture_handle, hw_params, &actual_rate, 0)) < 0) {
-        fprintf(stderr, "Cannot set sample rate: %s\n", snd_strerror(err));
-        goto cleanup;
+// Core and priority requested for the capture thread; on another thread
+// nothing is pinned and the policy is SCHED_OTHER
+static void apply_capture_scheduling(int cpu, int rt_priority, int *applied_cpu,
+                                     int *applied_priority, const cpu_set_t *any_cpu) {
+    if (cpu != *applied_cpu) {
+        *applied_cpu = cpu;
+        if (cpu >= 0) {
+            pin_thread_to_cpu(cpu, NULL);
+        } else {
+            restore_thread_affinity(any_cpu);
+        }
+    }
+    if (rt_priority != *applied_priority) {
+        *applied_priority = rt_priority;
+        if (rt_priority > 0) {
+            set_thread_realtime(rt_priority);
+        } else {
+            struct sched_param param = { .sched_priority = 0 };
+            pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+        }
     }
+}
 
-    // Set channels
-    if ((err = snd_pcm_hw_params_set_channels(capture_handle, hw_params, 1)) < 0) {
-        fprintf(stderr, "Cannot set channel count: %s\n", snd_strerror(err));
-        goto cleanup;
+// Capture loop, run on a dedicated thread so that it can be given real-time
+// priority and its own core without affecting matching or TTS. The thread
+// lives as long as the AudioCapture and records whenever a job is pending.
+// Scheduling is only changed when the settings do, so a failure to pin or
+// to get real-time priority is logged once rather than every recording.
+static void *capture_thread_main(void *arg) {
+    AudioCapture *capture = arg;
+    CaptureJob *job = &capture->job;
+    int cpu = -1, rt_priority = 0;
+    cpu_set_t any_cpu;
+
+    pthread_getaffinity_np(pthread_self(), sizeof(any_cpu), &any_cpu);
+
+    pthread_mutex_lock(&job->lock);
+    for (;;) {
+        while (!job->pending && !capture->quit) {
+            pthread_cond_wait(&capture->start, &job->lock);
+        }
+        if (capture->quit) {
+            break;
+        }
+        job->pending = false;
+        pthread_mutex_unlock(&job->lock);
+
+        unsigned long allocations = thread_allocations();
+        apply_capture_scheduling(job->cpu, job->rt_priority, &cpu, &rt_priority, &any_cpu);
+        job->error = job->source->run(job->source, store_source_frames, job, &job->xruns);
+
+        // Release the samples still held back by the conditioner's look-ahead
+        size_t produced = conditioner_flush(job->conditioner, job->buffer + job->conditioned);
+        job->allocations = thread_allocations() - allocations;
+        publish_conditioned(job, produced, true);
+
+        pthread_mutex_lock(&job->lock);
     }
+    pthread_mutex_unlock(&job->lock);
 
-    // Set buffer size
-    snd_pcm_uframes_t buffer_size = FRAME_SIZE;
-    if ((err = snd_pcm_hw_params_set_buffer_size_near(capture_handle, hw_params, &buffer_size)) < 0) {
-        fprintf(stderr, "Cannot set buffer size: %s\n", snd_strerror(err));
-        goto cleanup;
+    return NULL;
+}
+
+int16_t *record_audio(AudioCapture *capture, size_t *out_nsamps) {
+    return record_audio_stream(capture, out_nsamps, NULL, NULL);
+}
+
+int16_t *record_audio_stream(AudioCapture *capture, size_t *out_nsamps,
+                             AudioFrameHandler consumer, void *user) {
+    int16_t *buffer = alloc_audio_buffer();
+    
+    if (!buffer) {
+        log_error("Failed to allocate memory for audio buffer");
+        return NULL;
     }
+    if (record_audio_into(capture, buffer, BUFFER_SIZE, out_nsamps, consumer, user) < 0) {
+        free_audio_buffer(buffer);
+        return NULL;
+    }
+    return buffer;
+}
 
-    // Apply hardware parameters
-    if ((err = snd_pcm_hw_params(capture_handle, hw_params)) < 0) {
-        fprintf(stderr, "Cannot set parameters: %s\n", snd_strerror(err));
-        goto cleanup;
+int record_audio_into(AudioCapture *capture, int16_t *buffer, size_t nsamples, size_t *out_nsamps,
+                      AudioFrameHandler consumer, void *user) {
+    AudioSource *source = capture->source;
+    const CaptureConfig *config = &capture->config;
+    size_t longest = (size_t)SAMPLE_RATE * config->recording_ms / 1000;
+    CaptureJob *job = &capture->job;
+    unsigned int rate, channels;
+
+    conditioner_reset(capture->conditioner);
+
+    // The capture thread is idle between recordings, so the job can be
+    // filled in without the lock
+    job->source = source;
+    job->resampler = NULL;
+    job->buffer = buffer;
+    job->capacity = nsamples < longest ? nsamples : longest;
+    job->frames_read = 0;
+    job->window_sum = 0;
+    job->window_frames = 0;
+    job->silence_count = 0;
+    job->silence_threshold = config->silence_threshold;
+    job->silence_windows = (int)((config->silence_ms + CHUNK_MS - 1) / CHUNK_MS);
+    job->rt_priority = config->rt_priority;
+    job->cpu = config->capture_cpu;
+    job->conditioner = capture->conditioner;
+    job->conditioned = 0;
+    job->done = false;
+    job->stop_requested = false;
+    job->xruns = 0;
+    job->allocations = 0;
+    job->error = 0;
+
+    if (job->silence_windows < 1) {
+        job->silence_windows = 1;
     }
 
-    // Start recording
-    if ((err = snd_pcm_prepare(capture_handle)) < 0) {
-        fprintf(stderr, "Cannot prepare audio interface: %s\n", snd_strerror(err));
-        goto cleanup;
+    if (source->open(source, config, &rate, &channels) < 0) {
+        return -1;
     }
 
-    printf("Starting to record...\n");
-    
-    // Read samples
-    size_t frames_read = 0;
-    int silence_count = 0;
-    while (frames_read < nsamples) {
-        snd_pcm_sframes_t rc = snd_pcm_readi(capture_handle, buffer + frames_read, 
-                                            nsamples - frames_read);
-        if (rc < 0) {
-            if (rc == -EPIPE) {
-                // Handle buffer overrun
-                snd_pcm_prepare(capture_handle);
-                continue;
-            }
-            fprintf(stderr, "Read error: %s\n", snd_strerror(rc));
+    // Convert anything that is not SAMPLE_RATE mono in-process
+    if (rate != SAMPLE_RATE || channels != 1) {
+        if (!capture->resampler || capture->resampler_rate != rate || capture->resampler_channels != channels) {
+            resampler_destroy(capture->resampler);
+            capture->resampler = resampler_create(rate, SAMPLE_RATE, channels);
+            capture->resampler_rate = rate;
+            capture->resampler_channels = channels;
+        }
+        if (!capture->resampler) {
+            log_error("Cannot convert %u Hz, %u channel capture", rate, channels);
             goto cleanup;
         }
-        
-        // Check for silence in the current chunk
-        if (is_silence(buffer + frames_read, rc)) {
-            silence_count++;
-            if (silence_count > 3) { // More than 3 consecutive silent chunks
-                printf("Detected extended silence, stopping recording...\n");
-                nsamples = frames_read;
-                break;
-            }
-        } else {
-            silence_count = 0;
+        resampler_reset(capture->resampler);
+        job->resampler = capture->resampler;
+    }
+
+    log_debug("Starting to record...");
+
+    pthread_mutex_lock(&job->lock);
+    job->pending = true;
+    pthread_cond_signal(&capture->start);
+    pthread_mutex_unlock(&job->lock);
+
+    // Hand conditioned audio to the consumer as it arrives so recognition
+    // can run while the user is still speaking
+    size_t delivered = 0;
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        while (job->conditioned == delivered && !job->done) {
+            pthread_cond_wait(&job->ready, &job->lock);
+        }
+        size_t available = job->conditioned;
+        bool finished = job->done;
+        pthread_mutex_unlock(&job->lock);
+
+        if (consumer && available > delivered &&
+            consumer(buffer + delivered, available - delivered, user)) {
+            pthread_mutex_lock(&job->lock);
+            job->stop_requested = true;
+            pthread_mutex_unlock(&job->lock);
+        }
+        delivered = available;
+
+        if (finished) {
+            break;
         }
-        
-        frames_read += rc;
     }
+    capture->stats.recordings++;
+    capture->stats.frames_captured += job->frames_read;
+    capture->stats.xruns += job->xruns;
+    capture->stats.allocations += job->allocations;
 
-    // Process the recorded audio
-    remove_dc_offset(buffer, frames_read);
-    normalize_audio(buffer, frames_read);
+    if (job->xruns > 0) {
+        log_warn("Capture overruns this recording: %lu (total %lu over %lu recordings)",
+                 job->xruns, capture->stats.xruns, capture->stats.recordings);
+    }
 
-    *out_nsamps = frames_read;
-    snd_pcm_close(capture_handle);
-    return buffer;
+    if (job->error < 0) {
+        log_error("Read error on %s source: %s", source->name, snd_strerror(job->error));
+        goto cleanup;
+    }
+
+    if (job->silence_count >= job->silence_windows) {
+        log_debug("Detected extended silence, stopping recording...");
+    }
+
+    // DC removal and level control were applied while streaming
+    *out_nsamps = job->conditioned;
+    source->close(source);
+    return 0;
 
 cleanup:
-    snd_pcm_close(capture_handle);
-    free(buffer);
-    return NULL;
+    source->close(source);
+    return -1;
 } 
\ No newline at end of file
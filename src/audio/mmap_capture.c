@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <alsa/asoundlib.h>
+#include "../../include/speech_processor.h"
+
+#define LOG_MODULE LOG_MODULE_AUDIO
+#include "../../include/log.h"
+
+// Configure the device for mmap access with small, explicit periods so that
+// wakeups happen every config->period_ms instead of once per buffer.
+// rate and channels are requested on input and hold the granted values on return.
+int configure_mmap_capture(snd_pcm_t *handle, const CaptureConfig *config,
+                           unsigned int *rate, unsigned int *channels,
+                           snd_pcm_uframes_t *period_frames) {
+    snd_pcm_hw_params_t *hw_params;
+    snd_pcm_sw_params_t *sw_params;
+    int err;
+
+    snd_pcm_hw_params_alloca(&hw_params);
+    snd_pcm_sw_params_alloca(&sw_params);
+
+    if ((err = snd_pcm_hw_params_any(handle, hw_params)) < 0) {
+        log_error("Cannot initialize hardware parameter structure: %s", snd_strerror(err));
+        return err;
+    }
+
+    if ((err = snd_pcm_hw_params_set_access(handle, hw_params, SND_PCM_ACCESS_MMAP_INTERLEAVED)) < 0) {
+        log_warn("Device does not support mmap capture: %s", snd_strerror(err));
+        return err;
+    }
+
+    if ((err = snd_pcm_hw_params_set_format(handle, hw_params, SND_PCM_FORMAT_S16_LE)) < 0) {
+        log_error("Cannot set sample format: %s", snd_strerror(err));
+        return err;
+    }
+
+    if ((err = snd_pcm_hw_params_set_rate_near(handle, hw_params, rate, 0)) < 0) {
+        log_error("Cannot set sample rate: %s", snd_strerror(err));
+        return err;
+    }
+
+    if ((err = snd_pcm_hw_params_set_channels_near(handle, hw_params, channels)) < 0) {
+        log_error("Cannot set channel count: %s", snd_strerror(err));
+        return err;
+    }
+
+    snd_pcm_uframes_t period = *rate * config->period_ms / 1000;
+    if ((err = snd_pcm_hw_params_set_period_size_near(handle, hw_params, &period, 0)) < 0) {
+        log_error("Cannot set period size: %s", snd_strerror(err));
+        return err;
+    }
+
+    snd_pcm_uframes_t buffer_size = period * config->periods;
+    if ((err = snd_pcm_hw_params_set_buffer_size_near(handle, hw_params, &buffer_size)) < 0) {
+        log_error("Cannot set buffer size: %s", snd_strerror(err));
+        return err;
+    }
+
+    if ((err = snd_pcm_hw_params(handle, hw_params)) < 0) {
+        log_error("Cannot set parameters: %s", snd_strerror(err));
+        return err;
+    }
+
+    snd_pcm_hw_params_get_period_size(hw_params, &period, 0);
+    snd_pcm_hw_params_get_buffer_size(hw_params, &buffer_size);
+
+    // Wake up once per period; capture is started explicitly
+    if ((err = snd_pcm_sw_params_current(handle, sw_params)) < 0 ||
+        (err = snd_pcm_sw_params_set_avail_min(handle, sw_params, period)) < 0 ||
+        (err = snd_pcm_sw_params(handle, sw_params)) < 0) {
+        log_error("Cannot set software parameters: %s", snd_strerror(err));
+        return err;
+    }
+
+    log_debug("Capture: mmap, %u Hz x%u, period %lu frames (%.1f ms), buffer %lu frames (%.1f ms)",
+              *rate, *channels,
+              (unsigned long)period, period * 1000.0 / *rate,
+              (unsigned long)buffer_size, buffer_size * 1000.0 / *rate);
+
+    *period_frames = period;
+    return 0;
+}
+
+// Recover from an overrun or suspend and restart the stream
+static int recover_capture(snd_pcm_t *handle, int err, unsigned long *xruns) {
+    if (err == -EPIPE || err == -ESTRPIPE) {
+        (*xruns)++;
+    }
+    if ((err = snd_pcm_recover(handle, err, 1)) < 0) {
+        return err;
+    }
+    return snd_pcm_start(handle);
+}
+
+// Block until the device signals that at least one period is available
+static int wait_for_period(snd_pcm_t *handle, struct pollfd *ufds, int count) {
+    unsigned short revents;
+
+    for (;;) {
+        if (poll(ufds, count, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        snd_pcm_poll_descriptors_revents(handle, ufds, count, &revents);
+        if (revents & POLLERR) {
+            return -EPIPE;
+        }
+        if (revents & POLLIN) {
+            return 0;
+        }
+    }
+}
+
+int run_mmap_capture(snd_pcm_t *handle, snd_pcm_uframes_t period_frames,
+                     AudioFrameHandler handler, void *user, unsigned long *xruns) {
+    int count = snd_pcm_poll_descriptors_count(handle);
+    if (count <= 0) {
+        log_error("Invalid poll descriptors count");
+        return count < 0 ? count : -EINVAL;
+    }
+
+    struct pollfd *ufds = alloca(sizeof(struct pollfd) * count);
+    int err = snd_pcm_poll_descriptors(handle, ufds, count);
+    if (err < 0) {
+        log_error("Unable to obtain poll descriptors: %s", snd_strerror(err));
+        return err;
+    }
+
+    if ((err = snd_pcm_start(handle)) < 0) {
+        log_error("Cannot start capture: %s", snd_strerror(err));
+        return err;
+    }
+
+    for (;;) {
+        snd_pcm_sframes_t avail = snd_pcm_avail_update(handle);
+        if (avail < 0) {
+            if ((err = recover_capture(handle, (int)avail, xruns)) < 0) {
+                return err;
+            }
+            continue;
+        }
+
+        if ((snd_pcm_uframes_t)avail < period_frames) {
+            if ((err = wait_for_period(handle, ufds, count)) < 0) {
+                if ((err = recover_capture(handle, err, xruns)) < 0) {
+                    return err;
+                }
+            }
+            continue;
+        }
+
+        snd_pcm_uframes_t remaining = (snd_pcm_uframes_t)avail;
+        while (remaining > 0) {
+            const snd_pcm_channel_area_t *areas;
+            snd_pcm_uframes_t offset;
+            snd_pcm_uframes_t frames = remaining;
+
+            if ((err = snd_pcm_mmap_begin(handle, &areas, &offset, &frames)) < 0) {
+                if ((err = recover_capture(handle, err, xruns)) < 0) {
+                    return err;
+                }
+                break;
+            }
+
+            // Interleaved S16: hand the consumer a pointer straight into the DMA area
+            const int16_t *data = (const int16_t *)((const char *)areas[0].addr +
+                                                    (areas[0].first + offset * areas[0].step) / 8);
+            int stop = handler(data, frames, user);
+
+            snd_pcm_sframes_t committed = snd_pcm_mmap_commit(handle, offset, frames);
+            if (committed < 0 || (snd_pcm_uframes_t)committed != frames) {
+                if ((err = recover_capture(handle, committed >= 0 ? -EPIPE : (int)committed, xruns)) < 0) {
+                    return err;
+                }
+                break;
+            }
+
+            if (stop) {
+                snd_pcm_drop(handle);
+                return 0;
+            }
+            remaining -= frames;
+        }
+    }
+}
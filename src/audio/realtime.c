@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "../../include/realtime.h"
+
+#define LOG_MODULE LOG_MODULE_AUDIO
+#include "../../include/log.h"
+
+int set_thread_realtime(int priority) {
+    if (priority <= 0) {
+        return 0;
+    }
+
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = priority;
+
+    int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (err != 0) {
+        log_warn("Cannot set SCHED_FIFO priority %d: %s", priority, strerror(err));
+        log_warn("Grant CAP_SYS_NICE or raise LimitRTPRIO to enable real-time capture");
+        return -1;
+    }
+    return 0;
+}
+
+int pin_thread_to_cpu(int cpu, cpu_set_t *saved) {
+    if (cpu < 0) {
+        return -1;
+    }
+
+    if (saved) {
+        CPU_ZERO(saved);
+        pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), saved);
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set);
+    if (err != 0) {
+        log_warn("Cannot pin thread to CPU %d: %s", cpu, strerror(err));
+        return -1;
+    }
+    return 0;
+}
+
+void restore_thread_affinity(const cpu_set_t *saved) {
+    if (saved) {
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), saved);
+    }
+}
+
+void *alloc_locked_buffer(size_t bytes) {
+    void *buffer = NULL;
+    long page_size = sysconf(_SC_PAGESIZE);
+
+    if (page_size <= 0) {
+        page_size = 4096;
+    }
+
+    if (posix_memalign(&buffer, (size_t)page_size, bytes) != 0) {
+        return NULL;
+    }
+
+    // Touch every page up front so the first capture period never faults
+    memset(buffer, 0, bytes);
+
+    if (mlock(buffer, bytes) != 0) {
+        log_warn("Cannot lock audio buffer in memory: %s (continuing unlocked)",
+                 strerror(errno));
+    }
+    return buffer;
+}
+
+void free_locked_buffer(void *buffer, size_t bytes) {
+    if (!buffer) {
+        return;
+    }
+    munlock(buffer, bytes);
+    free(buffer);
+}
@@ -0,0 +1,218 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../../include/resampler.h"
+
+#define LOG_MODULE LOG_MODULE_AUDIO
+#include "../../include/log.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+struct Resampler {
+    unsigned int channels;
+    unsigned int up;          // Interpolation factor L
+    unsigned int down;        // Decimation factor M
+    int16_t *coeffs;          // up phases of RESAMPLER_TAPS, each stored reversed
+    int16_t *history;         // Mono input: RESAMPLER_TAPS - 1 history samples + one block
+    size_t fill;              // Valid samples in history
+    size_t position;          // Newest input sample used by the next output
+    unsigned int phase;       // Polyphase branch for the next output
+};
+
+static unsigned int gcd(unsigned int a, unsigned int b) {
+    while (b) {
+        unsigned int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Q15 dot product of RESAMPLER_TAPS samples against one polyphase branch
+static inline int32_t dot_q15(const int16_t *x, const int16_t *c) {
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    int32x4_t acc = vdupq_n_s32(0);
+    for (int i = 0; i < RESAMPLER_TAPS; i += 8) {
+        int16x8_t a = vld1q_s16(x + i);
+        int16x8_t b = vld1q_s16(c + i);
+        acc = vmlal_s16(acc, vget_low_s16(a), vget_low_s16(b));
+        acc = vmlal_s16(acc, vget_high_s16(a), vget_high_s16(b));
+    }
+#if defined(__aarch64__)
+    return vaddvq_s32(acc);
+#else
+    int32x2_t sum = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+    return vget_lane_s32(vpadd_s32(sum, sum), 0);
+#endif
+#elif defined(__SSE2__)
+    __m128i acc = _mm_setzero_si128();
+    for (int i = 0; i < RESAMPLER_TAPS; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(x + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(c + i));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(a, b));
+    }
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(acc);
+#else
+    int32_t acc = 0;
+    for (int i = 0; i < RESAMPLER_TAPS; i++) {
+        acc += (int32_t)x[i] * c[i];
+    }
+    return acc;
+#endif
+}
+
+// Design a windowed-sinc low-pass prototype at up * in_rate and split it
+// into polyphase branches, reversed so each output is a forward dot product
+static void design_filter(Resampler *rs) {
+    size_t length = (size_t)rs->up * RESAMPLER_TAPS;
+    unsigned int widest = rs->up > rs->down ? rs->up : rs->down;
+    double cutoff = 0.45 / widest;   // Just below the output Nyquist
+    double center = (length - 1) / 2.0;
+    double *prototype = malloc(sizeof(double) * length);
+    double sum = 0.0;
+
+    for (size_t n = 0; n < length; n++) {
+        double t = n - center;
+        double sinc = (t == 0.0) ? 2.0 * cutoff : sin(2.0 * M_PI * cutoff * t) / (M_PI * t);
+        double window = 0.42 - 0.5 * cos(2.0 * M_PI * n / (length - 1))
+                             + 0.08 * cos(4.0 * M_PI * n / (length - 1));
+        prototype[n] = sinc * window;
+        sum += prototype[n];
+    }
+
+    // Unity DC gain per branch
+    double gain = rs->up / sum;
+    for (unsigned int p = 0; p < rs->up; p++) {
+        for (unsigned int j = 0; j < RESAMPLER_TAPS; j++) {
+            double h = prototype[p + (size_t)j * rs->up] * gain;
+            rs->coeffs[(size_t)p * RESAMPLER_TAPS + (RESAMPLER_TAPS - 1 - j)] =
+                (int16_t)lrint(h * 32767.0);
+        }
+    }
+
+    free(prototype);
+}
+
+Resampler *resampler_create(unsigned int in_rate, unsigned int out_rate, unsigned int channels) {
+    if (in_rate == 0 || out_rate == 0 || channels == 0) {
+        return NULL;
+    }
+
+    Resampler *rs = calloc(1, sizeof(Resampler));
+    if (!rs) {
+        return NULL;
+    }
+
+    unsigned int g = gcd(in_rate, out_rate);
+    rs->channels = channels;
+    rs->up = out_rate / g;
+    rs->down = in_rate / g;
+    rs->coeffs = malloc(sizeof(int16_t) * rs->up * RESAMPLER_TAPS);
+    rs->history = malloc(sizeof(int16_t) * (RESAMPLER_TAPS - 1 + RESAMPLER_BLOCK));
+
+    if (!rs->coeffs || !rs->history) {
+        resampler_destroy(rs);
+        return NULL;
+    }
+
+    design_filter(rs);
+    resampler_reset(rs);
+
+    log_debug("Resampler: %u Hz x%u -> %u Hz mono (L=%u, M=%u, %d taps/phase)",
+              in_rate, channels, out_rate, rs->up, rs->down, RESAMPLER_TAPS);
+    return rs;
+}
+
+void resampler_destroy(Resampler *rs) {
+    if (!rs) {
+        return;
+    }
+    free(rs->coeffs);
+    free(rs->history);
+    free(rs);
+}
+
+void resampler_reset(Resampler *rs) {
+    memset(rs->history, 0, sizeof(int16_t) * (RESAMPLER_TAPS - 1));
+    rs->fill = RESAMPLER_TAPS - 1;
+    rs->position = RESAMPLER_TAPS - 1;
+    rs->phase = 0;
+}
+
+// Append frames to the history as mono
+static void downmix(Resampler *rs, const int16_t *in, size_t frames) {
+    int16_t *dst = rs->history + rs->fill;
+
+    if (rs->channels == 1) {
+        memcpy(dst, in, frames * sizeof(int16_t));
+    } else if (rs->channels == 2) {
+        for (size_t i = 0; i < frames; i++) {
+            dst[i] = (int16_t)(((int32_t)in[2 * i] + in[2 * i + 1]) >> 1);
+        }
+    } else {
+        for (size_t i = 0; i < frames; i++) {
+            int32_t sum = 0;
+            for (unsigned int ch = 0; ch < rs->channels; ch++) {
+                sum += in[i * rs->channels + ch];
+            }
+            dst[i] = (int16_t)(sum / (int32_t)rs->channels);
+        }
+    }
+    rs->fill += frames;
+}
+
+size_t resampler_process(Resampler *rs, const int16_t *in, size_t frames,
+                         int16_t *out, size_t max_out) {
+    size_t written = 0;
+
+    // Enough input for max_out outputs, rounded up so that a nearly full
+    // out still gets its last samples
+    size_t max_frames = (max_out * rs->down + rs->up - 1) / rs->up;
+    if (frames > max_frames) {
+        frames = max_frames;
+    }
+
+    while (frames > 0) {
+        // Input left over when out filled up stays in the history
+        size_t space = RESAMPLER_TAPS - 1 + RESAMPLER_BLOCK - rs->fill;
+        size_t block = frames < space ? frames : space;
+        downmix(rs, in, block);
+        in += block * rs->channels;
+        frames -= block;
+
+        while (rs->position < rs->fill && written < max_out) {
+            int32_t acc = dot_q15(rs->history + rs->position - (RESAMPLER_TAPS - 1),
+                                  rs->coeffs + (size_t)rs->phase * RESAMPLER_TAPS);
+            acc = (acc + (1 << 14)) >> 15;
+            if (acc > INT16_MAX) acc = INT16_MAX;
+            if (acc < INT16_MIN) acc = INT16_MIN;
+            out[written++] = (int16_t)acc;
+
+            rs->phase += rs->down;
+            rs->position += rs->phase / rs->up;
+            rs->phase %= rs->up;
+        }
+
+        // Keep only the history the next output still needs
+        size_t shift = rs->position - (RESAMPLER_TAPS - 1);
+        if (shift > rs->fill) {
+            shift = rs->fill;
+        }
+        memmove(rs->history, rs->history + shift, (rs->fill - shift) * sizeof(int16_t));
+        rs->fill -= shift;
+        rs->position -= shift;
+
+        if (written >= max_out) {
+            break;
+        }
+    }
+
+    return written;
+}
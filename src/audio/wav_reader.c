@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "../../include/wav_reader.h"
+#include "../../include/speech_processor.h"
+#include "../../include/resampler.h"
+
+#define LOG_MODULE LOG_MODULE_AUDIO
+#include "../../include/log.h"
+
+#define WAV_FORMAT_PCM 0x0001
+#define WAV_FORMAT_IMA_ADPCM 0x0011
+#define WAV_FORMAT_EXTENSIBLE 0xfffe
+
+typedef struct {
+    uint16_t format;
+    uint16_t channels;
+    uint32_t rate;
+    uint16_t block_align;
+    uint16_t bits;
+    uint16_t samples_per_block;     // IMA ADPCM only
+    uint32_t fact_samples;          // From the fact chunk, 0 if absent
+    const uint8_t *data;
+    size_t data_bytes;
+} WavInfo;
+
+static const int16_t ima_steps[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+    11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+    32767
+};
+static const int8_t ima_index_adjust[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+static uint16_t get_le16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Walk the RIFF chunks; returns false if fmt or data is missing
+static bool parse_wav(const uint8_t *file, size_t size, WavInfo *info) {
+    bool have_format = false;
+
+    memset(info, 0, sizeof(*info));
+    if (size < 12 || memcmp(file, "RIFF", 4) != 0 || memcmp(file + 8, "WAVE", 4) != 0) {
+        return false;
+    }
+
+    size_t offset = 12;
+    while (offset + 8 <= size) {
+        const uint8_t *chunk = file + offset;
+        size_t length = get_le32(chunk + 4);
+        size_t available = size - offset - 8;
+        const uint8_t *body = chunk + 8;
+
+        if (memcmp(chunk, "fmt ", 4) == 0 && length >= 16 && length <= available) {
+            info->format = get_le16(body);
+            info->channels = get_le16(body + 2);
+            info->rate = get_le32(body + 4);
+            info->block_align = get_le16(body + 12);
+            info->bits = get_le16(body + 14);
+            if (info->format == WAV_FORMAT_EXTENSIBLE && length >= 40) {
+                info->format = get_le16(body + 24);     // Sub-format GUID starts with the format code
+            } else if (info->format == WAV_FORMAT_IMA_ADPCM && length >= 20) {
+                info->samples_per_block = get_le16(body + 18);
+            }
+            have_format = true;
+        } else if (memcmp(chunk, "fact", 4) == 0 && length >= 4 && length <= available) {
+            info->fact_samples = get_le32(body);
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            // Streamed files may leave the length unset; take what is there
+            info->data = body;
+            info->data_bytes = length <= available ? length : available;
+            return have_format;
+        }
+        offset += 8 + length + (length & 1);
+    }
+    return false;
+}
+
+// Decode mono IMA ADPCM blocks; returns the number of samples written
+static size_t decode_ima_adpcm(const WavInfo *info, int16_t *out, size_t max_samples) {
+    size_t written = 0;
+
+    for (size_t offset = 0; offset + info->block_align <= info->data_bytes && written < max_samples;
+         offset += info->block_align) {
+        const uint8_t *block = info->data + offset;
+        int predictor = (int16_t)get_le16(block);
+        int index = block[2] > 88 ? 88 : block[2];
+        out[written++] = (int16_t)predictor;
+
+        for (size_t i = 0; i + 1 < info->samples_per_block && written < max_samples; i++) {
+            uint8_t byte = block[4 + i / 2];
+            uint8_t nibble = (i & 1) ? byte >> 4 : byte & 0x0f;
+            int step = ima_steps[index];
+            int delta = step >> 3;
+            if (nibble & 4) delta += step;
+            if (nibble & 2) delta += step >> 1;
+            if (nibble & 1) delta += step >> 2;
+
+            predictor += (nibble & 8) ? -delta : delta;
+            if (predictor > 32767) predictor = 32767;
+            if (predictor < -32768) predictor = -32768;
+            index += ima_index_adjust[nibble];
+            if (index < 0) index = 0;
+            if (index > 88) index = 88;
+            out[written++] = (int16_t)predictor;
+        }
+    }
+    return written;
+}
+
+static uint8_t *read_whole_file(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+
+    uint8_t *contents = NULL;
+    long length = -1;
+    if (fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) > 0 && fseek(file, 0, SEEK_SET) == 0) {
+        contents = malloc(length);
+        if (contents && fread(contents, 1, length, file) != (size_t)length) {
+            free(contents);
+            contents = NULL;
+        }
+    }
+    fclose(file);
+    *size = contents ? (size_t)length : 0;
+    return contents;
+}
+
+int16_t *read_wav_file(const char *path, size_t *out_samples) {
+    WavInfo info;
+    size_t size;
+    int16_t *decoded = NULL;
+    size_t frames = 0;
+
+    uint8_t *file = read_whole_file(path, &size);
+    if (!file) {
+        log_error("Cannot read %s", path);
+        return NULL;
+    }
+    if (!parse_wav(file, size, &info) || info.channels == 0 || info.rate == 0) {
+        log_error("%s: not a WAV file", path);
+        free(file);
+        return NULL;
+    }
+
+    // Decode to interleaved 16-bit frames at the file's own rate
+    if (info.format == WAV_FORMAT_PCM && info.bits == 16) {
+        frames = info.data_bytes / (2 * info.channels);
+        if (frames <= (size_t)WAV_MAX_SECONDS * info.rate && (decoded = malloc(frames * info.channels * 2 + 2))) {
+            for (size_t i = 0; i < frames * info.channels; i++) {
+                decoded[i] = (int16_t)get_le16(info.data + 2 * i);
+            }
+        }
+    } else if (info.format == WAV_FORMAT_IMA_ADPCM && info.channels == 1 && info.block_align > 4) {
+        uint16_t block_samples = (info.block_align - 4) * 2 + 1;
+        if (info.samples_per_block == 0 || info.samples_per_block > block_samples) {
+            info.samples_per_block = block_samples;
+        }
+        size_t capacity = info.data_bytes / info.block_align * info.samples_per_block;
+        if (info.fact_samples > 0 && info.fact_samples < capacity) {
+            capacity = info.fact_samples;
+        }
+        if (capacity <= (size_t)WAV_MAX_SECONDS * info.rate && (decoded = malloc(capacity * 2 + 2))) {
+            frames = decode_ima_adpcm(&info, decoded, capacity);
+        }
+    } else {
+        log_error("%s: unsupported WAV format %#x (%u-bit, %u channels)",
+                  path, info.format, info.bits, info.channels);
+        free(file);
+        return NULL;
+    }
+    free(file);
+
+    if (!decoded) {
+        log_error("%s: longer than %d seconds or out of memory", path, WAV_MAX_SECONDS);
+        return NULL;
+    }
+
+    // Downmix and convert to SAMPLE_RATE mono with the capture resampler
+    if (info.rate != SAMPLE_RATE || info.channels != 1) {
+        size_t max_out = frames * SAMPLE_RATE / info.rate + 2;
+        int16_t *converted = malloc(max_out * sizeof(int16_t));
+        Resampler *rs = converted ? resampler_create(info.rate, SAMPLE_RATE, info.channels) : NULL;
+        if (!rs) {
+            log_error("%s: cannot convert %u Hz, %u channels", path, info.rate, info.channels);
+            free(converted);
+            free(decoded);
+            return NULL;
+        }
+        frames = resampler_process(rs, decoded, frames, converted, max_out);
+        resampler_destroy(rs);
+        free(decoded);
+        decoded = converted;
+    }
+
+    *out_samples = frames;
+    return decoded;
+}
@@ -1,14 +1,283 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
+#include <signal.h>
 #include "../include/speech_processor.h"
 #include "../include/intent_processor.h"
+#include "../include/service.h"
+#include "../include/flight_recorder.h"
+#include "../include/speculation.h"
+#include "../include/model_manager.h"
+#include "../include/batch_transcriber.h"
+#include "../include/audio_backend.h"
+#include "../include/alloc_counter.h"
+#include "../include/config.h"
+#include "../include/memory_accounting.h"
+#include "../include/log.h"
+
+// Command-line settings, which take precedence over the config file
+typedef struct {
+    const char *path;           // --config, NULL for CONFIG_DEFAULT_PATH
+    const char *profile;        // --profile, NULL for the one named in the file
+    bool no_speculation;
+    double endpoint_ms;         // Negative: from the config
+    size_t model_budget_mb;     // 0: from the config
+    size_t batch_jobs;          // 0: from the config
+    const char *log_filter;     // NULL: from the config
+} ConfigOverrides;
+
+// Set by SIGHUP; the settings are reloaded between turns
+static volatile sig_atomic_t reload_requested;
+
+// Set by SIGUSR1; the memory report is logged between turns
+static volatile sig_atomic_t report_requested;
+
+static void request_reload(int signal_number) {
+    (void)signal_number;
+    reload_requested = 1;
+}
+
+static void request_report(int signal_number) {
+    (void)signal_number;
+    report_requested = 1;
+}
 
 void clear_input_buffer(void) {
     int c;
     while ((c = getchar()) != '\n' && c != EOF);
 }
 
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Returns early if a signal arrives, so a reload is not delayed
+static void sleep_ms(unsigned int ms) {
+    struct timespec delay = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    nanosleep(&delay, NULL);
+}
+
+// Defaults, then the config file, then the command line
+static bool load_settings(const ConfigOverrides *overrides, VaaniConfig *config) {
+    VaaniConfig loaded;
+
+    default_config(&loaded);
+    if (!load_config(overrides->path, overrides->profile, &loaded)) {
+        return false;
+    }
+    if (overrides->no_speculation) {
+        loaded.speculation_enabled = false;
+    }
+    if (overrides->endpoint_ms >= 0) {
+        loaded.speculation.endpoint_ms = overrides->endpoint_ms;
+    }
+    if (overrides->model_budget_mb > 0) {
+        loaded.model_budget_mb = overrides->model_budget_mb;
+    }
+    if (overrides->batch_jobs > 0) {
+        loaded.batch_jobs = overrides->batch_jobs;
+    }
+    if (overrides->log_filter) {
+        snprintf(loaded.log_filter, sizeof(loaded.log_filter), "%s", overrides->log_filter);
+    }
+    *config = loaded;
+    return true;
+}
+
+// Apply the settings that are shared by every thread
+static void apply_shared_settings(const VaaniConfig *config, IntentProcessor *intents) {
+    for (int m = 0; m < LOG_MODULE_COUNT; m++) {
+        set_log_level(m, LOG_DEFAULT_LEVEL);
+    }
+    set_log_filter(config->log_filter);
+    set_tts_config(&config->tts);
+    set_memory_budget(MEMORY_INTENTS, config->intents_budget_mb << 20);
+    set_memory_budget(MEMORY_AUDIO, config->audio_budget_mb << 20);
+    set_memory_budget(MEMORY_TTS, config->tts_budget_mb << 20);
+    if (intents) {
+        set_intent_min_similarity(intents, config->intent_min_similarity);
+        set_intent_group_fanout(intents, config->intent_group_fanout);
+    }
+}
+
+// SIGHUP: load the config file again, keeping the running settings if it
+// has errors. Settings only read at startup keep their running values.
+static bool reload_settings(const ConfigOverrides *overrides, VaaniConfig *config,
+                            IntentProcessor *intents) {
+    VaaniConfig loaded;
+
+    log_info("Reloading settings");
+    if (!load_settings(overrides, &loaded)) {
+        log_warn("Keeping the previous settings");
+        return false;
+    }
+    keep_startup_settings(config, &loaded);
+    *config = loaded;
+    apply_shared_settings(config, intents);
+    return true;
+}
+
+// Create, update or destroy the loop's speculation to match config
+static Speculation *update_speculation(Speculation *speculation, const VaaniConfig *config,
+                                       IntentProcessor *intents) {
+    if (!config->speculation_enabled) {
+        destroy_speculation(speculation);
+        return NULL;
+    }
+    if (!speculation) {
+        return create_speculation(intents, &config->speculation);
+    }
+    speculation_set_config(speculation, &config->speculation);
+    return speculation;
+}
+
+// Copy the session's last utterance into a flight record
+static void record_utterance(FlightRecord *record, const SpeechSession *session, const char *text) {
+    SpeechTimings timings;
+    size_t samples = 0;
+    const int16_t *audio = speech_session_audio(session, &samples);
+
+    if (!record) return;
+    flight_record_audio(record, audio, samples);
+    flight_record_transcript(record, text);
+    get_speech_timings(session, &timings);
+    flight_record_stage(record, "capture", timings.capture_ms);
+    flight_record_stage(record, "finalize", timings.finalize_ms);
+}
+
+// Recognizer for the microphone loop: its session and the model it uses
+typedef struct {
+    ModelManager *models;
+    const char *language;
+    SpeechModel *model;
+    SpeechSession *session;
+    AudioSource *source;
+    const SpeechConfig *config;     // Applied to every session
+} LoopRecognizer;
+
+// Switch the loop to the model for language, releasing the current one.
+// On failure, including a substitute model for language, the current model
+// and session stay in use.
+static int use_language(LoopRecognizer *mic, const char *language) {
+    const char *actual;
+    SpeechModel *model = acquire_model(mic->models, language, &actual);
+    SpeechSession *session = model && strcmp(actual, language) == 0 ? create_speech_session(model) : NULL;
+    if (!session) {
+        release_model(mic->models, model);
+        return 0;
+    }
+    set_speech_session_config(session, mic->config);
+    set_speech_session_source(session, mic->source);
+
+    destroy_speech_session(mic->session);
+    release_model(mic->models, mic->model);
+    mic->model = model;
+    mic->session = session;
+    mic->language = language;
+    return 1;
+}
+
+// With --language auto: decode the utterance again with the model for its
+// language if that is not the one that just transcribed it
+static const char *route_utterance(LoopRecognizer *mic, const char *text) {
+    size_t samples = 0;
+    const int16_t *audio = speech_session_audio(mic->session, &samples);
+    const char *language = identify_language(mic->models, audio, samples);
+
+    if (!audio || strcmp(language, mic->language) == 0) {
+        return text;
+    }
+
+    // The audio belongs to the session being replaced
+    int16_t *copy = malloc(samples * sizeof(int16_t));
+    if (!copy) {
+        return text;
+    }
+    memcpy(copy, audio, samples * sizeof(int16_t));
+    printf("Switching speech model to %s\n", language);
+    if (!use_language(mic, language) &&
+        (strcmp(mic->language, MODEL_DEFAULT_LANGUAGE) == 0 || !use_language(mic, MODEL_DEFAULT_LANGUAGE))) {
+        // Still on the session that transcribed text, so it remains valid
+        log_warn("Could not load the %s speech model; keeping %s", language, mic->language);
+        free(copy);
+        return text;
+    }
+    text = transcribe_audio(mic->session, copy, samples, NULL);
+    free(copy);
+    return text;
+}
+
+// --alloc-check: run turns of capture and answer lookup, counting heap
+// allocations on both the loop and capture threads. Every turn after the
+// first (which warms up lazily created state) should make none. Speech
+// recognition is left out; Vosk allocates internally on every utterance.
+static int run_alloc_check(AudioSource *source, const CaptureConfig *config,
+                           IntentProcessor *intents, int turns) {
+    char text[MAX_QUESTION_LENGTH];
+    char answer[MAX_ANSWER_LENGTH];
+    CaptureStats before, after;
+    size_t samples = 0;
+    int failures = 0;
+
+    if (!ALLOC_COUNTING) {
+        log_error("Allocation counting is not built in; rebuild with make ALLOC_COUNT=1");
+        return 1;
+    }
+
+    AudioCapture *capture = create_audio_capture(source);
+    int16_t *buffer = alloc_audio_buffer();
+    size_t questions = get_intent_count(intents);
+    if (!capture || !buffer || questions == 0) {
+        destroy_audio_capture(capture);
+        free_audio_buffer(buffer);
+        return 1;
+    }
+    set_audio_capture_config(capture, config);
+
+    for (int turn = 0; turn < turns; turn++) {
+        // Questions from the table; every other one loses its first word so
+        // that the similarity search runs as well as the exact match
+        unsigned int token = intent_read_lock(intents);
+        const IntentEntry *entry = get_intent_entry(intents, turn % questions);
+        const char *question = entry ? entry->question : "";
+        const char *space = strchr(question, ' ');
+        snprintf(text, sizeof(text), "%s", (turn & 1) && space ? space + 1 : question);
+        intent_read_unlock(intents, token);
+
+        get_capture_stats(capture, &before);
+        unsigned long started = thread_allocations();
+        int recorded = record_audio_into(capture, buffer, BUFFER_SIZE, &samples, NULL, NULL) == 0;
+        unsigned long capture_allocations = thread_allocations() - started;
+        get_capture_stats(capture, &after);
+        unsigned long capture_thread_allocations = after.allocations - before.allocations;
+
+        started = thread_allocations();
+        int answered = find_matching_answer(intents, text, answer, sizeof(answer)) != NULL;
+        unsigned long match_allocations = thread_allocations() - started;
+
+        printf("Turn %d: %zu samples%s, %s; allocations: capture %lu, capture thread %lu, matching %lu\n",
+               turn + 1, recorded ? samples : 0, recorded ? "" : " (capture failed)",
+               answered ? "answered" : "not answered",
+               capture_allocations, capture_thread_allocations, match_allocations);
+        if (turn > 0 && capture_allocations + capture_thread_allocations + match_allocations > 0) {
+            failures++;
+        }
+    }
+
+    if (failures > 0) {
+        printf("%d of %d steady-state turns allocated\n", failures, turns - 1);
+    } else {
+        printf("No allocations after the first turn\n");
+    }
+    destroy_audio_capture(capture);
+    free_audio_buffer(buffer);
+    return failures > 0;
+}
+
 void show_menu(void) {
     printf("\n=== Vaani Speech Processing Menu ===\n");
     printf("1. Ask a Question (Speech Q&A)\n");
@@ -18,25 +287,274 @@ void show_menu(void) {
     printf("Enter your choice (1-4): ");
 }
 
-int main(void) {
+static void show_usage(const char *program) {
+    printf("Usage: %s [--daemon] [--socket PATH] [--headless] [--record DIR]\n"
+           "       [--no-speculation] [--endpoint-ms MS]\n"
+           "       [--language LANG|auto] [--model LANG=DIR] [--model-budget MB]\n"
+           "       [--batch INPUT [--output FILE] [--jobs N]]\n"
+           "       [--audio-in SPEC] [--audio-out SPEC] [--alloc-check TURNS]\n"
+           "       [--log FILTER] [--config FILE] [--profile NAME]\n", program);
+    printf("  --daemon       Serve intent, transcription and TTS requests on a Unix socket\n");
+    printf("  --socket PATH  Socket path for --daemon (default %s, or %s in\n"
+           "                 $RUNTIME_DIRECTORY)\n", VAANI_SOCKET_PATH, VAANI_SOCKET_NAME);
+    printf("  --headless     With --daemon, serve requests only (no microphone loop)\n");
+    printf("  --record DIR   Log each turn's audio, transcript, matches and timings to DIR\n");
+    printf("  --no-speculation  Match only the final transcript (no early answers)\n");
+    printf("  --endpoint-ms MS  End capture once the matched intent is stable this long\n");
+    printf("                    (default %d, 0 keeps recording until silence)\n", SPECULATION_ENDPOINT_MS);
+    printf("  --language LANG   Speech model for the microphone (default %s); auto\n"
+           "                    picks %s or %s per utterance\n",
+           MODEL_DEFAULT_LANGUAGE, MODEL_DEFAULT_LANGUAGE, MODEL_LID_OTHER);
+    printf("  --model LANG=DIR  Use the Vosk model in DIR for LANG (repeatable)\n");
+    printf("  --model-budget MB Memory for loaded speech models (default %d%% of RAM)\n",
+           MODEL_MEMORY_BUDGET_PERCENT);
+    printf("  --batch INPUT     Transcribe and match recorded WAV files, then exit. INPUT is\n"
+           "                    a directory, a file listing WAV paths, or a flight manifest\n");
+    printf("  --output FILE     Batch results as CSV, or JSON lines for *.jsonl (default stdout)\n");
+    printf("  --jobs N          Batch workers (default one per CPU)\n");
+    printf("  --audio-in SPEC   Capture from alsa[:DEVICE] (default), wav:FILE, wav-fast:FILE,\n"
+           "                    stdin, fifo:PATH (raw s16le 16 kHz mono), null or loopback\n");
+    printf("  --audio-out SPEC  Speak on alsa[:DEVICE], null or loopback (default: Festival)\n");
+    printf("  --alloc-check TURNS  Count heap allocations over TURNS capture and match\n"
+           "                    turns, then exit (needs make ALLOC_COUNT=1)\n");
+    printf("  --log FILTER      Log levels, e.g. warn or info,audio=debug (default info;\n"
+           "                    debug messages need make LOG_DEBUG=1)\n");
+    printf("  --config FILE     Settings file (default %s if present); SIGHUP reloads it\n",
+           CONFIG_DEFAULT_PATH);
+    printf("  --profile NAME    Profile of the settings file to use, e.g. low-latency\n");
+    printf("  SIGUSR1 logs memory use per subsystem (models, intents, audio, tts)\n");
+}
+
+int main(int argc, char *argv[]) {
     int choice = 1;
     char text_input[MAX_TEXT_LENGTH];
-    
-    // Initialize Vosk model at program start
-    if (!initialize_vosk_model()) {
-        fprintf(stderr, "Failed to initialize speech recognition. Exiting.\n");
+    char answer[MAX_ANSWER_LENGTH];
+    int daemon_mode = 0;
+    int headless = 0;
+    char default_socket[CONFIG_PATH_LENGTH] = VAANI_SOCKET_PATH;
+    const char *socket_path = default_socket;
+    const char *record_dir = NULL;
+    const char *language = MODEL_DEFAULT_LANGUAGE;
+    const char *model_args[MODEL_MAX_LANGUAGES];
+    size_t model_arg_count = 0;
+    const char *batch_input = NULL;
+    const char *batch_output = NULL;
+    const char *audio_in = NULL;
+    const char *audio_out = AUDIO_DEFAULT_SINK;
+    int alloc_check_turns = 0;
+    ConfigOverrides overrides = { .endpoint_ms = -1 };
+    VaaniConfig config;
+
+    // Under systemd the socket goes in the unit's RuntimeDirectory
+    const char *runtime_dir = getenv("RUNTIME_DIRECTORY");
+    if (runtime_dir && runtime_dir[0]) {
+        snprintf(default_socket, sizeof(default_socket), "%s/%s", runtime_dir, VAANI_SOCKET_NAME);
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--daemon") == 0) {
+            daemon_mode = 1;
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            headless = 1;
+        } else if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_dir = argv[++i];
+        } else if (strcmp(argv[i], "--no-speculation") == 0) {
+            overrides.no_speculation = true;
+        } else if (strcmp(argv[i], "--endpoint-ms") == 0 && i + 1 < argc) {
+            overrides.endpoint_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--language") == 0 && i + 1 < argc) {
+            language = argv[++i];
+        } else if (strcmp(argv[i], "--model") == 0 && i + 1 < argc &&
+                   strchr(argv[i + 1], '=') && model_arg_count < MODEL_MAX_LANGUAGES) {
+            model_args[model_arg_count++] = argv[++i];
+        } else if (strcmp(argv[i], "--model-budget") == 0 && i + 1 < argc) {
+            overrides.model_budget_mb = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch_input = argv[++i];
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            batch_output = argv[++i];
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            overrides.batch_jobs = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--audio-in") == 0 && i + 1 < argc) {
+            audio_in = argv[++i];
+        } else if (strcmp(argv[i], "--audio-out") == 0 && i + 1 < argc) {
+            audio_out = argv[++i];
+        } else if (strcmp(argv[i], "--alloc-check") == 0 && i + 1 < argc) {
+            alloc_check_turns = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+            overrides.log_filter = argv[++i];
+            if (!check_log_filter(overrides.log_filter)) {
+                fprintf(stderr, "Invalid log filter %s\n", overrides.log_filter);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) {
+            overrides.path = argv[++i];
+        } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            overrides.profile = argv[++i];
+        } else {
+            show_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // Settings file and profile, overridden by the flags above
+    if (!load_settings(&overrides, &config)) {
+        return 1;
+    }
+    apply_shared_settings(&config, NULL);
+
+    // Log messages are written by a background thread from here on
+    if (start_logging()) {
+        atexit(stop_logging);
+    }
+
+    // SIGHUP reloads the settings and SIGUSR1 logs the memory report
+    // (between turns, or at once when headless)
+    struct sigaction reload_action = { .sa_handler = request_reload, .sa_flags = SA_RESTART };
+    sigemptyset(&reload_action.sa_mask);
+    sigaction(SIGHUP, &reload_action, NULL);
+    struct sigaction report_action = { .sa_handler = request_report, .sa_flags = SA_RESTART };
+    sigemptyset(&report_action.sa_mask);
+    sigaction(SIGUSR1, &report_action, NULL);
+
+    // Speech models are loaded on first use and kept within the budget
+    ModelManager *models = create_model_manager(config.model_budget_mb << 20);
+    if (!models) {
+        return 1;
+    }
+    for (size_t i = 0; i < model_arg_count; i++) {
+        char model_language[MODEL_LANGUAGE_LENGTH];
+        const char *path = strchr(model_args[i], '=') + 1;
+        snprintf(model_language, sizeof(model_language), "%.*s",
+                 (int)(path - 1 - model_args[i]), model_args[i]);
+        if (!register_model(models, model_language, path)) {
+            log_warn("Ignoring --model %s: not a directory", model_args[i]);
+        }
+    }
+    register_default_models(models);
+
+    // Load the microphone model at program start
+    int route_auto = strcmp(language, "auto") == 0;
+    LoopRecognizer mic = { .models = models, .config = &config.speech };
+    mic.model = acquire_model(models, route_auto ? MODEL_DEFAULT_LANGUAGE : language, &mic.language);
+    if (!mic.model) {
+        log_error("Failed to initialize speech recognition. Exiting.");
+        if (!has_language(models, route_auto ? MODEL_DEFAULT_LANGUAGE : language)) {
+            log_error("Please run the setup script: ./setup_vosk_model.sh");
+        }
+        destroy_model_manager(models);
         return 1;
     }
 
     // Initialize intent processor
-    if (!initialize_intent_processor()) {
-        fprintf(stderr, "Failed to initialize intent processor. Exiting.\n");
-        cleanup_vosk_model();
+    IntentProcessor *intents = initialize_intent_processor(config.intents_csv);
+    if (!intents) {
+        log_error("Failed to initialize intent processor. Exiting.");
+        release_model(models, mic.model);
+        destroy_model_manager(models);
+        return 1;
+    }
+    apply_shared_settings(&config, intents);
+
+    // Offline processing of recorded questions
+    if (batch_input) {
+        int rc = run_batch_transcription(mic.model, intents, batch_input, batch_output, config.batch_jobs);
+        cleanup_intent_processor(intents);
+        release_model(models, mic.model);
+        destroy_model_manager(models);
+        return rc == 0 ? 0 : 1;
+    }
+
+    // Share the loaded models with local clients
+    if (daemon_mode && headless) {
+        if (start_service(socket_path, models, intents) == 0) {
+            // Requests are served on the service thread; this one handles signals
+            log_memory_report("startup");
+            for (;;) {
+                pause();
+                if (reload_requested) {
+                    reload_requested = 0;
+                    reload_settings(&overrides, &config, intents);
+                }
+                if (report_requested) {
+                    report_requested = 0;
+                    log_memory_report("requested");
+                }
+            }
+        }
+        cleanup_intent_processor(intents);
+        release_model(models, mic.model);
+        destroy_model_manager(models);
+        return 1;
+    }
+    if (daemon_mode && start_service(socket_path, models, intents) != 0) {
+        log_warn("Failed to start service on %s. Continuing without it.", socket_path);
+    }
+
+    // Audio in and out for the loop
+    AudioSink *sink = NULL;
+    if (!open_audio_backends(audio_in, audio_out, &mic.source, &sink)) {
+        log_error("Failed to open audio. Exiting.");
+        cleanup_intent_processor(intents);
+        release_model(models, mic.model);
+        destroy_model_manager(models);
+        return 1;
+    }
+
+    if (alloc_check_turns > 0) {
+        int rc = run_alloc_check(mic.source, &config.speech.capture, intents, alloc_check_turns);
+        destroy_audio_source(mic.source);
+        destroy_audio_sink(sink);
+        cleanup_intent_processor(intents);
+        release_model(models, mic.model);
+        destroy_model_manager(models);
+        return rc;
+    }
+
+    // Session for the microphone loop
+    mic.session = create_speech_session(mic.model);
+    if (!mic.session) {
+        log_error("Failed to create speech session. Exiting.");
+        destroy_audio_source(mic.source);
+        destroy_audio_sink(sink);
+        cleanup_intent_processor(intents);
+        release_model(models, mic.model);
+        destroy_model_manager(models);
         return 1;
     }
-    text_to_speech("device has been started");
-    sleep(3);
+    set_speech_session_config(mic.session, &config.speech);
+    set_speech_session_source(mic.session, mic.source);
+
+    // Optional per-turn log for diagnosing field problems
+    FlightRecorder *recorder = NULL;
+    if (record_dir) {
+        recorder = start_flight_recorder(record_dir, FLIGHT_RECORDER_MAX_BYTES);
+        if (!recorder) {
+            log_warn("Continuing without the flight recorder.");
+        }
+    }
+
+    // Match on partial results to answer sooner
+    Speculation *speculation = update_speculation(NULL, &config, intents);
+
+    log_memory_report("startup");
+    speak_text(sink, "device has been started");
+    sleep_ms(config.start_delay_ms);
     while (1) {
+        if (reload_requested) {
+            reload_requested = 0;
+            if (reload_settings(&overrides, &config, intents)) {
+                set_speech_session_config(mic.session, &config.speech);
+                speculation = update_speculation(speculation, &config, intents);
+            }
+        }
+        if (report_requested) {
+            report_requested = 0;
+            log_memory_report("requested");
+        }
+
         // show_menu();
         
         // if (scanf("%d", &choice) != 1) {
@@ -50,32 +568,60 @@ int main(void) {
             case 1: {
                 printf("\n=== Ask a Question Mode ===\n");
                 printf("Speak your question clearly when recording starts...\n");
-                text_to_speech("Please ask your question");
-                const char* recognized_text = speech_to_text();
+                speak_text(sink, "Please ask your question");
+                FlightRecord *record = flight_record_begin(recorder);
+                const char* recognized_text;
+                if (speculation) {
+                    speculation_reset(speculation);
+                    recognized_text = speech_to_text_with_partials(mic.session, speculation_on_partial, speculation);
+                } else {
+                    recognized_text = speech_to_text(mic.session);
+                }
+                if (route_auto) {
+                    recognized_text = route_utterance(&mic, recognized_text);
+                }
+                record_utterance(record, mic.session, recognized_text);
                 if (recognized_text && strlen(recognized_text) > 0) {
                     printf("\nYour question: %s\n", recognized_text);
                     
                     // Try to find a matching answer
-                    const char* answer = find_matching_answer(recognized_text);
-                    if (answer) {
+                    double started = now_ms();
+                    const char *found = find_matching_answer(intents, recognized_text, answer, sizeof(answer));
+                    flight_record_stage(record, "match", now_ms() - started);
+                    flight_record_matches(record, intents, recognized_text);
+
+                    started = now_ms();
+                    if (found) {
                         printf("Found answer! Speaking response...\n");
-                        text_to_speech(answer);
+                        if (!speculation) {
+                            speak_text(sink, answer);
+                        } else if (speculation_speak(speculation, sink, answer)) {
+                            printf("Answer was prepared while you were speaking\n");
+                        }
                     } else {
-                        text_to_speech("I did not get it please ask again");
+                        speak_text(sink, "I did not get it please ask again");
                         printf("Sorry, I don't have an answer for that question.\n");
                         printf("Please try asking something about road safety, traffic rules, or emergency procedures.\n");
                     }
+                    flight_record_stage(record, "tts", now_ms() - started);
                 }
                 else
                 {
-                    text_to_speech("I did not get it please ask again");
+                    speak_text(sink, "I did not get it please ask again");
                 }
+                flight_record_commit(recorder, record);
                 break;
             }
             
             case 2: {
                 printf("\n=== Speech to Text Mode ===\n");
-                const char* recognized_text = speech_to_text();
+                FlightRecord *record = flight_record_begin(recorder);
+                const char* recognized_text = speech_to_text(mic.session);
+                if (route_auto) {
+                    recognized_text = route_utterance(&mic, recognized_text);
+                }
+                record_utterance(record, mic.session, recognized_text);
+                flight_record_commit(recorder, record);
                 if (recognized_text && strlen(recognized_text) > 0) {
                     printf("\nRecognized text: %s\n", recognized_text);
                 }
@@ -92,15 +638,21 @@ int main(void) {
                         text_input[len-1] = '\0';
                     }
                     if (strlen(text_input) > 0) {
-                        text_to_speech(text_input);
+                        speak_text(sink, text_input);
                     }
                 }
                 break;
                 
             case 4:
                 printf("\nExiting program. Goodbye!\n");
-                cleanup_vosk_model();
-                cleanup_intent_processor();
+                stop_flight_recorder(recorder);
+                destroy_speculation(speculation);
+                destroy_speech_session(mic.session);
+                destroy_audio_source(mic.source);
+                destroy_audio_sink(sink);
+                cleanup_intent_processor(intents);
+                release_model(models, mic.model);
+                destroy_model_manager(models);
                 return 0;
                 
             default:
@@ -110,7 +662,12 @@ int main(void) {
         
         // printf("\nPress Enter to continue...");
         // getchar();
-        sleep(2);
+        if (mic.source->finished) {
+            printf("\nAudio input has ended.\n");
+            choice = 4;
+            continue;
+        }
+        sleep_ms(config.turn_pause_ms);
     }
 
     return 0;
@@ -0,0 +1,516 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../../include/flight_recorder.h"
+
+#define LOG_MODULE LOG_MODULE_RECORDER
+#include "../../include/log.h"
+
+#define ADPCM_BLOCK_ALIGN 256
+#define ADPCM_SAMPLES_PER_BLOCK ((ADPCM_BLOCK_ALIGN - 4) * 2 + 1)   // 505
+#define MANIFEST_ROTATED_FILE "manifest.1.jsonl"
+
+struct FlightRecord {
+    FlightRecord *next;             // Free list or write queue link
+    int16_t *audio;                 // BUFFER_SIZE samples, allocated once
+    size_t samples;
+    char transcript[MAX_TEXT_LENGTH];
+    struct {
+        char intent[MAX_INTENT_LENGTH];
+        size_t index;
+        float similarity;
+        bool exact;
+    } matches[FLIGHT_MAX_MATCHES];
+    size_t match_count;
+    struct {
+        char name[16];
+        double ms;
+    } stages[FLIGHT_MAX_STAGES];
+    size_t stage_count;
+    time_t started;                 // Wall-clock time of flight_record_begin
+};
+
+// A turn file on disk, oldest first
+typedef struct {
+    unsigned long seq;
+    size_t bytes;
+} TurnFile;
+
+struct FlightRecorder {
+    char dir[512];
+    size_t max_bytes;
+    FlightRecord slots[FLIGHT_RECORDER_SLOTS];
+
+    // Guarded by lock
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    FlightRecord *free_list;
+    FlightRecord *queue_head;
+    FlightRecord *queue_tail;
+    bool stopping;
+    unsigned long dropped;          // Turns not recorded because no slot was free
+    pthread_t thread;
+
+    // Writer thread only
+    unsigned long next_seq;
+    TurnFile *files;
+    size_t file_count;
+    size_t file_capacity;
+    size_t turn_bytes;              // Sum of files[].bytes
+    size_t manifest_bytes;
+    size_t rotated_bytes;
+    uint8_t *encoded;               // Scratch for one turn of ADPCM
+};
+
+// IMA ADPCM (WAV format 0x0011) tables
+static const int16_t ima_steps[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+    11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+    32767
+};
+static const int8_t ima_index_adjust[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+static uint8_t ima_encode_sample(int sample, int *predictor, int *index) {
+    int step = ima_steps[*index];
+    int diff = sample - *predictor;
+    uint8_t nibble = 0;
+    if (diff < 0) {
+        nibble = 8;
+        diff = -diff;
+    }
+
+    int delta = step >> 3;
+    if (diff >= step) { nibble |= 4; diff -= step; delta += step; }
+    step >>= 1;
+    if (diff >= step) { nibble |= 2; diff -= step; delta += step; }
+    step >>= 1;
+    if (diff >= step) { nibble |= 1; delta += step; }
+
+    *predictor += (nibble & 8) ? -delta : delta;
+    if (*predictor > 32767) *predictor = 32767;
+    if (*predictor < -32768) *predictor = -32768;
+    *index += ima_index_adjust[nibble];
+    if (*index < 0) *index = 0;
+    if (*index > 88) *index = 88;
+    return nibble;
+}
+
+// Encode mono samples into whole ADPCM blocks; returns bytes written
+static size_t ima_encode(const int16_t *samples, size_t count, uint8_t *out) {
+    size_t written = 0;
+    int index = 0;
+
+    for (size_t start = 0; start < count; start += ADPCM_SAMPLES_PER_BLOCK) {
+        uint8_t *block = out + written;
+        int predictor = samples[start];
+
+        // Block header: first sample verbatim, then the step index
+        block[0] = predictor & 0xff;
+        block[1] = (predictor >> 8) & 0xff;
+        block[2] = (uint8_t)index;
+        block[3] = 0;
+
+        // The last block is padded by repeating the final sample
+        for (size_t i = 1; i < ADPCM_SAMPLES_PER_BLOCK; i += 2) {
+            size_t a = start + i < count ? start + i : count - 1;
+            size_t b = start + i + 1 < count ? start + i + 1 : count - 1;
+            uint8_t low = ima_encode_sample(samples[a], &predictor, &index);
+            uint8_t high = ima_encode_sample(samples[b], &predictor, &index);
+            block[4 + (i - 1) / 2] = low | (high << 4);
+        }
+        written += ADPCM_BLOCK_ALIGN;
+    }
+    return written;
+}
+
+static void put_le16(uint8_t *p, uint16_t v) {
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+}
+
+static void put_le32(uint8_t *p, uint32_t v) {
+    put_le16(p, v & 0xffff);
+    put_le16(p + 2, v >> 16);
+}
+
+// Write an IMA ADPCM WAV file; returns its size, or 0 on failure
+static size_t write_adpcm_wav(const char *path, const uint8_t *data, size_t data_bytes, size_t samples) {
+    uint8_t header[60];
+    memcpy(header, "RIFF", 4);
+    put_le32(header + 4, (uint32_t)(sizeof(header) - 8 + data_bytes));
+    memcpy(header + 8, "WAVEfmt ", 8);
+    put_le32(header + 16, 20);
+    put_le16(header + 20, 0x0011);                          // IMA ADPCM
+    put_le16(header + 22, 1);                               // Mono
+    put_le32(header + 24, SAMPLE_RATE);
+    put_le32(header + 28, SAMPLE_RATE * ADPCM_BLOCK_ALIGN / ADPCM_SAMPLES_PER_BLOCK);
+    put_le16(header + 32, ADPCM_BLOCK_ALIGN);
+    put_le16(header + 34, 4);                               // Bits per sample
+    put_le16(header + 36, 2);                               // Extra format bytes
+    put_le16(header + 38, ADPCM_SAMPLES_PER_BLOCK);
+    memcpy(header + 40, "fact", 4);
+    put_le32(header + 44, 4);
+    put_le32(header + 48, (uint32_t)samples);
+    memcpy(header + 52, "data", 4);
+    put_le32(header + 56, (uint32_t)data_bytes);
+
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        return 0;
+    }
+    bool ok = fwrite(header, 1, sizeof(header), file) == sizeof(header) &&
+              fwrite(data, 1, data_bytes, file) == data_bytes;
+    if (fclose(file) != 0 || !ok) {
+        unlink(path);
+        return 0;
+    }
+    return sizeof(header) + data_bytes;
+}
+
+// Append text as a JSON string literal
+static void write_json_string(FILE *out, const char *text) {
+    fputc('"', out);
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(out, "\\%c", *p);
+        } else if (*p < 0x20) {
+            fprintf(out, "\\u%04x", *p);
+        } else {
+            fputc(*p, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static size_t file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+static void turn_path(const FlightRecorder *recorder, unsigned long seq, char *path, size_t size) {
+    snprintf(path, size, "%s/turn-%08lu.wav", recorder->dir, seq);
+}
+
+static int compare_turn_files(const void *a, const void *b) {
+    unsigned long x = ((const TurnFile *)a)->seq, y = ((const TurnFile *)b)->seq;
+    return (x > y) - (x < y);
+}
+
+static bool track_turn_file(FlightRecorder *recorder, unsigned long seq, size_t bytes) {
+    if (recorder->file_count == recorder->file_capacity) {
+        size_t capacity = recorder->file_capacity ? recorder->file_capacity * 2 : 64;
+        TurnFile *grown = realloc(recorder->files, sizeof(TurnFile) * capacity);
+        if (!grown) return false;
+        recorder->files = grown;
+        recorder->file_capacity = capacity;
+    }
+    recorder->files[recorder->file_count].seq = seq;
+    recorder->files[recorder->file_count].bytes = bytes;
+    recorder->file_count++;
+    recorder->turn_bytes += bytes;
+    return true;
+}
+
+// Pick up turns left by a previous run so the size cap covers them too
+static void scan_existing_turns(FlightRecorder *recorder) {
+    char path[1024];
+    DIR *dir = opendir(recorder->dir);
+    if (!dir) return;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        unsigned long seq;
+        char suffix[8];
+        if (sscanf(entry->d_name, "turn-%lu.%7s", &seq, suffix) == 2 && strcmp(suffix, "wav") == 0) {
+            turn_path(recorder, seq, path, sizeof(path));
+            track_turn_file(recorder, seq, file_size(path));
+            if (seq >= recorder->next_seq) {
+                recorder->next_seq = seq + 1;
+            }
+        }
+    }
+    closedir(dir);
+    qsort(recorder->files, recorder->file_count, sizeof(TurnFile), compare_turn_files);
+
+    snprintf(path, sizeof(path), "%s/%s", recorder->dir, FLIGHT_MANIFEST_FILE);
+    recorder->manifest_bytes = file_size(path);
+    snprintf(path, sizeof(path), "%s/%s", recorder->dir, MANIFEST_ROTATED_FILE);
+    recorder->rotated_bytes = file_size(path);
+}
+
+// Rotate the manifest and delete the oldest turns until under the size cap
+static void enforce_size_cap(FlightRecorder *recorder) {
+    char path[1024], rotated[1024];
+
+    if (recorder->manifest_bytes > recorder->max_bytes / 16) {
+        snprintf(path, sizeof(path), "%s/%s", recorder->dir, FLIGHT_MANIFEST_FILE);
+        snprintf(rotated, sizeof(rotated), "%s/%s", recorder->dir, MANIFEST_ROTATED_FILE);
+        if (rename(path, rotated) == 0) {
+            recorder->rotated_bytes = recorder->manifest_bytes;
+            recorder->manifest_bytes = 0;
+        }
+    }
+
+    size_t removed = 0;
+    while (removed + 1 < recorder->file_count &&
+           recorder->turn_bytes + recorder->manifest_bytes + recorder->rotated_bytes > recorder->max_bytes) {
+        turn_path(recorder, recorder->files[removed].seq, path, sizeof(path));
+        unlink(path);
+        recorder->turn_bytes -= recorder->files[removed].bytes;
+        removed++;
+    }
+    if (removed > 0) {
+        memmove(recorder->files, recorder->files + removed,
+                sizeof(TurnFile) * (recorder->file_count - removed));
+        recorder->file_count -= removed;
+    }
+}
+
+static void write_record(FlightRecorder *recorder, const FlightRecord *record) {
+    char path[1024], wav_name[64] = "";
+    unsigned long seq = recorder->next_seq++;
+
+    if (record->samples > 0) {
+        size_t data_bytes = ima_encode(record->audio, record->samples, recorder->encoded);
+        turn_path(recorder, seq, path, sizeof(path));
+        size_t bytes = write_adpcm_wav(path, recorder->encoded, data_bytes, record->samples);
+        if (bytes > 0 && track_turn_file(recorder, seq, bytes)) {
+            snprintf(wav_name, sizeof(wav_name), "turn-%08lu.wav", seq);
+        } else if (bytes == 0) {
+            log_error("Flight recorder cannot write %s: %s", path, strerror(errno));
+        }
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", recorder->dir, FLIGHT_MANIFEST_FILE);
+    FILE *manifest = fopen(path, "a");
+    if (!manifest) {
+        log_error("Flight recorder cannot write %s: %s", path, strerror(errno));
+        return;
+    }
+
+    char time_text[32];
+    struct tm utc;
+    gmtime_r(&record->started, &utc);
+    strftime(time_text, sizeof(time_text), "%Y-%m-%dT%H:%M:%SZ", &utc);
+
+    long start = ftell(manifest);
+    fprintf(manifest, "{\"seq\":%lu,\"time\":\"%s\",\"wav\":", seq, time_text);
+    if (wav_name[0]) {
+        write_json_string(manifest, wav_name);
+    } else {
+        fputs("null", manifest);
+    }
+    fprintf(manifest, ",\"samples\":%zu,\"sample_rate\":%d,\"transcript\":", record->samples, SAMPLE_RATE);
+    write_json_string(manifest, record->transcript);
+    fputs(",\"matches\":[", manifest);
+    for (size_t i = 0; i < record->match_count; i++) {
+        fprintf(manifest, "%s{\"intent\":", i > 0 ? "," : "");
+        write_json_string(manifest, record->matches[i].intent);
+        fprintf(manifest, ",\"row\":%zu,\"score\":%.4f,\"exact\":%s}", record->matches[i].index,
+                record->matches[i].similarity, record->matches[i].exact ? "true" : "false");
+    }
+    fputs("],\"stages_ms\":{", manifest);
+    for (size_t i = 0; i < record->stage_count; i++) {
+        fprintf(manifest, "%s", i > 0 ? "," : "");
+        write_json_string(manifest, record->stages[i].name);
+        fprintf(manifest, ":%.2f", record->stages[i].ms);
+    }
+    fputs("}}\n", manifest);
+    long end = ftell(manifest);
+    fclose(manifest);
+    if (start >= 0 && end > start) {
+        recorder->manifest_bytes += (size_t)(end - start);
+    }
+
+    enforce_size_cap(recorder);
+}
+
+static void release_record(FlightRecorder *recorder, FlightRecord *record) {
+    pthread_mutex_lock(&recorder->lock);
+    record->next = recorder->free_list;
+    recorder->free_list = record;
+    pthread_mutex_unlock(&recorder->lock);
+}
+
+static void *flight_writer_main(void *arg) {
+    FlightRecorder *recorder = arg;
+
+    pthread_mutex_lock(&recorder->lock);
+    for (;;) {
+        while (!recorder->queue_head && !recorder->stopping) {
+            pthread_cond_wait(&recorder->wake, &recorder->lock);
+        }
+        FlightRecord *record = recorder->queue_head;
+        if (!record) {
+            break;      // Stopping with nothing left to write
+        }
+        recorder->queue_head = record->next;
+        if (!recorder->queue_head) {
+            recorder->queue_tail = NULL;
+        }
+        pthread_mutex_unlock(&recorder->lock);
+
+        write_record(recorder, record);
+        release_record(recorder, record);
+
+        pthread_mutex_lock(&recorder->lock);
+    }
+    pthread_mutex_unlock(&recorder->lock);
+    return NULL;
+}
+
+FlightRecorder *start_flight_recorder(const char *dir, size_t max_bytes) {
+    if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+        log_error("Cannot create flight recorder directory %s: %s", dir, strerror(errno));
+        return NULL;
+    }
+
+    FlightRecorder *recorder = calloc(1, sizeof(FlightRecorder));
+    if (!recorder) {
+        return NULL;
+    }
+    snprintf(recorder->dir, sizeof(recorder->dir), "%s", dir);
+    recorder->max_bytes = max_bytes;
+    pthread_mutex_init(&recorder->lock, NULL);
+    pthread_cond_init(&recorder->wake, NULL);
+
+    // Every buffer is allocated up front so recording a turn never allocates
+    size_t blocks = (BUFFER_SIZE + ADPCM_SAMPLES_PER_BLOCK - 1) / ADPCM_SAMPLES_PER_BLOCK;
+    recorder->encoded = malloc(blocks * ADPCM_BLOCK_ALIGN);
+    bool ok = recorder->encoded != NULL;
+    for (int i = 0; ok && i < FLIGHT_RECORDER_SLOTS; i++) {
+        recorder->slots[i].audio = malloc(BUFFER_SIZE * sizeof(int16_t));
+        ok = recorder->slots[i].audio != NULL;
+        recorder->slots[i].next = recorder->free_list;
+        recorder->free_list = &recorder->slots[i];
+    }
+    if (ok) {
+        scan_existing_turns(recorder);
+        enforce_size_cap(recorder);
+        ok = pthread_create(&recorder->thread, NULL, flight_writer_main, recorder) == 0;
+    }
+    if (!ok) {
+        log_error("Cannot start flight recorder");
+        for (int i = 0; i < FLIGHT_RECORDER_SLOTS; i++) {
+            free(recorder->slots[i].audio);
+        }
+        free(recorder->encoded);
+        free(recorder->files);
+        free(recorder);
+        return NULL;
+    }
+
+    log_info("Flight recorder writing to %s (%zu turns kept, cap %zu MB)",
+             dir, recorder->file_count, max_bytes >> 20);
+    return recorder;
+}
+
+void stop_flight_recorder(FlightRecorder *recorder) {
+    if (!recorder) return;
+
+    pthread_mutex_lock(&recorder->lock);
+    recorder->stopping = true;
+    pthread_cond_signal(&recorder->wake);
+    pthread_mutex_unlock(&recorder->lock);
+    pthread_join(recorder->thread, NULL);
+
+    if (recorder->dropped > 0) {
+        log_warn("Flight recorder dropped %lu turns", recorder->dropped);
+    }
+    for (int i = 0; i < FLIGHT_RECORDER_SLOTS; i++) {
+        free(recorder->slots[i].audio);
+    }
+    pthread_mutex_destroy(&recorder->lock);
+    pthread_cond_destroy(&recorder->wake);
+    free(recorder->encoded);
+    free(recorder->files);
+    free(recorder);
+}
+
+FlightRecord *flight_record_begin(FlightRecorder *recorder) {
+    if (!recorder) return NULL;
+
+    pthread_mutex_lock(&recorder->lock);
+    FlightRecord *record = recorder->free_list;
+    if (record) {
+        recorder->free_list = record->next;
+    } else {
+        recorder->dropped++;
+    }
+    pthread_mutex_unlock(&recorder->lock);
+
+    if (record) {
+        record->next = NULL;
+        record->samples = 0;
+        record->transcript[0] = '\0';
+        record->match_count = 0;
+        record->stage_count = 0;
+        record->started = time(NULL);
+    }
+    return record;
+}
+
+void flight_record_audio(FlightRecord *record, const int16_t *samples, size_t count) {
+    if (!record || !samples) return;
+    record->samples = count < BUFFER_SIZE ? count : BUFFER_SIZE;
+    memcpy(record->audio, samples, record->samples * sizeof(int16_t));
+}
+
+void flight_record_transcript(FlightRecord *record, const char *text) {
+    if (!record) return;
+    snprintf(record->transcript, sizeof(record->transcript), "%s", text ? text : "");
+}
+
+void flight_record_matches(FlightRecord *record, IntentProcessor *intents, const char *text) {
+    IntentMatch matches[FLIGHT_MAX_MATCHES];
+    if (!record || !intents || !text) return;
+
+    unsigned int token = intent_read_lock(intents);
+    record->match_count = find_top_matches(intents, text, matches, FLIGHT_MAX_MATCHES);
+    for (size_t i = 0; i < record->match_count; i++) {
+        snprintf(record->matches[i].intent, sizeof(record->matches[i].intent), "%s", matches[i].entry->intent);
+        record->matches[i].index = matches[i].index;
+        record->matches[i].similarity = matches[i].similarity;
+        record->matches[i].exact = matches[i].exact;
+    }
+    intent_read_unlock(intents, token);
+}
+
+void flight_record_stage(FlightRecord *record, const char *name, double ms) {
+    if (!record || record->stage_count >= FLIGHT_MAX_STAGES) return;
+    snprintf(record->stages[record->stage_count].name, sizeof(record->stages[0].name), "%s", name);
+    record->stages[record->stage_count].ms = ms;
+    record->stage_count++;
+}
+
+void flight_record_commit(FlightRecorder *recorder, FlightRecord *record) {
+    if (!recorder || !record) return;
+
+    pthread_mutex_lock(&recorder->lock);
+    if (recorder->queue_tail) {
+        recorder->queue_tail->next = record;
+    } else {
+        recorder->queue_head = record;
+    }
+    recorder->queue_tail = record;
+    pthread_cond_signal(&recorder->wake);
+    pthread_mutex_unlock(&recorder->lock);
+}
+
+void flight_record_discard(FlightRecorder *recorder, FlightRecord *record) {
+    if (!recorder || !record) return;
+    release_record(recorder, record);
+}
@@ -0,0 +1,419 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "../../include/service.h"
+#include "../../include/speech_processor.h"
+#include "../../include/intent_processor.h"
+#include "../../include/model_manager.h"
+#include "../../include/memory_accounting.h"
+
+#define LOG_MODULE LOG_MODULE_SERVICE
+#include "../../include/log.h"
+
+// Festival drives the one sound card, so speak one request at a time
+static pthread_mutex_t g_tts_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Shared by the accept loop and every client
+typedef struct {
+    int listen_fd;
+    ModelManager *models;
+    IntentProcessor *intents;
+} ServiceContext;
+
+// Per-connection state
+typedef struct {
+    const ServiceContext *context;
+    int fd;
+    uint8_t *payload;
+    size_t payload_capacity;
+    uint8_t *reply;
+    size_t reply_capacity;
+    SpeechSession *session;                // Created on the first audio stream
+    SpeechModel *model;                    // Model of session, acquired from the manager
+    char language[MODEL_LANGUAGE_LENGTH];  // Language requested for session
+    bool streaming;                        // An audio stream is open
+    char transcript[MAX_TEXT_LENGTH * 4];  // Finalized segments of the stream
+    char partial[MAX_TEXT_LENGTH * 5 + 2]; // Last transcript + partial sent to the client
+} ServiceClient;
+
+static void put_u16(uint8_t *p, uint16_t v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+}
+
+static void put_u32(uint8_t *p, uint32_t v) {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = (v >> 24) & 0xff;
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static int read_full(int fd, void *buf, size_t len) {
+    uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int write_full(int fd, const void *buf, size_t len) {
+    const uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int send_message(ServiceClient *client, uint8_t type, const void *payload, size_t len) {
+    uint8_t header[5];
+    put_u32(header, (uint32_t)len);
+    header[4] = type;
+    if (write_full(client->fd, header, sizeof(header)) < 0) return -1;
+    return len > 0 ? write_full(client->fd, payload, len) : 0;
+}
+
+static int send_text(ServiceClient *client, uint8_t type, const char *text) {
+    return send_message(client, type, text, strlen(text));
+}
+
+static bool ensure_capacity(uint8_t **buf, size_t *capacity, size_t needed) {
+    if (needed <= *capacity) return true;
+    uint8_t *grown = realloc(*buf, needed);
+    if (!grown) return false;
+    *buf = grown;
+    *capacity = needed;
+    return true;
+}
+
+// Copy a length-delimited payload into a NUL-terminated string
+static void payload_to_text(const uint8_t *payload, size_t len, char *out, size_t out_size) {
+    size_t n = len < out_size - 1 ? len : out_size - 1;
+    memcpy(out, payload, n);
+    out[n] = '\0';
+}
+
+static int handle_intent_query(ServiceClient *client, const uint8_t *payload, size_t len) {
+    char text[MAX_TEXT_LENGTH];
+    IntentMatch matches[SERVICE_MAX_TOP_K];
+
+    if (len < 1) {
+        return send_text(client, MSG_ERROR, "intent query needs k and text");
+    }
+
+    size_t k = payload[0];
+    if (k == 0 || k > SERVICE_MAX_TOP_K) k = SERVICE_MAX_TOP_K;
+    payload_to_text(payload + 1, len - 1, text, sizeof(text));
+
+    // Keep the matched entries alive while the reply is built
+    IntentProcessor *intents = client->context->intents;
+    unsigned int token = intent_read_lock(intents);
+    size_t count = find_top_matches(intents, text, matches, k);
+
+    // Size the reply: count byte plus per-match fixed fields and strings
+    size_t needed = 1;
+    for (size_t i = 0; i < count; i++) {
+        needed += 4 + 4 + 3 * 2 + strlen(matches[i].entry->intent) +
+                  strlen(matches[i].entry->question) + strlen(matches[i].entry->answer);
+    }
+    if (!ensure_capacity(&client->reply, &client->reply_capacity, needed)) {
+        intent_read_unlock(intents, token);
+        return send_text(client, MSG_ERROR, "out of memory");
+    }
+
+    uint8_t *p = client->reply;
+    *p++ = (uint8_t)count;
+    for (size_t i = 0; i < count; i++) {
+        const char *fields[3] = {
+            matches[i].entry->intent, matches[i].entry->question, matches[i].entry->answer
+        };
+        uint32_t bits;
+        memcpy(&bits, &matches[i].similarity, sizeof(bits));
+        put_u32(p, bits);
+        put_u32(p + 4, (uint32_t)matches[i].index);
+        p += 8;
+        for (int f = 0; f < 3; f++) {
+            size_t flen = strlen(fields[f]);
+            put_u16(p, (uint16_t)flen);
+            memcpy(p + 2, fields[f], flen);
+            p += 2 + flen;
+        }
+    }
+    intent_read_unlock(intents, token);
+
+    return send_message(client, MSG_INTENT_RESULT, client->reply, p - client->reply);
+}
+
+// Append a finalized segment to the stream transcript
+static void append_segment(ServiceClient *client, const char *segment) {
+    if (segment[0] == '\0') return;
+
+    size_t used = strlen(client->transcript);
+    snprintf(client->transcript + used, sizeof(client->transcript) - used,
+             "%s%s", used > 0 ? " " : "", segment);
+}
+
+static void release_session(ServiceClient *client) {
+    destroy_speech_session(client->session);
+    release_model(client->context->models, client->model);
+    client->session = NULL;
+    client->model = NULL;
+}
+
+static int handle_audio_begin(ServiceClient *client, const uint8_t *payload, size_t len) {
+    if (len < 4 || get_u32(payload) != SAMPLE_RATE) {
+        char message[64];
+        snprintf(message, sizeof(message), "audio must be %d Hz s16le mono", SAMPLE_RATE);
+        return send_text(client, MSG_ERROR, message);
+    }
+
+    // The session is kept across streams unless the language changes
+    char language[MODEL_LANGUAGE_LENGTH];
+    payload_to_text(payload + 4, len - 4, language, sizeof(language));
+    if (language[0] == '\0') {
+        snprintf(language, sizeof(language), "%s", MODEL_DEFAULT_LANGUAGE);
+    }
+    if (client->session && strcmp(language, client->language) != 0) {
+        release_session(client);
+    }
+    if (!client->session) {
+        if (!has_language(client->context->models, language)) {
+            return send_text(client, MSG_ERROR, "no speech model for that language");
+        }
+        const char *actual;
+        client->model = acquire_model(client->context->models, language, &actual);
+        if (!client->model) {
+            return send_text(client, MSG_ERROR, "speech model does not fit in the memory budget");
+        }
+        client->session = create_speech_session(client->model);
+        if (!client->session) {
+            release_session(client);
+            return send_text(client, MSG_ERROR, "could not create recognizer");
+        }
+        // A substitute model is reported in the reply below
+        snprintf(client->language, sizeof(client->language), "%s", actual);
+    }
+    reset_speech_session(client->session);
+    client->streaming = true;
+    client->transcript[0] = '\0';
+    client->partial[0] = '\0';
+    return send_text(client, MSG_OK, client->language);
+}
+
+static int handle_audio_data(ServiceClient *client, const uint8_t *payload, size_t len) {
+    char combined[sizeof(client->partial)];
+    const char *partial = "";
+
+    if (!client->streaming) {
+        return send_text(client, MSG_ERROR, "no audio stream open");
+    }
+
+    // Payload bytes are s16le; the buffer comes from malloc, so it is aligned.
+    // A stray byte would shift every later sample, so refuse it.
+    if (len % sizeof(int16_t) != 0) {
+        return send_text(client, MSG_ERROR, "audio data must be whole 16-bit samples");
+    }
+    if (speech_session_accept(client->session, (const int16_t *)payload, len / sizeof(int16_t))) {
+        append_segment(client, speech_session_result(client->session));
+    } else {
+        partial = speech_session_partial(client->session);
+    }
+
+    snprintf(combined, sizeof(combined), "%s%s%s", client->transcript,
+             client->transcript[0] && partial[0] ? " " : "", partial);
+    if (strcmp(combined, client->partial) == 0) {
+        return 0;
+    }
+    memcpy(client->partial, combined, sizeof(client->partial));
+    return send_text(client, MSG_PARTIAL, combined);
+}
+
+static int handle_audio_end(ServiceClient *client) {
+    if (!client->streaming) {
+        return send_text(client, MSG_ERROR, "no audio stream open");
+    }
+
+    append_segment(client, speech_session_final(client->session));
+    client->streaming = false;
+    return send_text(client, MSG_TRANSCRIPT, client->transcript);
+}
+
+static int handle_tts(ServiceClient *client, const uint8_t *payload, size_t len) {
+    char text[MAX_TEXT_LENGTH];
+    payload_to_text(payload, len, text, sizeof(text));
+
+    pthread_mutex_lock(&g_tts_lock);
+    text_to_speech(text);
+    pthread_mutex_unlock(&g_tts_lock);
+
+    return send_message(client, MSG_OK, NULL, 0);
+}
+
+static int handle_memory_query(ServiceClient *client) {
+    char report[MEMORY_REPORT_LENGTH];
+    format_memory_report(report, sizeof(report));
+    return send_text(client, MSG_MEMORY_REPORT, report);
+}
+
+static void *client_thread_main(void *arg) {
+    ServiceClient *client = arg;
+    uint8_t header[5];
+
+    while (read_full(client->fd, header, sizeof(header)) == 0) {
+        uint32_t len = get_u32(header);
+        uint8_t type = header[4];
+        int rc;
+
+        if (len > SERVICE_MAX_PAYLOAD ||
+            !ensure_capacity(&client->payload, &client->payload_capacity, len + 1) ||
+            read_full(client->fd, client->payload, len) < 0) {
+            break;
+        }
+
+        switch (type) {
+            case MSG_INTENT_QUERY: rc = handle_intent_query(client, client->payload, len); break;
+            case MSG_AUDIO_BEGIN:  rc = handle_audio_begin(client, client->payload, len); break;
+            case MSG_AUDIO_DATA:   rc = handle_audio_data(client, client->payload, len); break;
+            case MSG_AUDIO_END:    rc = handle_audio_end(client); break;
+            case MSG_TTS:          rc = handle_tts(client, client->payload, len); break;
+            case MSG_MEMORY_QUERY: rc = handle_memory_query(client); break;
+            default:               rc = send_text(client, MSG_ERROR, "unknown message type"); break;
+        }
+        if (rc < 0) {
+            break;
+        }
+    }
+
+    release_session(client);
+    close(client->fd);
+    free(client->payload);
+    free(client->reply);
+    free(client);
+    return NULL;
+}
+
+static int open_listening_socket(const char *socket_path) {
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        log_error("Cannot create service socket: %s", strerror(errno));
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        log_error("Service socket path too long: %s", socket_path);
+        close(fd);
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    // Replace a socket left by an earlier run, but nothing else
+    struct stat existing;
+    if (lstat(socket_path, &existing) == 0 && S_ISSOCK(existing.st_mode)) {
+        unlink(socket_path);
+    }
+
+    // Create the socket with its final mode, so it is never more open
+    mode_t saved_umask = umask(0777 & ~VAANI_SOCKET_MODE);
+    int bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(saved_umask);
+    if (bound < 0 || listen(fd, SERVICE_BACKLOG) < 0) {
+        log_error("Cannot listen on %s: %s", socket_path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    log_info("Service listening on %s", socket_path);
+    return fd;
+}
+
+static int serve(ServiceContext *context) {
+    for (;;) {
+        int fd = accept4(context->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            log_warn("Service accept failed: %s", strerror(errno));
+            close(context->listen_fd);
+            free(context);
+            return -1;
+        }
+
+        ServiceClient *client = calloc(1, sizeof(ServiceClient));
+        pthread_t thread;
+        if (!client) {
+            close(fd);
+            continue;
+        }
+        client->context = context;
+        client->fd = fd;
+        if (pthread_create(&thread, NULL, client_thread_main, client) != 0) {
+            close(fd);
+            free(client);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+}
+
+static void *service_thread_main(void *arg) {
+    serve(arg);
+    return NULL;
+}
+
+static ServiceContext *open_service(const char *socket_path, ModelManager *models, IntentProcessor *intents) {
+    ServiceContext *context = calloc(1, sizeof(ServiceContext));
+    if (!context) {
+        return NULL;
+    }
+    context->models = models;
+    context->intents = intents;
+    context->listen_fd = open_listening_socket(socket_path);
+    if (context->listen_fd < 0) {
+        free(context);
+        return NULL;
+    }
+    return context;
+}
+
+int start_service(const char *socket_path, ModelManager *models, IntentProcessor *intents) {
+    ServiceContext *context = open_service(socket_path, models, intents);
+    pthread_t thread;
+
+    if (!context) {
+        return -1;
+    }
+    if (pthread_create(&thread, NULL, service_thread_main, context) != 0) {
+        close(context->listen_fd);
+        free(context);
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
+
+int run_service(const char *socket_path, ModelManager *models, IntentProcessor *intents) {
+    ServiceContext *context = open_service(socket_path, models, intents);
+    if (!context) {
+        return -1;
+    }
+    return serve(context);
+}
@@ -0,0 +1,348 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <strings.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../../include/batch_transcriber.h"
+#include "../../include/wav_reader.h"
+
+#define LOG_MODULE LOG_MODULE_BATCH
+#include "../../include/log.h"
+
+typedef struct {
+    char **paths;
+    size_t count;
+    size_t capacity;
+} PathList;
+
+typedef struct {
+    bool ok;                            // File was read and decoded
+    double audio_s;
+    double process_ms;
+    float confidence;                   // Mean word confidence
+    char transcript[MAX_TEXT_LENGTH];
+    bool answered;                      // find_matching_answer would answer
+    size_t match_count;
+    struct {
+        char intent[MAX_INTENT_LENGTH];
+        size_t row;
+        float similarity;
+        bool exact;
+    } matches[BATCH_MATCHES];
+} BatchResult;
+
+typedef struct {
+    SpeechModel *model;
+    IntentProcessor *intents;
+    PathList files;
+    _Atomic size_t next;                // Next file to hand to a worker
+
+    // Results are written in input order as they complete
+    pthread_mutex_t lock;
+    BatchResult **results;              // Finished results not yet written
+    size_t next_write;
+    BatchResult failed;                 // Stands in for a result that could not be allocated
+    FILE *out;
+    bool jsonl;
+    size_t failures;
+    double audio_s;
+} BatchJob;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static bool add_path(PathList *list, const char *path) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 256;
+        char **grown = realloc(list->paths, sizeof(char *) * capacity);
+        if (!grown) return false;
+        list->paths = grown;
+        list->capacity = capacity;
+    }
+    if (!(list->paths[list->count] = strdup(path))) {
+        return false;
+    }
+    list->count++;
+    return true;
+}
+
+static void free_paths(PathList *list) {
+    for (size_t i = 0; i < list->count; i++) {
+        free(list->paths[i]);
+    }
+    free(list->paths);
+}
+
+static bool has_suffix(const char *name, const char *suffix) {
+    size_t length = strlen(name), suffix_length = strlen(suffix);
+    return length >= suffix_length && strcasecmp(name + length - suffix_length, suffix) == 0;
+}
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static bool collect_directory(const char *dir_path, PathList *list) {
+    char path[1024];
+    DIR *dir = opendir(dir_path);
+    if (!dir) return false;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] != '.' && has_suffix(entry->d_name, ".wav")) {
+            snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
+            add_path(list, path);
+        }
+    }
+    closedir(dir);
+    qsort(list->paths, list->count, sizeof(char *), compare_paths);
+    return true;
+}
+
+// One path per line (blank lines and # comments skipped), or for a flight
+// recorder manifest the "wav" of every turn, relative to the manifest
+static bool collect_listed(const char *list_path, bool manifest, PathList *list) {
+    char line[4096], path[1024], dir[512] = ".";
+    FILE *file = fopen(list_path, "r");
+    if (!file) return false;
+
+    const char *slash = strrchr(list_path, '/');
+    if (slash) {
+        snprintf(dir, sizeof(dir), "%.*s", (int)(slash - list_path), list_path);
+    }
+
+    while (fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (manifest) {
+            const char *wav = strstr(line, "\"wav\":\"");
+            if (!wav) continue;     // Turn without audio
+            wav += 7;
+            snprintf(path, sizeof(path), "%s/%.*s", dir, (int)strcspn(wav, "\""), wav);
+            add_path(list, path);
+        } else if (line[0] != '\0' && line[0] != '#') {
+            add_path(list, line);
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+static bool collect_inputs(const char *input, PathList *list) {
+    struct stat st;
+    if (stat(input, &st) != 0) {
+        return false;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        return collect_directory(input, list);
+    }
+    if (has_suffix(input, ".wav")) {
+        return add_path(list, input);
+    }
+    return collect_listed(input, has_suffix(input, ".jsonl"), list);
+}
+
+static void process_file(BatchJob *job, SpeechSession *session, const char *path, BatchResult *result) {
+    IntentMatch matches[BATCH_MATCHES];
+    size_t samples;
+
+    double started = now_ms();
+    int16_t *audio = read_wav_file(path, &samples);
+    if (!audio) {
+        return;
+    }
+    const char *text = transcribe_audio(session, audio, samples, &result->confidence);
+    free(audio);
+
+    result->ok = true;
+    result->audio_s = (double)samples / SAMPLE_RATE;
+    snprintf(result->transcript, sizeof(result->transcript), "%s", text ? text : "");
+
+    if (text) {
+        unsigned int token = intent_read_lock(job->intents);
+        result->match_count = find_top_matches(job->intents, text, matches, BATCH_MATCHES);
+        for (size_t i = 0; i < result->match_count; i++) {
+            snprintf(result->matches[i].intent, sizeof(result->matches[i].intent), "%s",
+                     matches[i].entry->intent);
+            result->matches[i].row = matches[i].index;
+            result->matches[i].similarity = matches[i].similarity;
+            result->matches[i].exact = matches[i].exact;
+        }
+        result->answered = result->match_count > 0 && intent_match_accepted(job->intents, &matches[0]);
+        intent_read_unlock(job->intents, token);
+    }
+    result->process_ms = now_ms() - started;
+}
+
+static void write_csv_field(FILE *out, const char *text) {
+    if (strpbrk(text, ",\"\r\n") == NULL) {
+        fputs(text, out);
+        return;
+    }
+    fputc('"', out);
+    for (const char *p = text; *p; p++) {
+        if (*p == '"') fputc('"', out);
+        fputc(*p, out);
+    }
+    fputc('"', out);
+}
+
+static void write_json_string(FILE *out, const char *text) {
+    fputc('"', out);
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(out, "\\%c", *p);
+        } else if (*p < 0x20) {
+            fprintf(out, "\\u%04x", *p);
+        } else {
+            fputc(*p, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void write_result(BatchJob *job, const char *path, const BatchResult *result) {
+    FILE *out = job->out;
+
+    if (job->jsonl) {
+        fputs("{\"file\":", out);
+        write_json_string(out, path);
+        fprintf(out, ",\"ok\":%s,\"audio_s\":%.2f,\"process_ms\":%.1f,\"confidence\":%.3f,\"transcript\":",
+                result->ok ? "true" : "false", result->audio_s, result->process_ms, result->confidence);
+        write_json_string(out, result->transcript);
+        fprintf(out, ",\"answered\":%s,\"matches\":[", result->answered ? "true" : "false");
+        for (size_t i = 0; i < result->match_count; i++) {
+            fprintf(out, "%s{\"intent\":", i > 0 ? "," : "");
+            write_json_string(out, result->matches[i].intent);
+            fprintf(out, ",\"row\":%zu,\"similarity\":%.4f,\"exact\":%s}", result->matches[i].row,
+                    result->matches[i].similarity, result->matches[i].exact ? "true" : "false");
+        }
+        fputs("]}\n", out);
+        return;
+    }
+
+    write_csv_field(out, path);
+    fprintf(out, ",%d,%.2f,%.1f,%.3f,", result->ok, result->audio_s, result->process_ms, result->confidence);
+    write_csv_field(out, result->transcript);
+    fputc(',', out);
+    if (result->match_count > 0) {
+        write_csv_field(out, result->matches[0].intent);
+        fprintf(out, ",%zu,%.4f,%d", result->matches[0].row, result->matches[0].similarity,
+                result->matches[0].exact);
+    } else {
+        fputs(",,,", out);
+    }
+    fprintf(out, ",%d\n", result->answered);
+}
+
+// Hand a finished result to the writer and write out every result that is
+// now next in input order
+static void publish_result(BatchJob *job, size_t index, BatchResult *result) {
+    pthread_mutex_lock(&job->lock);
+    job->results[index] = result ? result : &job->failed;
+    while (job->next_write < job->files.count && job->results[job->next_write]) {
+        BatchResult *next = job->results[job->next_write];
+        write_result(job, job->files.paths[job->next_write], next);
+        job->failures += !next->ok;
+        job->audio_s += next->audio_s;
+        if (next != &job->failed) {
+            free(next);
+        }
+        job->results[job->next_write++] = NULL;
+    }
+    pthread_mutex_unlock(&job->lock);
+}
+
+static void *batch_worker(void *arg) {
+    BatchJob *job = arg;
+    SpeechSession *session = create_speech_session(job->model);
+
+    for (;;) {
+        size_t index = atomic_fetch_add(&job->next, 1);
+        if (index >= job->files.count) {
+            break;
+        }
+        BatchResult *result = calloc(1, sizeof(BatchResult));
+        if (result && session) {
+            process_file(job, session, job->files.paths[index], result);
+        }
+        publish_result(job, index, result);
+    }
+
+    destroy_speech_session(session);
+    return NULL;
+}
+
+int run_batch_transcription(SpeechModel *model, IntentProcessor *intents,
+                            const char *input, const char *output, size_t jobs) {
+    BatchJob job = {
+        .model = model,
+        .intents = intents,
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+    };
+    pthread_t workers[BATCH_MAX_JOBS];
+    size_t started = 0;
+    int rc = -1;
+
+    if (!collect_inputs(input, &job.files) || job.files.count == 0) {
+        log_error("No WAV files found in %s", input);
+        free_paths(&job.files);
+        return -1;
+    }
+
+    bool to_stdout = !output || strcmp(output, "-") == 0;
+    job.out = to_stdout ? stdout : fopen(output, "w");
+    job.jsonl = !to_stdout && has_suffix(output, ".jsonl");
+    job.results = calloc(job.files.count, sizeof(BatchResult *));
+    if (!job.out || !job.results) {
+        log_error("Cannot write %s", output);
+        goto cleanup;
+    }
+    if (!job.jsonl) {
+        fputs("file,ok,audio_s,process_ms,confidence,transcript,intent,row,similarity,exact,answered\n", job.out);
+    }
+
+    if (jobs == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = cpus > 0 ? (size_t)cpus : 1;
+    }
+    if (jobs > BATCH_MAX_JOBS) jobs = BATCH_MAX_JOBS;
+    if (jobs > job.files.count) jobs = job.files.count;
+
+    log_info("Transcribing %zu files with %zu workers...", job.files.count, jobs);
+    double begin = now_ms();
+    for (; started < jobs; started++) {
+        if (pthread_create(&workers[started], NULL, batch_worker, &job) != 0) {
+            break;
+        }
+    }
+    if (started == 0) {
+        batch_worker(&job);     // No threads available; do the work here
+    }
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    double elapsed_s = (now_ms() - begin) / 1000.0;
+
+    log_info("Processed %zu files (%zu failed): %.1f s of audio in %.1f s, %.1fx real time",
+             job.files.count, job.failures, job.audio_s, elapsed_s,
+             elapsed_s > 0 ? job.audio_s / elapsed_s : 0.0);
+    rc = job.failures == 0 ? 0 : job.failures < job.files.count ? 1 : -1;
+
+cleanup:
+    if (job.out && !to_stdout) {
+        fclose(job.out);
+    }
+    free(job.results);
+    free_paths(&job.files);
+    pthread_mutex_destroy(&job.lock);
+    return rc;
+}
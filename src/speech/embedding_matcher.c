@@ -0,0 +1,386 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../../include/embedding_matcher.h"
+
+#define LOG_MODULE LOG_MODULE_INTENT
+#include "../../include/log.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define ALIGN16(n) (((n) + 15) & ~(size_t)15)
+
+// A read-only file mapping
+typedef struct {
+    void* base;
+    size_t size;
+} MappedFile;
+
+struct WordVectors {
+    MappedFile file;
+    const EmbeddingFileHeader* header;
+    const uint32_t* word_offsets;
+    const char* words;
+    const float* scales;
+    const float* weights;
+    const int8_t* vectors;
+};
+
+struct EmbeddingIndex {
+    MappedFile file;
+    const EmbeddingFileHeader* header;
+    const WordVectors* model;
+    const float* centroids;
+    const uint32_t* list_offsets;
+    const uint32_t* list_rows;
+    const float* scales;
+    const int8_t* vectors;
+};
+
+static bool map_file(const char* path, MappedFile* mapped) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(EmbeddingFileHeader)) {
+        close(fd);
+        return false;
+    }
+
+    mapped->size = (size_t)st.st_size;
+    mapped->base = mmap(NULL, mapped->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped->base == MAP_FAILED) {
+        mapped->base = NULL;
+        return false;
+    }
+    return true;
+}
+
+static void unmap_file(MappedFile* mapped) {
+    if (mapped->base) {
+        munmap(mapped->base, mapped->size);
+        mapped->base = NULL;
+    }
+}
+
+WordVectors* load_word_vectors(const char* path) {
+    WordVectors* model = calloc(1, sizeof(WordVectors));
+    if (!model) {
+        return NULL;
+    }
+    if (!map_file(path, &model->file)) {
+        free(model);
+        return NULL;
+    }
+
+    const EmbeddingFileHeader* header = model->file.base;
+    size_t count = header->count;
+    size_t offset = ALIGN16(sizeof(EmbeddingFileHeader));
+    size_t words_at = ALIGN16(offset + (count + 1) * sizeof(uint32_t));
+    size_t scales_at = ALIGN16(words_at + header->blob_size);
+    size_t weights_at = ALIGN16(scales_at + count * sizeof(float));
+    size_t vectors_at = ALIGN16(weights_at + count * sizeof(float));
+    size_t end = vectors_at + count * header->dim_padded;
+
+    if (header->magic != WORD_VECTORS_MAGIC || header->dim == 0 ||
+        header->dim_padded > EMBEDDING_MAX_DIM || header->dim_padded % 16 != 0 ||
+        header->dim > header->dim_padded || end > model->file.size) {
+        log_error("Invalid word vector file %s", path);
+        unmap_file(&model->file);
+        free(model);
+        return NULL;
+    }
+
+    const char* base = model->file.base;
+    model->header = header;
+    model->word_offsets = (const uint32_t*)(base + offset);
+    model->words = base + words_at;
+    model->scales = (const float*)(base + scales_at);
+    model->weights = (const float*)(base + weights_at);
+    model->vectors = (const int8_t*)(base + vectors_at);
+
+    log_info("Loaded %u word vectors (%u dimensions)", header->count, header->dim);
+    return model;
+}
+
+void free_word_vectors(WordVectors* model) {
+    if (!model) return;
+    unmap_file(&model->file);
+    free(model);
+}
+
+size_t word_vectors_bytes(const WordVectors* model) {
+    return model ? sizeof(WordVectors) + model->file.size : 0;
+}
+
+size_t word_vectors_dim(const WordVectors* model) {
+    return model->header->dim;
+}
+
+size_t word_vectors_padded_dim(const WordVectors* model) {
+    return model->header->dim_padded;
+}
+
+// Binary search of the sorted word table; -1 if unknown
+static long find_word(const WordVectors* model, const char* word, size_t len) {
+    long lo = 0, hi = (long)model->header->count - 1;
+    while (lo <= hi) {
+        long mid = lo + (hi - lo) / 2;
+        const char* candidate = model->words + model->word_offsets[mid];
+        size_t candidate_len = model->word_offsets[mid + 1] - model->word_offsets[mid] - 1;
+        int cmp = strncmp(word, candidate, len < candidate_len ? len : candidate_len);
+        if (cmp == 0) {
+            cmp = (len > candidate_len) - (len < candidate_len);
+        }
+        if (cmp == 0) return mid;
+        if (cmp < 0) hi = mid - 1; else lo = mid + 1;
+    }
+    return -1;
+}
+
+bool embed_text(const WordVectors* model, const char* text, float* out) {
+    size_t dim = model->header->dim_padded;
+    memset(out, 0, sizeof(float) * dim);
+
+    // Same separators as the TF-IDF tokenizer; stopwords are kept because
+    // SIF weighting already discounts frequent words
+    char word[64];
+    size_t len = 0;
+    int known = 0;
+    for (const char* p = text; ; p++) {
+        bool separator = *p == '\0' || isspace((unsigned char)*p) || strchr(".,?!;:\"'()[]{}/-", *p);
+        if (!separator) {
+            if (len < sizeof(word) - 1) {
+                word[len++] = (char)tolower((unsigned char)*p);
+            }
+            continue;
+        }
+        if (len > 0) {
+            long id = find_word(model, word, len);
+            if (id >= 0) {
+                float weight = model->weights[id] * model->scales[id];
+                const int8_t* vector = model->vectors + (size_t)id * dim;
+                for (size_t d = 0; d < dim; d++) {
+                    out[d] += weight * vector[d];
+                }
+                known++;
+            }
+            len = 0;
+        }
+        if (*p == '\0') break;
+    }
+
+    float norm = 0.0f;
+    for (size_t d = 0; d < dim; d++) {
+        norm += out[d] * out[d];
+    }
+    if (known == 0 || norm <= 0.0f) {
+        return false;
+    }
+    norm = 1.0f / sqrtf(norm);
+    for (size_t d = 0; d < dim; d++) {
+        out[d] *= norm;
+    }
+    return true;
+}
+
+float quantize_embedding(const float* in, size_t dim, int8_t* out) {
+    float peak = 0.0f;
+    for (size_t d = 0; d < dim; d++) {
+        if (fabsf(in[d]) > peak) peak = fabsf(in[d]);
+    }
+    float scale = peak > 0.0f ? peak / 127.0f : 1.0f;
+    for (size_t d = 0; d < dim; d++) {
+        out[d] = (int8_t)lrintf(in[d] / scale);
+    }
+    return scale;
+}
+
+uint64_t embedding_fingerprint(uint64_t hash, const char* question) {
+    for (const char* p = question; ; p++) {
+        hash ^= (uint8_t)*p;
+        hash *= 1099511628211ull;
+        if (*p == '\0') break;   // Hash the terminator so row boundaries count
+    }
+    return hash;
+}
+
+EmbeddingIndex* load_embedding_index(const char* path, const WordVectors* model,
+                                     size_t rows, uint64_t fingerprint) {
+    if (!model) {
+        return NULL;
+    }
+
+    EmbeddingIndex* index = calloc(1, sizeof(EmbeddingIndex));
+    if (!index) {
+        return NULL;
+    }
+    if (!map_file(path, &index->file)) {
+        free(index);
+        return NULL;
+    }
+
+    const EmbeddingFileHeader* header = index->file.base;
+    size_t dim = header->dim_padded;
+    size_t centroids_at = ALIGN16(sizeof(EmbeddingFileHeader));
+    size_t offsets_at = ALIGN16(centroids_at + (size_t)header->lists * dim * sizeof(float));
+    size_t rows_at = ALIGN16(offsets_at + ((size_t)header->lists + 1) * sizeof(uint32_t));
+    size_t scales_at = ALIGN16(rows_at + (size_t)header->count * sizeof(uint32_t));
+    size_t vectors_at = ALIGN16(scales_at + (size_t)header->count * sizeof(float));
+    size_t end = vectors_at + (size_t)header->count * dim;
+
+    const char* problem = NULL;
+    if (header->magic != EMBEDDING_INDEX_MAGIC || header->lists == 0 || end > index->file.size) {
+        problem = "is invalid";
+    } else if (header->dim != model->header->dim || dim != model->header->dim_padded) {
+        problem = "was built with a different word vector model";
+    } else if (header->count != rows || header->fingerprint != fingerprint) {
+        problem = "is out of date with the CSV";
+    }
+    if (problem) {
+        log_error("Embedding index %s %s; rebuild it with build/build_embeddings", path, problem);
+        unmap_file(&index->file);
+        free(index);
+        return NULL;
+    }
+
+    const char* base = index->file.base;
+    index->header = header;
+    index->model = model;
+    index->centroids = (const float*)(base + centroids_at);
+    index->list_offsets = (const uint32_t*)(base + offsets_at);
+    index->list_rows = (const uint32_t*)(base + rows_at);
+    index->scales = (const float*)(base + scales_at);
+    index->vectors = (const int8_t*)(base + vectors_at);
+
+    log_info("Loaded embedding index for %u questions (%u lists)", header->count, header->lists);
+    return index;
+}
+
+void free_embedding_index(EmbeddingIndex* index) {
+    if (!index) return;
+    unmap_file(&index->file);
+    free(index);
+}
+
+size_t embedding_index_bytes(const EmbeddingIndex* index) {
+    return index ? sizeof(EmbeddingIndex) + index->file.size : 0;
+}
+
+bool encode_query(const EmbeddingIndex* index, const char* text, QueryEmbedding* query) {
+    float vector[EMBEDDING_MAX_DIM];
+    if (!embed_text(index->model, text, vector)) {
+        return false;
+    }
+    query->scale = quantize_embedding(vector, index->header->dim_padded, query->values);
+    return true;
+}
+
+// int8 dot product; dim is a multiple of 16
+static inline int32_t dot_s8(const int8_t* a, const int8_t* b, size_t dim) {
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    int32x4_t acc = vdupq_n_s32(0);
+    for (size_t i = 0; i < dim; i += 16) {
+        int8x16_t x = vld1q_s8(a + i);
+        int8x16_t y = vld1q_s8(b + i);
+        acc = vpadalq_s16(acc, vmull_s8(vget_low_s8(x), vget_low_s8(y)));
+        acc = vpadalq_s16(acc, vmull_s8(vget_high_s8(x), vget_high_s8(y)));
+    }
+#if defined(__aarch64__)
+    return vaddvq_s32(acc);
+#else
+    int32x2_t sum = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+    return vget_lane_s32(vpadd_s32(sum, sum), 0);
+#endif
+#elif defined(__SSE2__)
+    __m128i acc = _mm_setzero_si128();
+    for (size_t i = 0; i < dim; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+        // Sign-extend bytes to 16 bits: duplicate each byte then shift right
+        __m128i x_lo = _mm_srai_epi16(_mm_unpacklo_epi8(x, x), 8);
+        __m128i x_hi = _mm_srai_epi16(_mm_unpackhi_epi8(x, x), 8);
+        __m128i y_lo = _mm_srai_epi16(_mm_unpacklo_epi8(y, y), 8);
+        __m128i y_hi = _mm_srai_epi16(_mm_unpackhi_epi8(y, y), 8);
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(x_lo, y_lo));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(x_hi, y_hi));
+    }
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(acc);
+#else
+    int32_t acc = 0;
+    for (size_t i = 0; i < dim; i++) {
+        acc += (int32_t)a[i] * b[i];
+    }
+    return acc;
+#endif
+}
+
+float embedding_similarity(const EmbeddingIndex* index, const QueryEmbedding* query, size_t row) {
+    size_t dim = index->header->dim_padded;
+    int32_t dot = dot_s8(query->values, index->vectors + row * dim, dim);
+    return (float)dot * query->scale * index->scales[row];
+}
+
+// Keep hits sorted best first, bounded at k; returns the new count
+static size_t insert_hit(EmbeddingHit* hits, size_t count, size_t k, uint32_t row, float similarity) {
+    if (count == k && similarity <= hits[k - 1].similarity) {
+        return count;
+    }
+    size_t pos = count < k ? count++ : k - 1;
+    while (pos > 0 && hits[pos - 1].similarity < similarity) {
+        hits[pos] = hits[pos - 1];
+        pos--;
+    }
+    hits[pos].row = row;
+    hits[pos].similarity = similarity;
+    return count;
+}
+
+size_t embedding_search(const EmbeddingIndex* index, const QueryEmbedding* query,
+                        size_t nprobe, EmbeddingHit* hits, size_t k) {
+    size_t dim = index->header->dim_padded;
+    size_t lists = index->header->lists;
+    if (k == 0) return 0;
+    if (nprobe > lists) nprobe = lists;
+
+    // Coarse pass: closest IVF centroids to the (dequantized) query
+    EmbeddingHit probes[64];
+    if (nprobe > sizeof(probes) / sizeof(probes[0])) {
+        nprobe = sizeof(probes) / sizeof(probes[0]);
+    }
+    size_t probe_count = 0;
+    for (size_t list = 0; list < lists; list++) {
+        const float* centroid = index->centroids + list * dim;
+        float dot = 0.0f;
+        for (size_t d = 0; d < dim; d++) {
+            dot += centroid[d] * query->values[d];
+        }
+        probe_count = insert_hit(probes, probe_count, nprobe, (uint32_t)list, dot);
+    }
+
+    // Fine pass: int8 dot products over the selected lists
+    size_t count = 0;
+    for (size_t p = 0; p < probe_count; p++) {
+        uint32_t list = probes[p].row;
+        for (uint32_t i = index->list_offsets[list]; i < index->list_offsets[list + 1]; i++) {
+            uint32_t row = index->list_rows[i];
+            count = insert_hit(hits, count, k, row, embedding_similarity(index, query, row));
+        }
+    }
+    return count;
+}
@@ -1,20 +1,72 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <ctype.h>
 #include <stdbool.h>
 #include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/inotify.h>
 #include "../../include/intent_processor.h"
+#include "../../include/memory_accounting.h"
+#include "../../include/embedding_matcher.h"
+#include "../../include/arena.h"
 
-#define MAX_INTENTS 300
+#define LOG_MODULE LOG_MODULE_INTENT
+#include "../../include/log.h"
+
+#define MAX_INTENTS 200000          // Upper bound on rows loaded from the CSV
 #define SIMILARITY_THRESHOLD 0.7  // 70% similarity threshold
-#define SIMILARITY_THRESHOLD_MIN 0.5  // 50% similarity threshold
 #define MIN_SIMILARITY_TO_SHOW 0.3 // Show matches above 30% for debugging
-#define MAX_VOCABULARY_SIZE 2000   // Maximum unique words in corpus
+#define MAX_VOCABULARY_SIZE 65535  // Maximum unique words in corpus (16-bit term ids)
 #define MAX_WORDS_PER_QUESTION 50  // Maximum words per question
 
-static IntentEntry* g_intents = NULL;
-static size_t g_intent_count = 0;
+// Storage precision of index weights: 32 (float), 16 or 8 bits.
+// Rows are L2-normalized before quantization, so weights lie in [0, 1].
+#define INTENT_WEIGHT_BITS 16
+
+// Top-k retrieval strategy: MaxScore walks the inverted index and skips
+// questions whose score upper bound cannot enter the current top k;
+// 0 scores every question (reference behaviour, identical results)
+#ifndef INTENT_RETRIEVAL_MAXSCORE
+#define INTENT_RETRIEVAL_MAXSCORE 1
+#endif
+#define MAXSCORE_EPSILON 1e-5f     // Slack on bounds for float rounding
+
+// Query words missing from the vocabulary are mapped to a close term before
+// scoring: two words that join into one ("hydro plane"), a word with the same
+// light stem ("zebras"), or a word within a small edit distance, found through
+// a SymSpell-style index of prefix deletions. Looser matches count for less.
+// 0 drops unknown words (previous behaviour)
+#ifndef INTENT_FUZZY_TERMS
+#define INTENT_FUZZY_TERMS 1
+#endif
+#define FUZZY_MIN_WORD 4            // Shorter unknown words are dropped
+#define FUZZY_LONG_WORD 6           // Words this long may be two edits away, shorter ones one
+#define FUZZY_MAX_DISTANCE 2
+#define FUZZY_PREFIX_LENGTH 7       // Deletions are indexed over this many leading letters
+#define FUZZY_MAX_VARIANTS (1 + FUZZY_PREFIX_LENGTH + FUZZY_PREFIX_LENGTH * (FUZZY_PREFIX_LENGTH - 1) / 2)
+#define FUZZY_STEM_CREDIT 0.9f      // Term frequency credited for a stem match
+#define FUZZY_EDIT1_CREDIT 0.75f    // ... one edit away
+#define FUZZY_EDIT2_CREDIT 0.5f     // ... two edits away
+
+#if INTENT_WEIGHT_BITS == 8
+typedef uint8_t IndexWeight;
+#define WEIGHT_SCALE 255.0f
+#elif INTENT_WEIGHT_BITS == 16
+typedef uint16_t IndexWeight;
+#define WEIGHT_SCALE 65535.0f
+#else
+typedef float IndexWeight;
+#define WEIGHT_SCALE 1.0f
+#endif
 
 // Vocabulary structure for TF-IDF
 typedef struct {
@@ -22,16 +74,121 @@ typedef struct {
     int document_frequency;  // Number of documents containing this word
 } VocabularyEntry;
 
-// TF-IDF vector structure
+// Sparse, L2-normalized TF-IDF vector with terms in ascending id order
 typedef struct {
-    float* tfidf_values;    // TF-IDF values for each word in vocabulary
-    int num_words;          // Number of words in this document
+    uint16_t term;
+    float weight;
+} WeightedTerm;
+
+typedef struct {
+    WeightedTerm terms[MAX_WORDS_PER_QUESTION];
+    int count;
 } TFIDFVector;
 
-// Global vocabulary and TF-IDF data
-static VocabularyEntry* g_vocabulary = NULL;
-static size_t g_vocabulary_size = 0;
-static TFIDFVector* g_question_vectors = NULL;
+// A candidate in the bounded top-k heap
+typedef struct {
+    float score;
+    uint32_t row;
+    bool exact;
+} ScoredRow;
+
+// Scratch memory for one query at a time, sized for its snapshot
+typedef struct {
+    atomic_flag busy;
+    Arena arena;
+} QueryScratch;
+
+// Terms sharing one deletion hash span [start, start + count) of deletion_terms
+typedef struct {
+    uint32_t hash;
+    uint32_t start;
+    uint32_t count;             // 0 marks an empty slot
+} DeletionBucket;
+
+// One immutable snapshot of the intent table and its TF-IDF index.
+// Queries read whichever snapshot is published; a reload builds a new one
+// and swaps it in, freeing the old one once no query can still see it.
+typedef struct {
+    IntentEntry* intents;
+    size_t intent_count;
+    VocabularyEntry* vocabulary;    // Sorted by word for binary search
+    size_t vocabulary_size;
+    // Question vectors in CSR form: row i spans
+    // [row_offsets[i], row_offsets[i + 1]) of term_ids and weights
+    uint32_t* row_offsets;
+    uint16_t* term_ids;
+    IndexWeight* weights;
+    size_t nonzero_count;
+    // Inverted index (transpose of the CSR rows): term t's postings span
+    // [posting_offsets[t], posting_offsets[t + 1]) in ascending question order
+    uint32_t* posting_offsets;
+    uint32_t* posting_rows;
+    IndexWeight* posting_weights;
+    IndexWeight* term_max_weight;   // Largest weight in each posting list
+    // Open-addressed table of case-insensitive question text -> row + 1
+    uint32_t* exact_slots;
+    size_t exact_mask;
+    // Fuzzy term lookup: light stem -> term id + 1 (open addressed), and
+    // deletion hash -> terms whose prefix yields it with up to
+    // FUZZY_MAX_DISTANCE letters deleted
+    uint32_t* stem_slots;
+    size_t stem_mask;
+    DeletionBucket* deletion_buckets;
+    size_t deletion_mask;
+    uint16_t* deletion_terms;
+    size_t deletion_term_count;
+    // Questions grouped by Intent label: group g's rows span
+    // [group_offsets[g], group_offsets[g + 1]) of group_rows
+    size_t group_count;
+    uint32_t* group_offsets;
+    uint32_t* group_rows;
+    // Normalized group centroids as postings: term t spans
+    // [centroid_offsets[t], centroid_offsets[t + 1]) of centroid_groups/weights
+    uint32_t* centroid_offsets;
+    uint32_t* centroid_groups;
+    float* centroid_weights;
+    // Optional semantic index built offline for exactly these questions
+    EmbeddingIndex* embeddings;
+    // Per-query scratch: a query checks out a free slot and resets it when
+    // done, so matching does not call malloc unless every slot is busy
+    QueryScratch* scratch;
+    // Charged to MEMORY_INTENTS while this snapshot exists (0 until then)
+    size_t bytes;
+} IntentIndex;
+
+// One intent data set: the published snapshot, its reclamation state and
+// the watcher that reloads it. All state lives here, so several processors
+// (e.g. one per CSV) can be used side by side from any number of threads.
+struct IntentProcessor {
+    char csv_path[512];
+    char csv_dir[512];
+    const char* csv_file;               // File name part of csv_path
+
+    // Currently published snapshot
+    IntentIndex* _Atomic index;
+
+    // Epoch-based reclamation: readers count themselves in the slot matching the
+    // epoch parity they observed; a writer flips the parity and waits for the
+    // old slot to drain (twice) before freeing a retired snapshot
+    atomic_uint read_epoch;
+    atomic_long active_readers[2];
+    pthread_mutex_t publish_lock;
+
+    // Word vectors for the semantic matcher (NULL when not installed)
+    WordVectors* word_vectors;
+
+    // Intents re-ranked by two-stage retrieval
+    atomic_size_t group_fanout;
+
+    // Cosine similarity an answer needs
+    _Atomic float min_similarity;
+
+    // CSV watcher state
+    pthread_t watch_thread;
+    bool watch_running;
+    int watch_stop_pipe[2];
+    int watch_inotify_fd;
+};
 
 // Helper function to trim whitespace
 static char* trim(char* str) {
@@ -70,16 +227,18 @@ static bool is_stopword(const char* word) {
 }
 
 // Helper function to tokenize text into words (removes punctuation and stopwords)
+// Text beyond MAX_QUESTION_LENGTH is ignored.
 static int tokenize_text(const char* text, char words[][64], int max_words) {
-    char* temp = strdup(text);
-    char* orig_temp = temp;
+    char temp[MAX_QUESTION_LENGTH];
+    char* saveptr = NULL;
     int word_count = 0;
     
     // Convert to lowercase
+    snprintf(temp, sizeof(temp), "%s", text);
     to_lower(temp);
     
-    // Tokenize by spaces and punctuation
-    char* token = strtok(temp, " \t\n.,?!;:\"'()[]{}/-");
+    // Tokenize by spaces and punctuation (strtok_r: lookups may run on service threads)
+    char* token = strtok_r(temp, " \t\n.,?!;:\"'()[]{}/-", &saveptr);
     while (token && word_count < max_words) {
         // Skip very short words and stopwords
         if (strlen(token) > 1 && !is_stopword(token)) {
@@ -87,205 +246,751 @@ static int tokenize_text(const char* text, char words[][64], int max_words) {
             words[word_count][63] = '\0';
             word_count++;
         }
-        token = strtok(NULL, " \t\n.,?!;:\"'()[]{}/-");
+        token = strtok_r(NULL, " \t\n.,?!;:\"'()[]{}/-", &saveptr);
     }
     
-    free(orig_temp);
     return word_count;
 }
 
+static int compare_vocabulary(const void* a, const void* b) {
+    return strcmp(((const VocabularyEntry*)a)->word, ((const VocabularyEntry*)b)->word);
+}
+
+static int compare_weighted_terms(const void* a, const void* b) {
+    return (int)((const WeightedTerm*)a)->term - (int)((const WeightedTerm*)b)->term;
+}
+
+static int compare_keys(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// FNV-1a over the lowercased bytes of a string
+static uint32_t hash_lower(const char* str) {
+    uint32_t hash = 2166136261u;
+    for (; *str; str++) {
+        hash ^= (uint8_t)tolower((unsigned char)*str);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
 // Build vocabulary from all questions
-static void build_vocabulary(void) {
-    g_vocabulary = malloc(sizeof(VocabularyEntry) * MAX_VOCABULARY_SIZE);
-    g_vocabulary_size = 0;
+static void build_vocabulary(IntentIndex* idx) {
+    idx->vocabulary = malloc(sizeof(VocabularyEntry) * MAX_VOCABULARY_SIZE);
+    idx->vocabulary_size = 0;
+    if (!idx->vocabulary) {
+        return;
+    }
+    
+    // Temporary hash of word -> vocabulary slot + 1 so building stays linear
+    const size_t table_size = 1u << 17;
+    uint32_t* table = calloc(table_size, sizeof(uint32_t));
+    if (!table) {
+        free(idx->vocabulary);
+        idx->vocabulary = NULL;
+        return;
+    }
     
-    // Process each question to build vocabulary
-    for (size_t i = 0; i < g_intent_count; i++) {
+    // Process each question to build vocabulary and document frequencies
+    for (size_t i = 0; i < idx->intent_count; i++) {
         char words[MAX_WORDS_PER_QUESTION][64];
-        int word_count = tokenize_text(g_intents[i].question, words, MAX_WORDS_PER_QUESTION);
+        int word_count = tokenize_text(idx->intents[i].question, words, MAX_WORDS_PER_QUESTION);
+        uint32_t seen[MAX_WORDS_PER_QUESTION];
+        int seen_count = 0;
         
         // For each word in this question
         for (int j = 0; j < word_count; j++) {
-            // Check if word already exists in vocabulary
-            bool found = false;
-            for (size_t k = 0; k < g_vocabulary_size; k++) {
-                if (strcmp(g_vocabulary[k].word, words[j]) == 0) {
-                    // Word exists, increment document frequency
-                    found = true;
-                    break;
-                }
+            size_t slot = hash_lower(words[j]) & (table_size - 1);
+            while (table[slot] && strcmp(idx->vocabulary[table[slot] - 1].word, words[j]) != 0) {
+                slot = (slot + 1) & (table_size - 1);
             }
             
             // If word doesn't exist and we have space, add it
-            if (!found && g_vocabulary_size < MAX_VOCABULARY_SIZE) {
-                strncpy(g_vocabulary[g_vocabulary_size].word, words[j], 63);
-                g_vocabulary[g_vocabulary_size].word[63] = '\0';
-                g_vocabulary[g_vocabulary_size].document_frequency = 0;
-                g_vocabulary_size++;
+            if (!table[slot]) {
+                if (idx->vocabulary_size >= MAX_VOCABULARY_SIZE) {
+                    continue;
+                }
+                VocabularyEntry* entry = &idx->vocabulary[idx->vocabulary_size];
+                snprintf(entry->word, sizeof(entry->word), "%.*s", (int)sizeof(entry->word) - 1, words[j]);
+                entry->document_frequency = 0;
+                table[slot] = (uint32_t)++idx->vocabulary_size;
             }
-        }
-    }
-    
-    // Count document frequencies
-    for (size_t i = 0; i < g_intent_count; i++) {
-        char words[MAX_WORDS_PER_QUESTION][64];
-        int word_count = tokenize_text(g_intents[i].question, words, MAX_WORDS_PER_QUESTION);
-        
-        // Mark which vocabulary words appear in this document
-        bool word_seen[MAX_VOCABULARY_SIZE] = {false};
-        
-        for (int j = 0; j < word_count; j++) {
-            for (size_t k = 0; k < g_vocabulary_size; k++) {
-                if (strcmp(g_vocabulary[k].word, words[j]) == 0 && !word_seen[k]) {
-                    g_vocabulary[k].document_frequency++;
-                    word_seen[k] = true;
+            
+            // Count each word once per document
+            bool counted = false;
+            for (int s = 0; s < seen_count; s++) {
+                if (seen[s] == table[slot]) {
+                    counted = true;
                     break;
                 }
             }
+            if (!counted) {
+                seen[seen_count++] = table[slot];
+                idx->vocabulary[table[slot] - 1].document_frequency++;
+            }
         }
     }
+    free(table);
     
-    printf("Built vocabulary with %zu unique words\n", g_vocabulary_size);
-}
+    // Sort so query terms can be found by binary search
+    qsort(idx->vocabulary, idx->vocabulary_size, sizeof(VocabularyEntry), compare_vocabulary);
 
-// Calculate TF-IDF vector for a given text
-static TFIDFVector calculate_tfidf_vector(const char* text) {
-    TFIDFVector vector;
-    vector.tfidf_values = calloc(g_vocabulary_size, sizeof(float));
-    vector.num_words = 0;
+    // Room was made for MAX_VOCABULARY_SIZE words; keep only what is used
+    VocabularyEntry* used = realloc(idx->vocabulary, sizeof(VocabularyEntry) * (idx->vocabulary_size + 1));
+    if (used) {
+        idx->vocabulary = used;
+    }
     
+    log_info("Built vocabulary with %zu unique words", idx->vocabulary_size);
+}
+
+// Find a word's term id, or -1 if it is not in the vocabulary
+static int lookup_term(const IntentIndex* idx, const char* word) {
+    size_t lo = 0, hi = idx->vocabulary_size;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        int cmp = strcmp(word, idx->vocabulary[mid].word);
+        if (cmp == 0) return (int)mid;
+        if (cmp < 0) hi = mid; else lo = mid + 1;
+    }
+    return -1;
+}
+
+// Light stemmer for fuzzy lookup: strips plural, -ing and -ed endings and
+// a final 'e', so "zebras"/"zebra" and "driving"/"drive" share a stem
+static void light_stem(const char* word, char* stem, size_t size) {
+    size_t len = strlen(word);
+    if (len >= size) len = size - 1;
+    memcpy(stem, word, len);
+    stem[len] = '\0';
+
+    if (len > 4 && strcmp(stem + len - 3, "ies") == 0) {
+        len -= 2;
+        stem[len - 1] = 'y';
+    } else if (len > 3 && strcmp(stem + len - 2, "es") == 0 && strchr("sxzh", stem[len - 3])) {
+        len -= 2;
+    } else if (len > 3 && stem[len - 1] == 's' && !strchr("sui", stem[len - 2])) {
+        len -= 1;
+    }
+    stem[len] = '\0';
+    if (len > 5 && strcmp(stem + len - 3, "ing") == 0) {
+        len -= 3;
+    } else if (len > 4 && strcmp(stem + len - 2, "ed") == 0) {
+        len -= 2;
+    }
+    if (len > 3 && stem[len - 1] == 'e') {
+        len -= 1;
+    }
+    stem[len] = '\0';
+}
+
+// Hashes of word's first FUZZY_PREFIX_LENGTH letters with 0 to max_distance
+// of them deleted (the symmetric-deletion neighbourhood). Returns the count,
+// at most FUZZY_MAX_VARIANTS; repeated letters can give duplicates.
+// The hash is polynomial, so each variant is combined from prefix hashes
+// in constant time instead of rehashing the letters.
+static int deletion_hashes(const char* word, int max_distance, uint32_t* hashes) {
+    const uint32_t base = 16777619u;
+    uint32_t prefix[FUZZY_PREFIX_LENGTH + 1];   // Hash of word[0, k)
+    uint32_t power[FUZZY_PREFIX_LENGTH + 1];    // base^k
+    int len = (int)strnlen(word, FUZZY_PREFIX_LENGTH);
+    int count = 0;
+
+    prefix[0] = 0;
+    power[0] = 1;
+    for (int k = 0; k < len; k++) {
+        prefix[k + 1] = prefix[k] * base + (uint8_t)word[k];
+        power[k + 1] = power[k] * base;
+    }
+// Hash of word[a, b)
+#define SEGMENT(a, b) (prefix[b] - prefix[a] * power[(b) - (a)])
+
+    hashes[count++] = prefix[len];
+    for (int i = 0; i < len && max_distance >= 1 && len > 1; i++) {
+        uint32_t tail = SEGMENT(i + 1, len);
+        hashes[count++] = prefix[i] * power[len - i - 1] + tail;
+        for (int j = i + 1; j < len && max_distance >= 2 && len > 2; j++) {
+            hashes[count++] = (prefix[i] * power[j - i - 1] + SEGMENT(i + 1, j)) * power[len - j - 1] +
+                              SEGMENT(j + 1, len);
+        }
+    }
+#undef SEGMENT
+    return count;
+}
+
+// Optimal string alignment distance (edits plus adjacent swaps) between two
+// lowercase words, or limit + 1 once it must exceed limit. Only the band of
+// cells within limit of the diagonal is computed.
+static int edit_distance_within(const char* a, const char* b, int limit) {
+    int la = (int)strlen(a), lb = (int)strlen(b);
+    int rows[3][66];
+    int *before = rows[0], *previous = rows[1], *current = rows[2];
+    const int far = limit + 1;
+
+    if (abs(la - lb) > limit || la >= 64 || lb >= 64) {
+        return far;
+    }
+    for (int j = 0; j <= lb + 1; j++) {
+        before[j] = far;
+        previous[j] = j <= limit ? j : far;
+    }
+
+    for (int i = 1; i <= la; i++) {
+        int lo = i - limit > 1 ? i - limit : 1;
+        int hi = i + limit < lb ? i + limit : lb;
+        int row_min = far;
+
+        current[lo - 1] = lo == 1 && i <= limit ? i : far;
+        for (int j = lo; j <= hi; j++) {
+            int d = previous[j - 1] + (a[i - 1] != b[j - 1]);
+            if (previous[j] + 1 < d) d = previous[j] + 1;
+            if (current[j - 1] + 1 < d) d = current[j - 1] + 1;
+            if (i > 1 && j > 1 && a[i - 1] == b[j - 2] && a[i - 2] == b[j - 1] && before[j - 2] + 1 < d) {
+                d = before[j - 2] + 1;
+            }
+            current[j] = d < far ? d : far;
+            if (d < row_min) row_min = d;
+        }
+        current[hi + 1] = far;
+        if (row_min >= far) {
+            return far;
+        }
+        int* spare = before;
+        before = previous;
+        previous = current;
+        current = spare;
+    }
+    return previous[lb];
+}
+
+// Build the stem table and the deletion index over the vocabulary
+static bool build_fuzzy_terms(IntentIndex* idx) {
+    char stem[64];
+
+    if (!INTENT_FUZZY_TERMS) {
+        return true;
+    }
+
+    // Stem -> most frequent term with that stem
+    size_t size = 16;
+    while (size < idx->vocabulary_size * 2) size <<= 1;
+    idx->stem_slots = calloc(size, sizeof(uint32_t));
+    idx->stem_mask = size - 1;
+    if (!idx->stem_slots) {
+        return false;
+    }
+    for (size_t term = 0; term < idx->vocabulary_size; term++) {
+        char other[64];
+        light_stem(idx->vocabulary[term].word, stem, sizeof(stem));
+        size_t slot = hash_lower(stem) & idx->stem_mask;
+        while (idx->stem_slots[slot]) {
+            uint32_t existing = idx->stem_slots[slot] - 1;
+            light_stem(idx->vocabulary[existing].word, other, sizeof(other));
+            if (strcmp(stem, other) == 0) {
+                break;
+            }
+            slot = (slot + 1) & idx->stem_mask;
+        }
+        if (!idx->stem_slots[slot] ||
+            idx->vocabulary[term].document_frequency > idx->vocabulary[idx->stem_slots[slot] - 1].document_frequency) {
+            idx->stem_slots[slot] = (uint32_t)term + 1;
+        }
+    }
+
+    // Every (deletion hash, term) pair as hash << 16 | term, sorted and deduplicated
+    uint64_t* keys = malloc(sizeof(uint64_t) * (idx->vocabulary_size * FUZZY_MAX_VARIANTS + 1));
+    if (!keys) {
+        return false;
+    }
+    size_t key_count = 0;
+    for (size_t term = 0; term < idx->vocabulary_size; term++) {
+        uint32_t hashes[FUZZY_MAX_VARIANTS];
+        int count = deletion_hashes(idx->vocabulary[term].word, FUZZY_MAX_DISTANCE, hashes);
+        for (int v = 0; v < count; v++) {
+            keys[key_count++] = (uint64_t)hashes[v] << 16 | term;
+        }
+    }
+    qsort(keys, key_count, sizeof(uint64_t), compare_keys);
+
+    size_t distinct = 0, unique = 0;
+    for (size_t e = 0; e < key_count; e++) {
+        if (e > 0 && keys[e] == keys[e - 1]) continue;
+        if (unique == 0 || keys[e] >> 16 != keys[unique - 1] >> 16) distinct++;
+        keys[unique++] = keys[e];
+    }
+
+    size = 16;
+    while (size < distinct * 2) size <<= 1;
+    idx->deletion_buckets = calloc(size, sizeof(DeletionBucket));
+    idx->deletion_mask = size - 1;
+    idx->deletion_terms = malloc(sizeof(uint16_t) * (unique + 1));
+    idx->deletion_term_count = unique;
+    if (!idx->deletion_buckets || !idx->deletion_terms) {
+        free(keys);
+        return false;
+    }
+    for (size_t e = 0; e < unique; e++) {
+        uint32_t hash = (uint32_t)(keys[e] >> 16);
+        idx->deletion_terms[e] = (uint16_t)(keys[e] & 0xffff);
+        if (e > 0 && (uint32_t)(keys[e - 1] >> 16) == hash) {
+            continue;
+        }
+        size_t slot = hash & idx->deletion_mask;
+        while (idx->deletion_buckets[slot].count) {
+            slot = (slot + 1) & idx->deletion_mask;
+        }
+        size_t end = e + 1;
+        while (end < unique && (uint32_t)(keys[end] >> 16) == hash) end++;
+        idx->deletion_buckets[slot].hash = hash;
+        idx->deletion_buckets[slot].start = (uint32_t)e;
+        idx->deletion_buckets[slot].count = (uint32_t)(end - e);
+    }
+    free(keys);
+
+    log_info("Fuzzy term index: %zu deletion keys, %zu entries", distinct, unique);
+    return true;
+}
+
+// Term for two adjacent query words written as one ("hydro plane"), or -1
+static int lookup_joined_term(const IntentIndex* idx, const char* first, const char* second) {
+    char joined[64];
+    if (snprintf(joined, sizeof(joined), "%s%s", first, second) >= (int)sizeof(joined)) {
+        return -1;
+    }
+    return lookup_term(idx, joined);
+}
+
+// Closest vocabulary term to an unknown word: same stem first, then the
+// fewest edits (ties to the more common term). Sets *credit to the share
+// of a term occurrence the match is worth. Returns -1 if nothing is close.
+static int lookup_fuzzy_term(const IntentIndex* idx, const char* word, float* credit) {
+    size_t len = strlen(word);
+    char stem[64], other[64];
+
+    if (!idx->stem_slots || !idx->deletion_buckets || len < FUZZY_MIN_WORD) {
+        return -1;
+    }
+
+    light_stem(word, stem, sizeof(stem));
+    size_t slot = hash_lower(stem) & idx->stem_mask;
+    while (idx->stem_slots[slot]) {
+        uint32_t term = idx->stem_slots[slot] - 1;
+        light_stem(idx->vocabulary[term].word, other, sizeof(other));
+        if (strcmp(stem, other) == 0) {
+            *credit = FUZZY_STEM_CREDIT;
+            return (int)term;
+        }
+        slot = (slot + 1) & idx->stem_mask;
+    }
+
+    int limit = len >= FUZZY_LONG_WORD ? FUZZY_MAX_DISTANCE : 1;
+    uint32_t hashes[FUZZY_MAX_VARIANTS];
+    int variant_count = deletion_hashes(word, limit, hashes);
+    int best = -1, best_distance = limit + 1;
+    uint16_t checked[FUZZY_MAX_VARIANTS];      // Terms already measured (the first few)
+    int checked_count = 0;
+
+    for (int v = 0; v < variant_count; v++) {
+        slot = hashes[v] & idx->deletion_mask;
+        while (idx->deletion_buckets[slot].count && idx->deletion_buckets[slot].hash != hashes[v]) {
+            slot = (slot + 1) & idx->deletion_mask;
+        }
+        const DeletionBucket* bucket = &idx->deletion_buckets[slot];
+        for (uint32_t c = 0; c < bucket->count; c++) {
+            int term = idx->deletion_terms[bucket->start + c];
+            bool seen = false;
+            for (int k = 0; k < checked_count && !seen; k++) {
+                seen = checked[k] == term;
+            }
+            if (seen) continue;
+            if (checked_count < FUZZY_MAX_VARIANTS) {
+                checked[checked_count++] = (uint16_t)term;
+            }
+
+            int distance = edit_distance_within(word, idx->vocabulary[term].word, best_distance);
+            if (distance < best_distance ||
+                (distance == best_distance && distance <= limit &&
+                 idx->vocabulary[term].document_frequency > idx->vocabulary[best].document_frequency)) {
+                best = term;
+                best_distance = distance;
+            }
+        }
+    }
+    if (best < 0) {
+        return -1;
+    }
+    *credit = best_distance == 1 ? FUZZY_EDIT1_CREDIT : FUZZY_EDIT2_CREDIT;
+    log_debug("Unknown word \"%s\" read as \"%s\" (%d edits)", word, idx->vocabulary[best].word, best_distance);
+    return best;
+}
+
+// Calculate the normalized sparse TF-IDF vector for a given text
+static void calculate_tfidf_vector(const IntentIndex* idx, const char* text, TFIDFVector* vector) {
     char words[MAX_WORDS_PER_QUESTION][64];
     int word_count = tokenize_text(text, words, MAX_WORDS_PER_QUESTION);
-    vector.num_words = word_count;
-    
+    float magnitude = 0.0f;
+
+    vector->count = 0;
     if (word_count == 0) {
-        return vector;
+        return;
     }
     
     // Count term frequencies in this document
-    int term_frequencies[MAX_VOCABULARY_SIZE] = {0};
-    
     for (int i = 0; i < word_count; i++) {
-        for (size_t j = 0; j < g_vocabulary_size; j++) {
-            if (strcmp(g_vocabulary[j].word, words[i]) == 0) {
-                term_frequencies[j]++;
-                break;
+        float credit = 1.0f;
+        int term = lookup_term(idx, words[i]);
+        if (INTENT_FUZZY_TERMS && term < 0) {
+            if (i + 1 < word_count && (term = lookup_joined_term(idx, words[i], words[i + 1])) >= 0) {
+                i++;
+            } else {
+                term = lookup_fuzzy_term(idx, words[i], &credit);
             }
         }
+        if (term < 0) continue;
+
+        int j = 0;
+        while (j < vector->count && vector->terms[j].term != term) j++;
+        if (j == vector->count) {
+            vector->terms[j].term = (uint16_t)term;
+            vector->terms[j].weight = 0.0f;
+            vector->count++;
+        }
+        vector->terms[j].weight += credit;
     }
     
     // Calculate TF-IDF values
-    for (size_t i = 0; i < g_vocabulary_size; i++) {
-        if (term_frequencies[i] > 0) {
-            // TF = (frequency of term in document) / (total number of terms in document)
-            float tf = (float)term_frequencies[i] / (float)word_count;
-            
-            // IDF = log(total number of documents / number of documents containing term)
-            float idf = logf((float)g_intent_count / (float)g_vocabulary[i].document_frequency);
-            
-            // TF-IDF = TF * IDF
-            vector.tfidf_values[i] = tf * idf;
+    int kept = 0;
+    for (int j = 0; j < vector->count; j++) {
+        // TF = (frequency of term in document) / (total number of terms in document)
+        float tf = vector->terms[j].weight / (float)word_count;
+        
+        // IDF = log(total number of documents / number of documents containing term)
+        float idf = logf((float)idx->intent_count /
+                         (float)idx->vocabulary[vector->terms[j].term].document_frequency);
+        
+        // TF-IDF = TF * IDF
+        float weight = tf * idf;
+        if (weight > 0.0f) {
+            vector->terms[kept].term = vector->terms[j].term;
+            vector->terms[kept].weight = weight;
+            magnitude += weight * weight;
+            kept++;
         }
     }
-    
-    return vector;
+    vector->count = kept;
+
+    // Normalize so cosine similarity is a plain dot product
+    magnitude = sqrtf(magnitude);
+    for (int j = 0; j < vector->count; j++) {
+        vector->terms[j].weight /= magnitude;
+    }
+    qsort(vector->terms, vector->count, sizeof(WeightedTerm), compare_weighted_terms);
 }
 
-// Calculate cosine similarity between two TF-IDF vectors
-static float calculate_cosine_similarity(const TFIDFVector* vec1, const TFIDFVector* vec2) {
+// Cosine similarity between a query vector and question row i
+// Both sides are normalized and sorted, so this is a sparse merge-join dot product
+static float calculate_cosine_similarity(const IntentIndex* idx, const TFIDFVector* query, size_t row) {
+    uint32_t j = idx->row_offsets[row];
+    uint32_t end = idx->row_offsets[row + 1];
+    int q = 0;
     float dot_product = 0.0f;
-    float magnitude1 = 0.0f;
-    float magnitude2 = 0.0f;
-    
-    // Calculate dot product and magnitudes
-    for (size_t i = 0; i < g_vocabulary_size; i++) {
-        dot_product += vec1->tfidf_values[i] * vec2->tfidf_values[i];
-        magnitude1 += vec1->tfidf_values[i] * vec1->tfidf_values[i];
-        magnitude2 += vec2->tfidf_values[i] * vec2->tfidf_values[i];
+
+    while (q < query->count && j < end) {
+        uint16_t qt = query->terms[q].term;
+        uint16_t rt = idx->term_ids[j];
+        if (qt == rt) {
+            dot_product += query->terms[q].weight * (float)idx->weights[j];
+            q++;
+            j++;
+        } else if (qt < rt) {
+            q++;
+        } else {
+            j++;
+        }
     }
     
-    magnitude1 = sqrtf(magnitude1);
-    magnitude2 = sqrtf(magnitude2);
+    return dot_product / WEIGHT_SCALE;
+}
+
+// Precompute TF-IDF vectors for all questions into the CSR arrays
+static bool precompute_question_vectors(IntentIndex* idx) {
+    size_t capacity = idx->intent_count * 8 + 1;
+    TFIDFVector vector;
+
+    idx->row_offsets = malloc(sizeof(uint32_t) * (idx->intent_count + 1));
+    idx->term_ids = malloc(sizeof(uint16_t) * capacity);
+    idx->weights = malloc(sizeof(IndexWeight) * capacity);
+    idx->nonzero_count = 0;
+    if (!idx->row_offsets || !idx->term_ids || !idx->weights) {
+        return false;
+    }
     
-    // Avoid division by zero
-    if (magnitude1 == 0.0f || magnitude2 == 0.0f) {
-        return 0.0f;
+    for (size_t i = 0; i < idx->intent_count; i++) {
+        idx->row_offsets[i] = (uint32_t)idx->nonzero_count;
+        calculate_tfidf_vector(idx, idx->intents[i].question, &vector);
+
+        if (idx->nonzero_count + vector.count > capacity) {
+            capacity = (idx->nonzero_count + vector.count) * 2;
+            uint16_t* term_ids = realloc(idx->term_ids, sizeof(uint16_t) * capacity);
+            if (term_ids) idx->term_ids = term_ids;
+            IndexWeight* weights = realloc(idx->weights, sizeof(IndexWeight) * capacity);
+            if (weights) idx->weights = weights;
+            if (!term_ids || !weights) return false;
+        }
+
+        for (int j = 0; j < vector.count; j++) {
+            idx->term_ids[idx->nonzero_count] = vector.terms[j].term;
+#if INTENT_WEIGHT_BITS == 8 || INTENT_WEIGHT_BITS == 16
+            idx->weights[idx->nonzero_count] = (IndexWeight)lrintf(vector.terms[j].weight * WEIGHT_SCALE);
+#else
+            idx->weights[idx->nonzero_count] = vector.terms[j].weight;
+#endif
+            idx->nonzero_count++;
+        }
     }
+    idx->row_offsets[idx->intent_count] = (uint32_t)idx->nonzero_count;
+
+    // Drop the growth slack
+    uint16_t* term_ids = realloc(idx->term_ids, sizeof(uint16_t) * (idx->nonzero_count + 1));
+    if (term_ids) idx->term_ids = term_ids;
+    IndexWeight* weights = realloc(idx->weights, sizeof(IndexWeight) * (idx->nonzero_count + 1));
+    if (weights) idx->weights = weights;
     
-    return dot_product / (magnitude1 * magnitude2);
+    size_t index_bytes = sizeof(uint32_t) * (idx->intent_count + 1) +
+                         (sizeof(uint16_t) + sizeof(IndexWeight)) * idx->nonzero_count;
+    log_info("Precomputed TF-IDF vectors for %zu questions (%zu non-zeros, %d-bit weights, %zu bytes)",
+             idx->intent_count, idx->nonzero_count, INTENT_WEIGHT_BITS, index_bytes);
+    return true;
 }
 
-// Precompute TF-IDF vectors for all questions
-static void precompute_question_vectors(void) {
-    g_question_vectors = malloc(sizeof(TFIDFVector) * g_intent_count);
-    
-    for (size_t i = 0; i < g_intent_count; i++) {
-        g_question_vectors[i] = calculate_tfidf_vector(g_intents[i].question);
+// Transpose the CSR rows into per-term posting lists with max weights
+static bool build_postings(IntentIndex* idx) {
+    idx->posting_offsets = calloc(idx->vocabulary_size + 1, sizeof(uint32_t));
+    idx->posting_rows = malloc(sizeof(uint32_t) * (idx->nonzero_count + 1));
+    idx->posting_weights = malloc(sizeof(IndexWeight) * (idx->nonzero_count + 1));
+    idx->term_max_weight = calloc(idx->vocabulary_size + 1, sizeof(IndexWeight));
+    if (!idx->posting_offsets || !idx->posting_rows || !idx->posting_weights || !idx->term_max_weight) {
+        return false;
     }
-    
-    printf("Precomputed TF-IDF vectors for %zu questions\n", g_intent_count);
+
+    for (size_t j = 0; j < idx->nonzero_count; j++) {
+        idx->posting_offsets[idx->term_ids[j] + 1]++;
+    }
+    for (size_t t = 0; t < idx->vocabulary_size; t++) {
+        idx->posting_offsets[t + 1] += idx->posting_offsets[t];
+    }
+
+    // Rows are visited in order, so every posting list comes out sorted
+    uint32_t* fill = malloc(sizeof(uint32_t) * (idx->vocabulary_size + 1));
+    if (!fill) {
+        return false;
+    }
+    memcpy(fill, idx->posting_offsets, sizeof(uint32_t) * (idx->vocabulary_size + 1));
+    for (size_t row = 0; row < idx->intent_count; row++) {
+        for (uint32_t j = idx->row_offsets[row]; j < idx->row_offsets[row + 1]; j++) {
+            uint16_t term = idx->term_ids[j];
+            uint32_t pos = fill[term]++;
+            idx->posting_rows[pos] = (uint32_t)row;
+            idx->posting_weights[pos] = idx->weights[j];
+            if (idx->weights[j] > idx->term_max_weight[term]) {
+                idx->term_max_weight[term] = idx->weights[j];
+            }
+        }
+    }
+    free(fill);
+    return true;
 }
 
-// New similarity function using Cosine similarity with TF-IDF
-static float calculate_similarity(const char* str1, const char* str2) {
-    // Check for exact string match first (case-insensitive)
-    char* temp1 = strdup(str1);
-    char* temp2 = strdup(str2);
-    to_lower(temp1);
-    to_lower(temp2);
-    
-    bool exact_match = (strcmp(temp1, temp2) == 0);
-    free(temp1);
-    free(temp2);
-    
-    if (exact_match) {
-        return 1.0f; // 100% match for exact strings
+// Hash every question case-insensitively for the exact-match check
+static bool build_exact_table(IntentIndex* idx) {
+    size_t size = 16;
+    while (size < idx->intent_count * 2) size <<= 1;
+
+    idx->exact_slots = calloc(size, sizeof(uint32_t));
+    idx->exact_mask = size - 1;
+    if (!idx->exact_slots) {
+        return false;
     }
-    
-    // Calculate TF-IDF vector for input text
-    TFIDFVector input_vector = calculate_tfidf_vector(str1);
-    
-    // Find the corresponding question vector
-    TFIDFVector question_vector;
-    question_vector.tfidf_values = NULL;
-    question_vector.num_words = 0;
-    
-    // Find which question we're comparing against
-    for (size_t i = 0; i < g_intent_count; i++) {
-        if (strcmp(g_intents[i].question, str2) == 0) {
-            question_vector = g_question_vectors[i];
-            break;
+
+    for (size_t row = 0; row < idx->intent_count; row++) {
+        size_t slot = hash_lower(idx->intents[row].question) & idx->exact_mask;
+        bool duplicate = false;
+        while (idx->exact_slots[slot]) {
+            if (strcasecmp(idx->intents[idx->exact_slots[slot] - 1].question, idx->intents[row].question) == 0) {
+                duplicate = true;   // Keep the first row, as a linear scan would
+                break;
+            }
+            slot = (slot + 1) & idx->exact_mask;
+        }
+        if (!duplicate) {
+            idx->exact_slots[slot] = (uint32_t)row + 1;
         }
     }
-    
-    // If we couldn't find precomputed vector, calculate it
-    if (question_vector.tfidf_values == NULL) {
-        question_vector = calculate_tfidf_vector(str2);
+    return true;
+}
+
+// Row whose question equals text ignoring case, or -1
+static long find_exact_row(const IntentIndex* idx, const char* text) {
+    size_t slot = hash_lower(text) & idx->exact_mask;
+    while (idx->exact_slots[slot]) {
+        uint32_t row = idx->exact_slots[slot] - 1;
+        if (strcasecmp(idx->intents[row].question, text) == 0) {
+            return (long)row;
+        }
+        slot = (slot + 1) & idx->exact_mask;
     }
-    
-    // Calculate cosine similarity
-    float similarity = calculate_cosine_similarity(&input_vector, &question_vector);
-    
-    // Clean up input vector
-    if (input_vector.tfidf_values) {
-        free(input_vector.tfidf_values);
+    return -1;
+}
+
+// A (term, group, weight) entry of a centroid, collected before transposing
+typedef struct {
+    uint32_t group;
+    float weight;
+} CentroidEntry;
+
+// Group rows by Intent label and build one L2-normalized centroid per group
+static bool build_intent_groups(IntentIndex* idx) {
+    uint32_t* row_group = malloc(sizeof(uint32_t) * (idx->intent_count + 1));
+    size_t table_size = 16;
+    while (table_size < idx->intent_count * 2) table_size <<= 1;
+    uint32_t* table = calloc(table_size, sizeof(uint32_t));  // label -> first row + 1
+    if (!row_group || !table) {
+        free(row_group);
+        free(table);
+        return false;
     }
-    
-    // If we calculated question vector on the fly, clean it up
-    if (question_vector.tfidf_values != NULL) {
-        bool is_precomputed = false;
-        for (size_t i = 0; i < g_intent_count; i++) {
-            if (question_vector.tfidf_values == g_question_vectors[i].tfidf_values) {
-                is_precomputed = true;
-                break;
+
+    // Assign group ids in order of first appearance
+    idx->group_count = 0;
+    for (size_t row = 0; row < idx->intent_count; row++) {
+        const char* label = idx->intents[row].intent;
+        size_t slot = hash_lower(label) & (table_size - 1);
+        while (table[slot] && strcmp(idx->intents[table[slot] - 1].intent, label) != 0) {
+            slot = (slot + 1) & (table_size - 1);
+        }
+        if (!table[slot]) {
+            table[slot] = (uint32_t)row + 1;
+            row_group[row] = (uint32_t)idx->group_count++;
+        } else {
+            row_group[row] = row_group[table[slot] - 1];
+        }
+    }
+    free(table);
+
+    // Member lists, each in ascending row order
+    idx->group_offsets = calloc(idx->group_count + 1, sizeof(uint32_t));
+    idx->group_rows = malloc(sizeof(uint32_t) * (idx->intent_count + 1));
+    idx->centroid_offsets = calloc(idx->vocabulary_size + 1, sizeof(uint32_t));
+    float* sums = calloc(idx->vocabulary_size + 1, sizeof(float));
+    uint16_t* touched = malloc(sizeof(uint16_t) * (idx->vocabulary_size + 1));
+    CentroidEntry* entries = malloc(sizeof(CentroidEntry) * (idx->nonzero_count + 1));
+    uint16_t* entry_terms = malloc(sizeof(uint16_t) * (idx->nonzero_count + 1));
+    bool ok = idx->group_offsets && idx->group_rows && idx->centroid_offsets &&
+              sums && touched && entries && entry_terms;
+    if (ok) {
+        for (size_t row = 0; row < idx->intent_count; row++) {
+            idx->group_offsets[row_group[row] + 1]++;
+        }
+        for (size_t g = 0; g < idx->group_count; g++) {
+            idx->group_offsets[g + 1] += idx->group_offsets[g];
+        }
+        uint32_t* cursor = malloc(sizeof(uint32_t) * (idx->group_count + 1));
+        ok = cursor != NULL;
+        if (ok) {
+            memcpy(cursor, idx->group_offsets, sizeof(uint32_t) * (idx->group_count + 1));
+            for (size_t row = 0; row < idx->intent_count; row++) {
+                idx->group_rows[cursor[row_group[row]]++] = (uint32_t)row;
             }
+            free(cursor);
         }
-        if (!is_precomputed) {
-            free(question_vector.tfidf_values);
+    }
+
+    // Sum member vectors term by term, normalize, and collect the entries
+    size_t entry_count = 0;
+    for (size_t g = 0; ok && g < idx->group_count; g++) {
+        size_t touched_count = 0;
+        for (uint32_t m = idx->group_offsets[g]; m < idx->group_offsets[g + 1]; m++) {
+            uint32_t row = idx->group_rows[m];
+            for (uint32_t j = idx->row_offsets[row]; j < idx->row_offsets[row + 1]; j++) {
+                uint16_t term = idx->term_ids[j];
+                if (sums[term] == 0.0f) {
+                    touched[touched_count++] = term;
+                }
+                sums[term] += (float)idx->weights[j] / WEIGHT_SCALE;
+            }
+        }
+
+        float norm = 0.0f;
+        for (size_t t = 0; t < touched_count; t++) {
+            norm += sums[touched[t]] * sums[touched[t]];
+        }
+        norm = sqrtf(norm);
+        for (size_t t = 0; t < touched_count; t++) {
+            uint16_t term = touched[t];
+            if (norm > 0.0f) {
+                entry_terms[entry_count] = term;
+                entries[entry_count].group = (uint32_t)g;
+                entries[entry_count].weight = sums[term] / norm;
+                entry_count++;
+                idx->centroid_offsets[term + 1]++;
+            }
+            sums[term] = 0.0f;
         }
     }
-    
-    return similarity;
+
+    // Transpose into per-term postings (groups ascending within each term)
+    if (ok) {
+        for (size_t t = 0; t < idx->vocabulary_size; t++) {
+            idx->centroid_offsets[t + 1] += idx->centroid_offsets[t];
+        }
+        idx->centroid_groups = malloc(sizeof(uint32_t) * (entry_count + 1));
+        idx->centroid_weights = malloc(sizeof(float) * (entry_count + 1));
+        uint32_t* cursor = malloc(sizeof(uint32_t) * (idx->vocabulary_size + 1));
+        ok = idx->centroid_groups && idx->centroid_weights && cursor;
+        if (ok) {
+            memcpy(cursor, idx->centroid_offsets, sizeof(uint32_t) * (idx->vocabulary_size + 1));
+            for (size_t e = 0; e < entry_count; e++) {
+                uint32_t pos = cursor[entry_terms[e]]++;
+                idx->centroid_groups[pos] = entries[e].group;
+                idx->centroid_weights[pos] = entries[e].weight;
+            }
+        }
+        free(cursor);
+    }
+
+    free(row_group);
+    free(sums);
+    free(touched);
+    free(entries);
+    free(entry_terms);
+    if (ok) {
+        log_info("Grouped questions into %zu intents", idx->group_count);
+    }
+    return ok;
+}
+
+// Preallocate the scratch slots, each large enough for a query returning up
+// to INTENT_QUERY_MAX_K matches with a typical fanout
+static bool build_query_scratch(IntentIndex* idx) {
+    size_t pool = INTENT_QUERY_MAX_K + EMBEDDING_CANDIDATES;
+    size_t bytes = sizeof(ScoredRow) * INTENT_QUERY_MAX_K +                 // Result heap
+                   sizeof(float) * idx->group_count +                       // Two-stage group scores
+                   sizeof(ScoredRow) * INTENT_GROUP_FANOUT_TYPICAL +        // and best groups
+                   (sizeof(ScoredRow) + sizeof(EmbeddingHit)) * pool +      // Fusion candidates
+                   ARENA_ALIGNMENT * 4;
+
+    idx->scratch = calloc(INTENT_QUERY_SCRATCH_SLOTS, sizeof(QueryScratch));
+    if (!idx->scratch) {
+        return false;
+    }
+    for (size_t i = 0; i < INTENT_QUERY_SCRATCH_SLOTS; i++) {
+        atomic_flag_clear(&idx->scratch[i].busy);
+        if (!arena_init(&idx->scratch[i].arena, bytes)) {
+            return false;
+        }
+    }
+    return true;
 }
 
 // Helper function to parse a CSV line properly handling quoted fields
@@ -355,18 +1060,96 @@ static bool parse_csv_line(char* line, char* fields[], int max_fields, int* num_
     return *num_fields > 0;
 }
 
-bool initialize_intent_processor(void) {
-    FILE* file = fopen("data/Intents.csv", "r");
+// Bytes held by a snapshot: every array at its allocated size, the
+// scratch slots and the mapped embedding index
+static size_t intent_index_bytes(const IntentIndex* idx) {
+    size_t vocabulary = idx->vocabulary_size + 1;
+    size_t nonzeros = idx->nonzero_count + 1;
+    size_t centroid_entries = idx->centroid_offsets ? idx->centroid_offsets[idx->vocabulary_size] + 1 : 0;
+    size_t bytes = sizeof(IntentIndex) +
+                   sizeof(IntentEntry) * idx->intent_count +
+                   sizeof(VocabularyEntry) * vocabulary +
+                   sizeof(uint32_t) * (idx->intent_count + 1) +                     // row_offsets
+                   (sizeof(uint16_t) + sizeof(IndexWeight)) * nonzeros +            // CSR rows
+                   sizeof(uint32_t) * vocabulary +                                  // posting_offsets
+                   (sizeof(uint32_t) + sizeof(IndexWeight)) * nonzeros +            // postings
+                   sizeof(IndexWeight) * vocabulary +                               // term_max_weight
+                   sizeof(uint32_t) * (idx->exact_slots ? idx->exact_mask + 1 : 0) +
+                   sizeof(uint32_t) * (idx->stem_slots ? idx->stem_mask + 1 : 0) +
+                   sizeof(DeletionBucket) * (idx->deletion_buckets ? idx->deletion_mask + 1 : 0) +
+                   sizeof(uint16_t) * (idx->deletion_terms ? idx->deletion_term_count + 1 : 0) +
+                   sizeof(uint32_t) * (idx->group_count + 1 + idx->intent_count + 1) +  // groups
+                   sizeof(uint32_t) * vocabulary +                                  // centroid_offsets
+                   (sizeof(uint32_t) + sizeof(float)) * centroid_entries +
+                   embedding_index_bytes(idx->embeddings);
+
+    if (idx->scratch) {
+        bytes += sizeof(QueryScratch) * INTENT_QUERY_SCRATCH_SLOTS;
+        for (size_t i = 0; i < INTENT_QUERY_SCRATCH_SLOTS; i++) {
+            bytes += idx->scratch[i].arena.size;
+        }
+    }
+    return bytes;
+}
+
+static void free_intent_index(IntentIndex* idx) {
+    if (!idx) {
+        return;
+    }
+    
+    memory_release(MEMORY_INTENTS, idx->bytes);
+
+    if (idx->scratch) {
+        for (size_t i = 0; i < INTENT_QUERY_SCRATCH_SLOTS; i++) {
+            arena_release(&idx->scratch[i].arena);
+        }
+        free(idx->scratch);
+    }
+    free(idx->intents);
+    free(idx->vocabulary);
+    free(idx->row_offsets);
+    free(idx->term_ids);
+    free(idx->weights);
+    free(idx->posting_offsets);
+    free(idx->posting_rows);
+    free(idx->posting_weights);
+    free(idx->term_max_weight);
+    free(idx->exact_slots);
+    free(idx->stem_slots);
+    free(idx->deletion_buckets);
+    free(idx->deletion_terms);
+    free(idx->group_offsets);
+    free(idx->group_rows);
+    free(idx->centroid_offsets);
+    free(idx->centroid_groups);
+    free(idx->centroid_weights);
+    free_embedding_index(idx->embeddings);
+    
+    free(idx);
+}
+
+// Load the CSV at path and build a complete snapshot from it
+static IntentIndex* load_intent_index(const IntentProcessor* ip) {
+    const char* path = ip->csv_path;
+    FILE* file = fopen(path, "r");
     if (!file) {
-        fprintf(stderr, "Failed to open Intents.csv\n");
-        return false;
+        log_error("Failed to open %s", path);
+        return NULL;
     }
 
-    // Allocate memory for intents
-    g_intents = malloc(sizeof(IntentEntry) * MAX_INTENTS);
-    if (!g_intents) {
+    IntentIndex* idx = calloc(1, sizeof(IntentIndex));
+    if (!idx) {
         fclose(file);
-        return false;
+        return NULL;
+    }
+
+    // Allocate memory for intents, grown as rows are read
+    size_t intent_capacity = 256;
+    idx->intents = calloc(intent_capacity, sizeof(IntentEntry));
+    if (!idx->intents) {
+        fclose(file);
+        free(idx);
+        return NULL;
     }
 
     char line[MAX_QUESTION_LENGTH + MAX_ANSWER_LENGTH + MAX_INTENT_LENGTH + 3];
@@ -374,10 +1157,15 @@ bool initialize_intent_processor(void) {
     int num_fields;
     
     // Skip header line
-    fgets(line, sizeof(line), file);
+    if (!fgets(line, sizeof(line), file)) {
+        log_error("%s is empty", path);
+        fclose(file);
+        free_intent_index(idx);
+        return NULL;
+    }
     
     // Read entries
-    while (fgets(line, sizeof(line), file) && g_intent_count < MAX_INTENTS) {
+    while (fgets(line, sizeof(line), file) && idx->intent_count < MAX_INTENTS) {
         // Remove newline if present
         size_t len = strlen(line);
         if (len > 0 && line[len-1] == '\n') {
@@ -385,139 +1173,673 @@ bool initialize_intent_processor(void) {
         }
         
         if (parse_csv_line(line, fields, 3, &num_fields) && num_fields == 3) {
-            strncpy(g_intents[g_intent_count].question, trim(fields[0]), MAX_QUESTION_LENGTH - 1);
-            strncpy(g_intents[g_intent_count].answer, trim(fields[1]), MAX_ANSWER_LENGTH - 1);
-            strncpy(g_intents[g_intent_count].intent, trim(fields[2]), MAX_INTENT_LENGTH - 1);
+            if (idx->intent_count == intent_capacity) {
+                IntentEntry* grown = realloc(idx->intents, sizeof(IntentEntry) * intent_capacity * 2);
+                if (!grown) {
+                    break;
+                }
+                memset(grown + intent_capacity, 0, sizeof(IntentEntry) * intent_capacity);
+                idx->intents = grown;
+                intent_capacity *= 2;
+            }
+            strncpy(idx->intents[idx->intent_count].question, trim(fields[0]), MAX_QUESTION_LENGTH - 1);
+            strncpy(idx->intents[idx->intent_count].answer, trim(fields[1]), MAX_ANSWER_LENGTH - 1);
+            strncpy(idx->intents[idx->intent_count].intent, trim(fields[2]), MAX_INTENT_LENGTH - 1);
             
             // Note: We don't convert to lowercase here since TF-IDF handles case normalization
-            g_intent_count++;
+            idx->intent_count++;
         }
     }
 
     fclose(file);
+
+    // The table grows by doubling; give back the unused rows
+    if (idx->intent_count > 0 && idx->intent_count < intent_capacity) {
+        IntentEntry* used = realloc(idx->intents, sizeof(IntentEntry) * idx->intent_count);
+        if (used) {
+            idx->intents = used;
+        }
+    }
     
     // Build vocabulary and precompute TF-IDF vectors
-    printf("Initializing Cosine similarity with TF-IDF...\n");
-    build_vocabulary();
-    precompute_question_vectors();
-    printf("Intent processor initialized with %zu questions\n", g_intent_count);
+    log_info("Initializing Cosine similarity with TF-IDF...");
+    build_vocabulary(idx);
+    if (!idx->vocabulary || !build_fuzzy_terms(idx) || !precompute_question_vectors(idx) ||
+        !build_postings(idx) || !build_exact_table(idx) || !build_intent_groups(idx) || !build_query_scratch(idx)) {
+        log_error("Out of memory building the intent index");
+        free_intent_index(idx);
+        return NULL;
+    }
+
+    // Attach the offline embeddings if they were built from this CSV
+    if (ip->word_vectors) {
+        char embeddings_path[1024];
+        uint64_t fingerprint = EMBEDDING_FINGERPRINT_SEED;
+        for (size_t i = 0; i < idx->intent_count; i++) {
+            fingerprint = embedding_fingerprint(fingerprint, idx->intents[i].question);
+        }
+        snprintf(embeddings_path, sizeof(embeddings_path), "%s/%s", ip->csv_dir, EMBEDDING_INDEX_FILE);
+        idx->embeddings = load_embedding_index(embeddings_path, ip->word_vectors,
+                                               idx->intent_count, fingerprint);
+    }
+
+    // A reload is refused if both snapshots would not fit in the budget
+    size_t bytes = intent_index_bytes(idx);
+    if (!memory_reserve(MEMORY_INTENTS, bytes)) {
+        MemoryUsage usage;
+        get_memory_usage(MEMORY_INTENTS, &usage);
+        log_error("The intent index needs %zu KB, which exceeds the %zu KB budget (%zu KB in use)",
+                  bytes >> 10, usage.budget >> 10, usage.current >> 10);
+        free_intent_index(idx);
+        return NULL;
+    }
+    idx->bytes = bytes;
+    log_info("Intent index uses %zu KB", bytes >> 10);
     
-    return true;
+    return idx;
+}
+
+unsigned int intent_read_lock(IntentProcessor* ip) {
+    unsigned int slot = atomic_load(&ip->read_epoch) & 1;
+    atomic_fetch_add(&ip->active_readers[slot], 1);
+    return slot;
 }
 
-void cleanup_intent_processor(void) {
-    if (g_intents) {
-        free(g_intents);
-        g_intents = NULL;
+void intent_read_unlock(IntentProcessor* ip, unsigned int token) {
+    atomic_fetch_sub(&ip->active_readers[token], 1);
+}
+
+// Wait until every reader that could have seen the previously published
+// snapshot has left its read-side section. Readers never wait on this.
+static void synchronize_readers(IntentProcessor* ip) {
+    for (int phase = 0; phase < 2; phase++) {
+        unsigned int old_slot = atomic_fetch_add(&ip->read_epoch, 1) & 1;
+        while (atomic_load(&ip->active_readers[old_slot]) != 0) {
+            struct timespec pause = {0, 1000000};  // 1 ms
+            nanosleep(&pause, NULL);
+        }
     }
-    
-    if (g_vocabulary) {
-        free(g_vocabulary);
-        g_vocabulary = NULL;
+}
+
+// Publish next as the current snapshot and reclaim the old one
+static void publish_intent_index(IntentProcessor* ip, IntentIndex* next) {
+    pthread_mutex_lock(&ip->publish_lock);
+    IntentIndex* old = atomic_exchange(&ip->index, next);
+    synchronize_readers(ip);
+    free_intent_index(old);
+    pthread_mutex_unlock(&ip->publish_lock);
+}
+
+bool reload_intents(IntentProcessor* ip) {
+    IntentIndex* next = load_intent_index(ip);
+    if (!next) {
+        log_warn("Keeping previous intents after failed reload");
+        return false;
     }
-    
-    if (g_question_vectors) {
-        for (size_t i = 0; i < g_intent_count; i++) {
-            if (g_question_vectors[i].tfidf_values) {
-                free(g_question_vectors[i].tfidf_values);
+    if (next->intent_count == 0) {
+        log_warn("Reloaded %s has no valid rows, keeping previous intents", ip->csv_path);
+        free_intent_index(next);
+        return false;
+    }
+
+    // A concurrent reload may retire and free next as soon as it is published
+    size_t intent_count = next->intent_count;
+    publish_intent_index(ip, next);
+    log_info("Intent processor reloaded with %zu questions", intent_count);
+    return true;
+}
+
+// Background thread: rebuild the index whenever Intents.csv is rewritten.
+// Editors often replace the file via rename, so the directory is watched.
+static void* intent_watch_thread(void* arg) {
+    IntentProcessor* ip = arg;
+    int inotify_fd = ip->watch_inotify_fd;
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd fds[2] = {
+        { .fd = inotify_fd, .events = POLLIN },
+        { .fd = ip->watch_stop_pipe[0], .events = POLLIN },
+    };
+
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents) {
+            break;
+        }
+
+        bool changed = false;
+        ssize_t len = read(inotify_fd, events, sizeof(events));
+        for (char* p = events; len > 0 && p < events + len; ) {
+            struct inotify_event* event = (struct inotify_event*)p;
+            if (event->len > 0 && (strcmp(event->name, ip->csv_file) == 0 ||
+                                   strcmp(event->name, EMBEDDING_INDEX_FILE) == 0)) {
+                changed = true;
             }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+
+        if (changed) {
+            // Let a burst of writes settle, then drop the events it produced
+            struct timespec settle = {0, INTENT_RELOAD_SETTLE_MS * 1000000L};
+            nanosleep(&settle, NULL);
+            while (poll(fds, 1, 0) > 0 && read(inotify_fd, events, sizeof(events)) > 0) {
+            }
+            log_info("Intent data in %s/ changed, rebuilding intent index...", ip->csv_dir);
+            reload_intents(ip);
         }
-        free(g_question_vectors);
-        g_question_vectors = NULL;
     }
-    
-    g_intent_count = 0;
-    g_vocabulary_size = 0;
+
+    close(inotify_fd);
+    return NULL;
 }
 
-const char* find_matching_answer(const char* text) {
-    if (!text || !g_intents) return NULL;
-    
-    float best_similarity = 0;
-    size_t best_match_index = 0;
-    bool found_match = false;
-    bool found_exact_match = false;
-    
-    printf("\nAnalyzing matches using Cosine similarity...\n");
-    printf("Your question: \"%s\"\n", text);
-    printf("\nTop matching questions:\n");
-    printf("----------------------------------------\n");
-    
-    // Store top 3 matches
-    struct {
-        float similarity;
-        size_t index;
-    } top_matches[3] = {{0,0}, {0,0}, {0,0}};
-    
-    // First pass: look for exact matches (ignoring case)
-    char* lower_text = strdup(text);
-    to_lower(lower_text);
+static void start_intent_watcher(IntentProcessor* ip) {
+    int inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (inotify_fd < 0) {
+        log_warn("Cannot watch %s for changes: %s", ip->csv_path, strerror(errno));
+        return;
+    }
+    if (inotify_add_watch(inotify_fd, ip->csv_dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0 ||
+        pipe2(ip->watch_stop_pipe, O_CLOEXEC) < 0) {
+        log_warn("Cannot watch %s for changes: %s", ip->csv_path, strerror(errno));
+        close(inotify_fd);
+        return;
+    }
+    ip->watch_inotify_fd = inotify_fd;
+    if (pthread_create(&ip->watch_thread, NULL, intent_watch_thread, ip) != 0) {
+        close(inotify_fd);
+        close(ip->watch_stop_pipe[0]);
+        close(ip->watch_stop_pipe[1]);
+        return;
+    }
+    ip->watch_running = true;
+}
+
+static void stop_intent_watcher(IntentProcessor* ip) {
+    if (!ip->watch_running) {
+        return;
+    }
+    if (write(ip->watch_stop_pipe[1], "x", 1) < 0) {
+        pthread_cancel(ip->watch_thread);
+    }
+    pthread_join(ip->watch_thread, NULL);
+    close(ip->watch_stop_pipe[0]);
+    close(ip->watch_stop_pipe[1]);
+    ip->watch_running = false;
+}
+
+IntentProcessor* initialize_intent_processor(const char* csv_path) {
+    IntentProcessor* ip = calloc(1, sizeof(IntentProcessor));
+    if (!ip) {
+        return NULL;
+    }
+
+    // Split the path: the directory is watched and holds the embedding files
+    snprintf(ip->csv_path, sizeof(ip->csv_path), "%s", csv_path ? csv_path : INTENTS_CSV_PATH);
+    snprintf(ip->csv_dir, sizeof(ip->csv_dir), "%s", ip->csv_path);
+    char* slash = strrchr(ip->csv_dir, '/');
+    if (slash) {
+        *slash = '\0';
+        ip->csv_file = ip->csv_path + (slash - ip->csv_dir) + 1;
+    } else {
+        strcpy(ip->csv_dir, ".");
+        ip->csv_file = ip->csv_path;
+    }
+    pthread_mutex_init(&ip->publish_lock, NULL);
+    atomic_init(&ip->group_fanout, INTENT_GROUP_FANOUT);
+    atomic_init(&ip->min_similarity, INTENT_MIN_SIMILARITY);
+
+    char model_path[1024];
+    snprintf(model_path, sizeof(model_path), "%s/%s", ip->csv_dir, EMBEDDING_MODEL_FILE);
+    ip->word_vectors = load_word_vectors(model_path);
+    memory_charge(MEMORY_INTENTS, word_vectors_bytes(ip->word_vectors));
+
+    IntentIndex* idx = load_intent_index(ip);
+    if (!idx) {
+        memory_release(MEMORY_INTENTS, word_vectors_bytes(ip->word_vectors));
+        free_word_vectors(ip->word_vectors);
+        pthread_mutex_destroy(&ip->publish_lock);
+        free(ip);
+        return NULL;
+    }
+
+    publish_intent_index(ip, idx);
+    log_info("Intent processor initialized with %zu questions", idx->intent_count);
+
+    if (INTENT_HOT_RELOAD) {
+        start_intent_watcher(ip);
+    }
     
-    for (size_t i = 0; i < g_intent_count; i++) {
-        char* lower_question = strdup(g_intents[i].question);
-        to_lower(lower_question);
-        
-        if (strcmp(lower_text, lower_question) == 0) {
-            best_similarity = 1.0;
-            best_match_index = i;
-            found_match = true;
-            found_exact_match = true;
-            free(lower_question);
-            break;
+    return ip;
+}
+
+void cleanup_intent_processor(IntentProcessor* ip) {
+    if (!ip) return;
+    stop_intent_watcher(ip);
+    publish_intent_index(ip, NULL);
+    memory_release(MEMORY_INTENTS, word_vectors_bytes(ip->word_vectors));
+    free_word_vectors(ip->word_vectors);
+    pthread_mutex_destroy(&ip->publish_lock);
+    free(ip);
+}
+
+size_t get_intent_count(IntentProcessor* ip) {
+    const IntentIndex* idx = atomic_load(&ip->index);
+    return idx ? idx->intent_count : 0;
+}
+
+const IntentEntry* get_intent_entry(IntentProcessor* ip, size_t index) {
+    const IntentIndex* idx = atomic_load(&ip->index);
+    return idx && index < idx->intent_count ? &idx->intents[index] : NULL;
+}
+
+// Check out a free scratch slot, or NULL if all are in use
+static Arena* acquire_scratch(const IntentIndex* idx) {
+    for (size_t i = 0; i < INTENT_QUERY_SCRATCH_SLOTS; i++) {
+        if (!atomic_flag_test_and_set_explicit(&idx->scratch[i].busy, memory_order_acquire)) {
+            arena_reset(&idx->scratch[i].arena);
+            return &idx->scratch[i].arena;
         }
-        free(lower_question);
     }
-    
-    free(lower_text);
-    
-    // If no exact match, do cosine similarity matching
-    if (!found_exact_match) {
-        for (size_t i = 0; i < g_intent_count; i++) {
-            float similarity = calculate_similarity(text, g_intents[i].question);
-            
-            // Update best overall match
-            if (similarity > best_similarity) {
-                best_similarity = similarity;
-                best_match_index = i;
-                found_match = true;
+    return NULL;
+}
+
+static void release_scratch(Arena* arena) {
+    if (arena) {
+        QueryScratch* slot = (QueryScratch*)((char*)arena - offsetof(QueryScratch, arena));
+        atomic_flag_clear_explicit(&slot->busy, memory_order_release);
+    }
+}
+
+// Scratch memory from the query's arena, or the heap once that is exhausted
+static void* scratch_alloc(Arena* arena, size_t bytes) {
+    void* block = arena_alloc(arena, bytes);
+    return block ? block : malloc(bytes);
+}
+
+static void scratch_free(Arena* arena, void* block) {
+    if (!arena_owns(arena, block)) {
+        free(block);
+    }
+}
+
+// Ranking order: higher score first, earlier row first on ties
+static bool ranks_before(const ScoredRow* a, const ScoredRow* b) {
+    return a->score > b->score || (a->score == b->score && a->row < b->row);
+}
+
+static int compare_scored_rows(const void* a, const void* b) {
+    return ranks_before(a, b) ? -1 : (ranks_before(b, a) ? 1 : 0);
+}
+
+// Min-heap on ranking order: heap[0] is the weakest of the current top k
+static void heap_sift_down(ScoredRow* heap, size_t count, size_t i) {
+    for (;;) {
+        size_t weakest = i;
+        size_t left = 2 * i + 1, right = 2 * i + 2;
+        if (left < count && ranks_before(&heap[weakest], &heap[left])) weakest = left;
+        if (right < count && ranks_before(&heap[weakest], &heap[right])) weakest = right;
+        if (weakest == i) return;
+        ScoredRow tmp = heap[i];
+        heap[i] = heap[weakest];
+        heap[weakest] = tmp;
+        i = weakest;
+    }
+}
+
+static void heap_offer(ScoredRow* heap, size_t* count, size_t k, ScoredRow candidate) {
+    if (*count < k) {
+        size_t i = (*count)++;
+        heap[i] = candidate;
+        while (i > 0 && ranks_before(&heap[(i - 1) / 2], &heap[i])) {
+            ScoredRow tmp = heap[i];
+            heap[i] = heap[(i - 1) / 2];
+            heap[(i - 1) / 2] = tmp;
+            i = (i - 1) / 2;
+        }
+    } else if (ranks_before(&candidate, &heap[0])) {
+        heap[0] = candidate;
+        heap_sift_down(heap, *count, 0);
+    }
+}
+
+// Score every question (reference path)
+static size_t search_exhaustive(const IntentIndex* idx, const TFIDFVector* query, long exact_row,
+                                ScoredRow* heap, size_t k) {
+    size_t count = 0;
+    for (size_t i = 0; i < idx->intent_count; i++) {
+        bool exact = (long)i == exact_row;
+        float similarity = exact ? 1.0f : calculate_cosine_similarity(idx, query, i);
+        if (similarity > 0.0f) {
+            heap_offer(heap, &count, k, (ScoredRow){ similarity, (uint32_t)i, exact });
+        }
+    }
+    return count;
+}
+
+// Posting list cursor for one query term
+typedef struct {
+    const uint32_t* rows;
+    const IndexWeight* weights;
+    uint32_t pos;
+    uint32_t len;
+    float query_weight;
+    float upper_bound;      // query_weight * max weight in the list
+} TermCursor;
+
+static int compare_cursor_bounds(const void* a, const void* b) {
+    float x = ((const TermCursor*)a)->upper_bound, y = ((const TermCursor*)b)->upper_bound;
+    return (x > y) - (x < y);
+}
+
+// Advance a cursor to the first row >= row (galloping then binary search)
+static void cursor_seek(TermCursor* c, uint32_t row) {
+    uint32_t lo = c->pos, step = 1, hi = c->pos;
+    while (hi < c->len && c->rows[hi] < row) {
+        lo = hi + 1;
+        hi += step;
+        step <<= 1;
+    }
+    if (hi > c->len) hi = c->len;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (c->rows[mid] < row) lo = mid + 1; else hi = mid;
+    }
+    c->pos = lo;
+}
+
+// Document-at-a-time MaxScore: terms are ordered by score upper bound and
+// split into essential terms (which drive candidate generation) and
+// non-essential ones whose bounds together cannot beat the k-th score.
+// Surviving candidates are scored exactly, so results match search_exhaustive.
+static size_t search_maxscore(const IntentIndex* idx, const TFIDFVector* query, long exact_row,
+                              ScoredRow* heap, size_t k) {
+    TermCursor cursors[MAX_WORDS_PER_QUESTION];
+    float prefix_bound[MAX_WORDS_PER_QUESTION];  // Sum of bounds of cursors[0..i]
+    int n = 0;
+    size_t count = 0;
+
+    // The exact match is always a candidate, whatever its terms
+    if (exact_row >= 0) {
+        heap_offer(heap, &count, k, (ScoredRow){ 1.0f, (uint32_t)exact_row, true });
+    }
+
+    for (int q = 0; q < query->count; q++) {
+        uint16_t term = query->terms[q].term;
+        uint32_t start = idx->posting_offsets[term];
+        cursors[n].rows = idx->posting_rows + start;
+        cursors[n].weights = idx->posting_weights + start;
+        cursors[n].pos = 0;
+        cursors[n].len = idx->posting_offsets[term + 1] - start;
+        cursors[n].query_weight = query->terms[q].weight;
+        cursors[n].upper_bound = query->terms[q].weight * (float)idx->term_max_weight[term] / WEIGHT_SCALE;
+        if (cursors[n].len > 0) n++;
+    }
+    qsort(cursors, n, sizeof(TermCursor), compare_cursor_bounds);
+    for (int i = 0; i < n; i++) {
+        prefix_bound[i] = cursors[i].upper_bound + (i > 0 ? prefix_bound[i - 1] : 0.0f) + MAXSCORE_EPSILON;
+    }
+
+    int first_essential = 0;
+    for (;;) {
+        // Only questions scoring above the current k-th entry can change the result
+        float threshold = count == k ? heap[0].score : 0.0f;
+        while (count == k && first_essential < n && prefix_bound[first_essential] <= threshold) {
+            first_essential++;
+        }
+        if (first_essential >= n) {
+            break;
+        }
+
+        // Next candidate: smallest current row among essential terms
+        uint32_t row = UINT32_MAX;
+        for (int i = first_essential; i < n; i++) {
+            if (cursors[i].pos < cursors[i].len && cursors[i].rows[cursors[i].pos] < row) {
+                row = cursors[i].rows[cursors[i].pos];
             }
+        }
+        if (row == UINT32_MAX) {
+            break;
+        }
 
-            // Update top 3 matches
-            for (int j = 0; j < 3; j++) {
-                if (similarity > top_matches[j].similarity) {
-                    // Shift lower matches down
-                    for (int k = 2; k > j; k--) {
-                        top_matches[k] = top_matches[k-1];
-                    }
-                    top_matches[j].similarity = similarity;
-                    top_matches[j].index = i;
-                    break;
-                }
+        float score = 0.0f;
+        for (int i = first_essential; i < n; i++) {
+            TermCursor* c = &cursors[i];
+            if (c->pos < c->len && c->rows[c->pos] == row) {
+                score += c->query_weight * (float)c->weights[c->pos] / WEIGHT_SCALE;
+                c->pos++;
+            }
+        }
+
+        // Add non-essential terms, strongest first, while the bound still allows entry
+        bool pruned = false;
+        for (int i = first_essential - 1; i >= 0; i--) {
+            if (count == k && score + prefix_bound[i] <= threshold) {
+                pruned = true;
+                break;
+            }
+            TermCursor* c = &cursors[i];
+            cursor_seek(c, row);
+            if (c->pos < c->len && c->rows[c->pos] == row) {
+                score += c->query_weight * (float)c->weights[c->pos] / WEIGHT_SCALE;
+            }
+        }
+
+        if (!pruned && (long)row != exact_row) {
+            float similarity = calculate_cosine_similarity(idx, query, row);
+            if (similarity > 0.0f) {
+                heap_offer(heap, &count, k, (ScoredRow){ similarity, row, false });
+            }
+        }
+    }
+
+    return count;
+}
+
+// Two-stage retrieval: rank intent centroids by cosine with the query, then
+// score only the questions that belong to the best fanout intents
+static size_t search_two_stage(const IntentIndex* idx, const TFIDFVector* query, long exact_row,
+                               size_t fanout, Arena* arena, ScoredRow* heap, size_t k) {
+    size_t count = 0;
+    float* group_scores = scratch_alloc(arena, sizeof(float) * idx->group_count);
+    ScoredRow* best_groups = scratch_alloc(arena, sizeof(ScoredRow) * fanout);
+    if (!group_scores || !best_groups) {
+        scratch_free(arena, group_scores);
+        scratch_free(arena, best_groups);
+        return search_maxscore(idx, query, exact_row, heap, k);
+    }
+    memset(group_scores, 0, sizeof(float) * idx->group_count);
+
+    // Stage 1: accumulate centroid scores term at a time
+    for (int q = 0; q < query->count; q++) {
+        uint16_t term = query->terms[q].term;
+        for (uint32_t p = idx->centroid_offsets[term]; p < idx->centroid_offsets[term + 1]; p++) {
+            group_scores[idx->centroid_groups[p]] += query->terms[q].weight * idx->centroid_weights[p];
+        }
+    }
+    size_t group_hits = 0;
+    for (size_t g = 0; g < idx->group_count; g++) {
+        if (group_scores[g] > 0.0f) {
+            heap_offer(best_groups, &group_hits, fanout, (ScoredRow){ group_scores[g], (uint32_t)g, false });
+        }
+    }
+
+    // Stage 2: exact question scores within the selected intents
+    if (exact_row >= 0) {
+        heap_offer(heap, &count, k, (ScoredRow){ 1.0f, (uint32_t)exact_row, true });
+    }
+    for (size_t i = 0; i < group_hits; i++) {
+        uint32_t g = best_groups[i].row;
+        for (uint32_t m = idx->group_offsets[g]; m < idx->group_offsets[g + 1]; m++) {
+            uint32_t row = idx->group_rows[m];
+            if ((long)row == exact_row) continue;
+            float similarity = calculate_cosine_similarity(idx, query, row);
+            if (similarity > 0.0f) {
+                heap_offer(heap, &count, k, (ScoredRow){ similarity, row, false });
             }
         }
     }
+
+    scratch_free(arena, group_scores);
+    scratch_free(arena, best_groups);
+    return count;
+}
+
+// TF-IDF candidates: two-stage on large grouped tables, else MaxScore
+static size_t search_lexical(const IntentIndex* idx, const TFIDFVector* query, long exact_row,
+                             size_t fanout, Arena* arena, ScoredRow* heap, size_t k) {
+    if (fanout > 0 && fanout < idx->group_count && idx->intent_count >= INTENT_GROUP_MIN_QUESTIONS) {
+        return search_two_stage(idx, query, exact_row, fanout, arena, heap, k);
+    }
+    if (INTENT_RETRIEVAL_MAXSCORE) {
+        return search_maxscore(idx, query, exact_row, heap, k);
+    }
+    return search_exhaustive(idx, query, exact_row, heap, k);
+}
+
+// Fuse TF-IDF and embedding cosine over the union of both matchers'
+// candidates, so paraphrases with no shared terms can still be found
+static size_t search_fused(const IntentIndex* idx, const TFIDFVector* query,
+                           const QueryEmbedding* embedding, long exact_row,
+                           size_t fanout, Arena* arena, ScoredRow* heap, size_t k) {
+    size_t pool = k + EMBEDDING_CANDIDATES;
+    ScoredRow* lexical = scratch_alloc(arena, sizeof(ScoredRow) * pool);
+    EmbeddingHit* semantic = scratch_alloc(arena, sizeof(EmbeddingHit) * pool);
+    if (!lexical || !semantic) {
+        scratch_free(arena, lexical);
+        scratch_free(arena, semantic);
+        return search_lexical(idx, query, exact_row, fanout, arena, heap, k);
+    }
+
+    size_t lexical_count = search_lexical(idx, query, exact_row, fanout, arena, lexical, pool);
+    size_t semantic_count = embedding_search(idx->embeddings, embedding, EMBEDDING_NPROBE, semantic, pool);
+    const float w = EMBEDDING_FUSION_WEIGHT;
+    size_t count = 0;
+
+    for (size_t i = 0; i < lexical_count; i++) {
+        ScoredRow candidate = lexical[i];
+        if (!candidate.exact) {
+            float cosine = embedding_similarity(idx->embeddings, embedding, candidate.row);
+            candidate.score = (1.0f - w) * candidate.score + w * fmaxf(cosine, 0.0f);
+        }
+        heap_offer(heap, &count, k, candidate);
+    }
+    for (size_t i = 0; i < semantic_count; i++) {
+        bool seen = false;
+        for (size_t j = 0; j < lexical_count && !seen; j++) {
+            seen = lexical[j].row == semantic[i].row;
+        }
+        if (seen || semantic[i].similarity <= 0.0f) {
+            continue;
+        }
+        float score = (1.0f - w) * calculate_cosine_similarity(idx, query, semantic[i].row) +
+                      w * semantic[i].similarity;
+        heap_offer(heap, &count, k, (ScoredRow){ score, semantic[i].row, false });
+    }
+
+    scratch_free(arena, lexical);
+    scratch_free(arena, semantic);
+    return count;
+}
+
+void set_intent_group_fanout(IntentProcessor* ip, size_t fanout) {
+    atomic_store(&ip->group_fanout, fanout);
+}
+
+void set_intent_min_similarity(IntentProcessor* ip, float similarity) {
+    atomic_store(&ip->min_similarity, similarity);
+}
+
+size_t find_top_matches(IntentProcessor* ip, const char* text, IntentMatch* matches, size_t k) {
+    if (!ip || !text || !matches || k == 0) return 0;
+
+    unsigned int token = intent_read_lock(ip);
+    const IntentIndex* idx = atomic_load(&ip->index);
+    if (!idx) {
+        intent_read_unlock(ip, token);
+        return 0;
+    }
+
+    TFIDFVector input_vector;
+    calculate_tfidf_vector(idx, text, &input_vector);
+
+    // Exact string match first (case-insensitive), otherwise TF-IDF cosine
+    long exact_row = find_exact_row(idx, text);
+
+    Arena* arena = acquire_scratch(idx);
+    ScoredRow* heap = scratch_alloc(arena, sizeof(ScoredRow) * k);
+    if (!heap) {
+        release_scratch(arena);
+        intent_read_unlock(ip, token);
+        return 0;
+    }
+    size_t fanout = atomic_load(&ip->group_fanout);
+    QueryEmbedding embedding;
+    size_t count;
+    if (idx->embeddings && encode_query(idx->embeddings, text, &embedding)) {
+        count = search_fused(idx, &input_vector, &embedding, exact_row, fanout, arena, heap, k);
+    } else {
+        count = search_lexical(idx, &input_vector, exact_row, fanout, arena, heap, k);
+    }
+    qsort(heap, count, sizeof(ScoredRow), compare_scored_rows);
+
+    for (size_t i = 0; i < count; i++) {
+        matches[i].index = heap[i].row;
+        matches[i].similarity = heap[i].score;
+        matches[i].exact = heap[i].exact;
+        matches[i].entry = &idx->intents[heap[i].row];
+    }
+
+    scratch_free(arena, heap);
+    release_scratch(arena);
+    intent_read_unlock(ip, token);
+    return count;
+}
+
+bool intent_match_accepted(IntentProcessor* ip, const IntentMatch* match) {
+    return match->exact || match->similarity >= atomic_load(&ip->min_similarity);
+}
+
+const char* find_matching_answer(IntentProcessor* ip, const char* text, char* answer, size_t answer_size) {
+    if (!ip || !text || !answer || answer_size == 0) return NULL;
     
-    // Show top 3 matches if they're above minimum threshold
-    for (int i = 0; i < 3; i++) {
+    float min_similarity = atomic_load(&ip->min_similarity);
+    log_debug("Matching \"%s\"", text);
+    
+    // Store top 3 matches
+    IntentMatch top_matches[3];
+    unsigned int token = intent_read_lock(ip);
+    size_t match_count = find_top_matches(ip, text, top_matches, 3);
+    
+    // Log top 3 matches if they're above minimum threshold
+    for (size_t i = 0; i < match_count; i++) {
         if (top_matches[i].similarity >= MIN_SIMILARITY_TO_SHOW) {
-            printf("%d. \"%s\"\n", i+1, g_intents[top_matches[i].index].question);
-            printf("   Cosine Similarity: %.1f%%\n", top_matches[i].similarity * 100);
+            log_debug("%zu. \"%s\" (cosine similarity %.1f%%)", i+1, top_matches[i].entry->question,
+                      top_matches[i].similarity * 100);
         }
     }
-    printf("----------------------------------------\n");
+    
+    float best_similarity = match_count > 0 ? top_matches[0].similarity : 0.0f;
+    bool exact = match_count > 0 && top_matches[0].exact;
+    if (match_count > 0) {
+        snprintf(answer, answer_size, "%s", top_matches[0].entry->answer);
+    }
+    intent_read_unlock(ip, token);
     
     // Return answer if similarity is above threshold or exact match
-    if (found_exact_match) {
-        printf("\nExact match found! (100%% confidence)\n");
-        return g_intents[best_match_index].answer;
+    if (exact) {
+        log_info("Exact match found (100%% confidence)");
+        return answer;
     }
     
-    if (found_match && best_similarity >= SIMILARITY_THRESHOLD_MIN) {
-        printf("\nFound matching answer! (%.1f%% cosine similarity)\n", best_similarity * 100);
-        return g_intents[best_match_index].answer;
+    if (match_count > 0 && best_similarity >= min_similarity) {
+        log_info("Found matching answer (%.1f%% cosine similarity)", best_similarity * 100);
+        return answer;
     }
     
-    printf("\nNo answer found - required similarity: %.1f%%, best match: %.1f%%\n", 
-           SIMILARITY_THRESHOLD_MIN * 100, best_similarity * 100);
+    log_info("No answer found - required similarity: %.1f%%, best match: %.1f%%",
+             min_similarity * 100, best_similarity * 100);
     return NULL;
-} 
\ No newline at end of file
+}
@@ -0,0 +1,335 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../../include/model_manager.h"
+#include "../../include/memory_accounting.h"
+
+#define LOG_MODULE LOG_MODULE_MODELS
+#include "../../include/log.h"
+
+typedef struct {
+    char language[MODEL_LANGUAGE_LENGTH];
+    char path[512];
+    size_t disk_bytes;          // Size of the model directory, the estimate before loading
+    size_t resident_bytes;      // Measured when loaded (0 while unloaded)
+    SpeechModel *model;         // NULL while unloaded
+    unsigned int users;         // Outstanding acquire_model calls
+    unsigned long last_used;    // Manager clock value of the last acquire
+    unsigned long loads;
+} ModelSlot;
+
+struct ModelManager {
+    pthread_mutex_t lock;
+    size_t budget;
+    size_t resident;            // Sum of resident_bytes
+    unsigned long clock;
+    ModelSlot slots[MODEL_MAX_LANGUAGES];
+    size_t slot_count;
+
+    // Language identification, serialized by its own lock
+    pthread_mutex_t lid_lock;
+    SpeechModel *lid_model;
+    SpeechSession *lid_session;
+};
+
+static size_t directory_bytes(const char *path) {
+    char child[1024];
+    size_t total = 0;
+    struct stat st;
+
+    DIR *dir = opendir(path);
+    if (!dir) return 0;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        if (lstat(child, &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            total += directory_bytes(child);
+        } else if (S_ISREG(st.st_mode)) {
+            total += st.st_size;
+        }
+    }
+    closedir(dir);
+    return total;
+}
+
+// Resident set size of this process
+static size_t resident_bytes(void) {
+    unsigned long size, resident;
+    FILE *file = fopen("/proc/self/statm", "r");
+    if (!file) return 0;
+    int fields = fscanf(file, "%lu %lu", &size, &resident);
+    fclose(file);
+    return fields == 2 ? resident * (size_t)sysconf(_SC_PAGESIZE) : 0;
+}
+
+static ModelSlot *find_slot(ModelManager *manager, const char *language) {
+    for (size_t i = 0; i < manager->slot_count; i++) {
+        if (strcmp(manager->slots[i].language, language) == 0) {
+            return &manager->slots[i];
+        }
+    }
+    return NULL;
+}
+
+static size_t slot_cost(const ModelSlot *slot) {
+    return slot->model ? slot->resident_bytes : slot->disk_bytes;
+}
+
+static void unload_slot(ModelManager *manager, ModelSlot *slot) {
+    log_info("Unloading %s speech model (%zu MB)", slot->language, slot->resident_bytes >> 20);
+    free_speech_model(slot->model);
+    manager->resident -= slot->resident_bytes;
+    memory_release(MEMORY_MODELS, slot->resident_bytes);
+    slot->model = NULL;
+    slot->resident_bytes = 0;
+}
+
+// Unload idle models, least recently used first, until need more bytes fit.
+// Returns false if it cannot be made to fit.
+static bool make_room(ModelManager *manager, size_t need) {
+    while (manager->resident + need > manager->budget) {
+        ModelSlot *victim = NULL;
+        for (size_t i = 0; i < manager->slot_count; i++) {
+            ModelSlot *slot = &manager->slots[i];
+            if (slot->model && slot->users == 0 &&
+                (!victim || slot->last_used < victim->last_used)) {
+                victim = slot;
+            }
+        }
+        if (!victim) {
+            return false;
+        }
+        unload_slot(manager, victim);
+    }
+    return true;
+}
+
+// The directory size is reserved first, so a model that does not fit the
+// budget is refused (and counted) rather than loaded
+static bool load_slot(ModelManager *manager, ModelSlot *slot) {
+    if (!memory_reserve(MEMORY_MODELS, slot->disk_bytes)) {
+        log_error("The %s speech model (%zu MB) does not fit in the %zu MB budget (%zu MB in use)",
+                  slot->language, slot->disk_bytes >> 20, manager->budget >> 20, manager->resident >> 20);
+        return false;
+    }
+
+    size_t before = resident_bytes();
+    slot->model = load_speech_model(slot->path);
+    if (!slot->model) {
+        memory_release(MEMORY_MODELS, slot->disk_bytes);
+        return false;
+    }
+
+    // Most of a Vosk model is read into the heap, so its footprint is at least
+    // the directory size; the RSS growth also catches decoder tables it builds.
+    // Other threads allocating meanwhile can only make this an overestimate.
+    size_t after = resident_bytes();
+    size_t grown = after > before ? after - before : 0;
+    slot->resident_bytes = grown > slot->disk_bytes ? grown : slot->disk_bytes;
+    manager->resident += slot->resident_bytes;
+    memory_charge(MEMORY_MODELS, slot->resident_bytes - slot->disk_bytes);
+    slot->loads++;
+    log_info("Loaded %s speech model: %zu MB, %zu of %zu MB budget in use",
+             slot->language, slot->resident_bytes >> 20, manager->resident >> 20, manager->budget >> 20);
+    return true;
+}
+
+ModelManager *create_model_manager(size_t budget_bytes) {
+    ModelManager *manager = calloc(1, sizeof(ModelManager));
+    if (!manager) {
+        return NULL;
+    }
+    if (budget_bytes == 0) {
+        budget_bytes = (size_t)sysconf(_SC_PHYS_PAGES) * (size_t)sysconf(_SC_PAGESIZE) / 100 *
+                       MODEL_MEMORY_BUDGET_PERCENT;
+    }
+    manager->budget = budget_bytes;
+    set_memory_budget(MEMORY_MODELS, manager->budget);
+    pthread_mutex_init(&manager->lock, NULL);
+    pthread_mutex_init(&manager->lid_lock, NULL);
+    return manager;
+}
+
+void destroy_model_manager(ModelManager *manager) {
+    if (!manager) return;
+
+    if (manager->lid_session) {
+        destroy_speech_session(manager->lid_session);
+        release_model(manager, manager->lid_model);
+    }
+    for (size_t i = 0; i < manager->slot_count; i++) {
+        if (manager->slots[i].users > 0) {
+            log_warn("%s speech model still in use", manager->slots[i].language);
+        }
+        free_speech_model(manager->slots[i].model);
+    }
+    pthread_mutex_destroy(&manager->lock);
+    pthread_mutex_destroy(&manager->lid_lock);
+    free(manager);
+}
+
+bool register_model(ModelManager *manager, const char *language, const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return false;
+    }
+
+    pthread_mutex_lock(&manager->lock);
+    ModelSlot *slot = find_slot(manager, language);
+    if (!slot && manager->slot_count < MODEL_MAX_LANGUAGES) {
+        slot = &manager->slots[manager->slot_count++];
+        snprintf(slot->language, sizeof(slot->language), "%s", language);
+    }
+    if (slot && !slot->model) {
+        snprintf(slot->path, sizeof(slot->path), "%s", path);
+        slot->disk_bytes = directory_bytes(path);
+    }
+    pthread_mutex_unlock(&manager->lock);
+
+    if (slot) {
+        log_info("Speech model for %s: %s (%zu MB on disk)", language, path, slot->disk_bytes >> 20);
+    }
+    return slot != NULL;
+}
+
+size_t register_default_models(ModelManager *manager) {
+    static const struct {
+        const char *language;
+        const char *dir;
+    } known[] = {
+        { MODEL_DEFAULT_LANGUAGE, MODEL_DIR_EN_IN },
+        { "hi", MODEL_DIR_HI },
+        { MODEL_FALLBACK_LANGUAGE, MODEL_DIR_EN_SMALL },
+    };
+    const char *search_dirs[] = MODEL_SEARCH_DIRS;
+    char path[512];
+    size_t found = 0;
+
+    for (size_t k = 0; k < sizeof(known) / sizeof(known[0]); k++) {
+        // Models registered explicitly take precedence
+        bool registered = has_language(manager, known[k].language);
+        for (int d = 0; search_dirs[d] && !registered; d++) {
+            snprintf(path, sizeof(path), "%s/%s", search_dirs[d], known[k].dir);
+            registered = register_model(manager, known[k].language, path);
+        }
+        // The setup script installs the default model as ./vosk-model
+        if (!registered && strcmp(known[k].language, MODEL_DEFAULT_LANGUAGE) == 0) {
+            registered = register_model(manager, known[k].language, "vosk-model");
+        }
+        found += registered;
+    }
+    return found;
+}
+
+bool has_language(const ModelManager *manager, const char *language) {
+    ModelManager *mutable_manager = (ModelManager *)manager;
+    pthread_mutex_lock(&mutable_manager->lock);
+    bool found = find_slot(mutable_manager, language) != NULL;
+    pthread_mutex_unlock(&mutable_manager->lock);
+    return found;
+}
+
+SpeechModel *acquire_model(ModelManager *manager, const char *language, const char **actual) {
+    SpeechModel *model = NULL;
+
+    if (!language) {
+        language = MODEL_DEFAULT_LANGUAGE;
+    }
+    if (actual) {
+        *actual = NULL;
+    }
+
+    pthread_mutex_lock(&manager->lock);
+    ModelSlot *slot = find_slot(manager, language);
+    if (!slot) {
+        log_error("No speech model registered for %s", language);
+    } else if (!slot->model && !make_room(manager, slot_cost(slot))) {
+        // Everything loaded is in use; a small model may still fit
+        ModelSlot *fallback = find_slot(manager, MODEL_FALLBACK_LANGUAGE);
+        if (fallback && fallback != slot && (fallback->model || make_room(manager, slot_cost(fallback)))) {
+            log_warn("No room for the %s speech model (%zu MB budget); using %s",
+                     language, manager->budget >> 20, MODEL_FALLBACK_LANGUAGE);
+            slot = fallback;
+        }
+        // Otherwise load_slot refuses it against the budget
+    }
+
+    if (slot && (slot->model || load_slot(manager, slot))) {
+        slot->users++;
+        slot->last_used = ++manager->clock;
+        model = slot->model;
+        if (actual) {
+            // Slot languages live as long as the manager
+            *actual = slot->language;
+        }
+    }
+    pthread_mutex_unlock(&manager->lock);
+
+    return model;
+}
+
+void release_model(ModelManager *manager, SpeechModel *model) {
+    if (!model) return;
+
+    pthread_mutex_lock(&manager->lock);
+    for (size_t i = 0; i < manager->slot_count; i++) {
+        ModelSlot *slot = &manager->slots[i];
+        if (slot->model == model && slot->users > 0) {
+            // Stays loaded until its memory is needed for another model
+            slot->users--;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&manager->lock);
+}
+
+const char *identify_language(ModelManager *manager, const int16_t *samples, size_t count) {
+    const char *language = MODEL_DEFAULT_LANGUAGE;
+    float confidence = 0.0f;
+
+    if (!samples || count == 0 ||
+        !has_language(manager, MODEL_LID_LANGUAGE) || !has_language(manager, MODEL_LID_OTHER)) {
+        return language;
+    }
+
+    pthread_mutex_lock(&manager->lid_lock);
+    if (!manager->lid_session) {
+        manager->lid_model = acquire_model(manager, MODEL_LID_LANGUAGE, NULL);
+        manager->lid_session = create_speech_session(manager->lid_model);
+        if (!manager->lid_session) {
+            release_model(manager, manager->lid_model);
+            manager->lid_model = NULL;
+        }
+    }
+    if (manager->lid_session) {
+        size_t window = (size_t)SAMPLE_RATE * MODEL_LID_WINDOW_MS / 1000;
+        const char *text = transcribe_audio(manager->lid_session, samples,
+                                            count < window ? count : window, &confidence);
+        if (!text || confidence < MODEL_LID_MIN_CONFIDENCE) {
+            language = MODEL_LID_OTHER;
+        }
+        log_info("Language identified as %s (English word confidence %.2f)", language, confidence);
+    }
+    pthread_mutex_unlock(&manager->lid_lock);
+
+    return language;
+}
+
+void print_model_stats(ModelManager *manager) {
+    pthread_mutex_lock(&manager->lock);
+    printf("Speech models (%zu of %zu MB budget in use):\n", manager->resident >> 20, manager->budget >> 20);
+    for (size_t i = 0; i < manager->slot_count; i++) {
+        const ModelSlot *slot = &manager->slots[i];
+        printf("  %-10s %-8s %4zu MB  users %u  loads %lu  %s\n", slot->language,
+               slot->model ? "loaded" : "unloaded", slot_cost(slot) >> 20,
+               slot->users, slot->loads, slot->path);
+    }
+    pthread_mutex_unlock(&manager->lock);
+}
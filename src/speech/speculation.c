@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../include/speculation.h"
+
+#define LOG_MODULE LOG_MODULE_SPEECH
+#include "../../include/log.h"
+
+#define SPECULATION_MATCHES 4   // Enough to find the runner-up intent in most cases
+
+struct Speculation {
+    IntentProcessor *intents;
+    SpeculationConfig config;
+    char candidate[MAX_INTENT_LENGTH];      // Confident top intent, empty if none
+    char answer[MAX_ANSWER_LENGTH];         // Its answer
+    double stable_since;                    // Audio time the candidate took the lead
+    TtsClip *clip;                          // Answer being or already synthesized
+    bool endpointed;
+};
+
+void default_speculation_config(SpeculationConfig *config) {
+    config->min_similarity = SPECULATION_MIN_SIMILARITY;
+    config->min_margin = SPECULATION_MIN_MARGIN;
+    config->prepare_ms = SPECULATION_PREPARE_MS;
+    config->endpoint_ms = SPECULATION_ENDPOINT_MS;
+}
+
+Speculation *create_speculation(IntentProcessor *intents, const SpeculationConfig *config) {
+    Speculation *speculation = calloc(1, sizeof(Speculation));
+    if (!speculation) {
+        return NULL;
+    }
+    speculation->intents = intents;
+    if (config) {
+        speculation->config = *config;
+    } else {
+        default_speculation_config(&speculation->config);
+    }
+    return speculation;
+}
+
+void speculation_set_config(Speculation *speculation, const SpeculationConfig *config) {
+    speculation->config = *config;
+}
+
+void destroy_speculation(Speculation *speculation) {
+    if (!speculation) return;
+    tts_discard(speculation->clip);
+    free(speculation);
+}
+
+void speculation_reset(Speculation *speculation) {
+    tts_discard(speculation->clip);
+    speculation->clip = NULL;
+    speculation->candidate[0] = '\0';
+    speculation->answer[0] = '\0';
+    speculation->endpointed = false;
+}
+
+// Copy the top intent and its answer if the match is confident enough;
+// returns false (leaving the outputs alone) otherwise
+static bool confident_match(Speculation *speculation, const char *text,
+                            char *intent, char *answer) {
+    IntentMatch matches[SPECULATION_MATCHES];
+    bool confident = false;
+
+    unsigned int token = intent_read_lock(speculation->intents);
+    size_t count = find_top_matches(speculation->intents, text, matches, SPECULATION_MATCHES);
+    if (count > 0) {
+        // Several questions share an intent; the margin is to the next intent
+        float runner_up = 0.0f;
+        for (size_t i = 1; i < count; i++) {
+            if (strcmp(matches[i].entry->intent, matches[0].entry->intent) != 0) {
+                runner_up = matches[i].similarity;
+                break;
+            }
+        }
+        confident = matches[0].exact ||
+                    (matches[0].similarity >= speculation->config.min_similarity &&
+                     matches[0].similarity - runner_up >= speculation->config.min_margin);
+    }
+    if (confident) {
+        snprintf(intent, MAX_INTENT_LENGTH, "%s", matches[0].entry->intent);
+        snprintf(answer, MAX_ANSWER_LENGTH, "%s", matches[0].entry->answer);
+    }
+    intent_read_unlock(speculation->intents, token);
+
+    return confident;
+}
+
+int speculation_on_partial(const char *partial, double audio_ms, void *user) {
+    Speculation *speculation = user;
+    char intent[MAX_INTENT_LENGTH];
+    char answer[MAX_ANSWER_LENGTH];
+
+    if (!confident_match(speculation, partial, intent, answer)) {
+        speculation->candidate[0] = '\0';
+        return 0;
+    }
+    if (strcmp(intent, speculation->candidate) != 0) {
+        snprintf(speculation->candidate, sizeof(speculation->candidate), "%s", intent);
+        snprintf(speculation->answer, sizeof(speculation->answer), "%s", answer);
+        speculation->stable_since = audio_ms;
+        return 0;
+    }
+
+    double stable_ms = audio_ms - speculation->stable_since;
+
+    // Synthesize the answer while the user finishes speaking. A clip for an
+    // earlier candidate is only replaced once done so this never blocks.
+    if (stable_ms >= speculation->config.prepare_ms) {
+        TtsClip *clip = speculation->clip;
+        if (!clip || (strcmp(tts_clip_text(clip), speculation->answer) != 0 && tts_clip_done(clip))) {
+            tts_discard(clip);
+            speculation->clip = tts_prepare(speculation->answer);
+            log_info("Speculating on intent %s after %.0f ms; preparing answer",
+                     speculation->candidate, audio_ms);
+        }
+    }
+
+    if (speculation->config.endpoint_ms > 0 && stable_ms >= speculation->config.endpoint_ms) {
+        log_info("Intent %s stable for %.0f ms; ending capture", speculation->candidate, stable_ms);
+        speculation->endpointed = true;
+        return 1;
+    }
+    return 0;
+}
+
+bool speculation_endpointed(const Speculation *speculation) {
+    return speculation->endpointed;
+}
+
+bool speculation_speak(Speculation *speculation, AudioSink *sink, const char *answer) {
+    TtsClip *clip = speculation->clip;
+    speculation->clip = NULL;
+
+    if (clip && strcmp(tts_clip_text(clip), answer) == 0) {
+        if (tts_play(clip, sink) == 0) {
+            return true;
+        }
+    } else {
+        tts_discard(clip);      // Wrong guess
+    }
+    speak_text(sink, answer);
+    return false;
+}
@@ -1,16 +1,63 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <errno.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <vosk_api.h>
 #include "../../include/speech_processor.h"
+#include "../../include/realtime.h"
+#include "../../include/audio_backend.h"
+#include "../../include/memory_accounting.h"
 
-// Global Vosk model instance
-VoskModel *g_vosk_model = NULL;
+#define LOG_MODULE LOG_MODULE_SPEECH
+#include "../../include/log.h"
 
-// Buffer to store the last recognized text
-static char g_last_recognized_text[MAX_TEXT_LENGTH] = {0};
+struct SpeechModel {
+    VoskModel *vosk;
+};
+
+struct SpeechSession {
+    SpeechModel *model;
+    VoskRecognizer *recognizer;
+    AudioSource *source;                    // NULL for the default microphone
+    AudioCapture *capture;                  // Created on first recording
+    SpeechConfig config;
+    char partial[MAX_TEXT_LENGTH];
+    char result[MAX_TEXT_LENGTH];
+    char text[MAX_TEXT_LENGTH];             // Last recognized utterance
+    int16_t *audio;                         // Conditioned audio of the last utterance (BUFFER_SIZE, reused)
+    size_t audio_samples;
+    SpeechTimings timings;                  // Stage timings of the last utterance
+};
+
+struct TtsClip {
+    pthread_t thread;
+    char text[MAX_TEXT_LENGTH];
+    char text_path[64];
+    char wav_path[64];
+    _Atomic int done;
+    int status;                             // text2wave exit status
+    size_t bytes;                           // Charged to MEMORY_TTS: estimated, then the WAV size
+};
+
+// Festival runs once per process, so its settings are process-wide
+static TtsConfig tts_config = { TTS_VOICE, TTS_CPU };
+static pthread_mutex_t tts_config_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void get_tts_config(TtsConfig *config) {
+    pthread_mutex_lock(&tts_config_lock);
+    *config = tts_config;
+    pthread_mutex_unlock(&tts_config_lock);
+}
+
+static double elapsed_ms(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1000.0 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
 
 // Helper function to escape special characters for Festival
 static char* escape_text_for_festival(const char* text, char* buffer, size_t buffer_size) {
@@ -81,7 +128,7 @@ static const char* find_vosk_model_path(void) {
     
     for (int i = 0; model_paths[i] != NULL; i++) {
         if (directory_exists(model_paths[i])) {
-            printf("Found Vosk model at: %s\n", model_paths[i]);
+            log_debug("Found Vosk model at: %s", model_paths[i]);
             return model_paths[i];
         }
     }
@@ -89,120 +136,493 @@ static const char* find_vosk_model_path(void) {
     return NULL;
 }
 
-int initialize_vosk_model(void) {
-    printf("Initializing speech recognition with Indian English model...\n");
+SpeechModel *load_speech_model(const char *path) {
+    log_info("Initializing speech recognition with Indian English model...");
     
     // Find the model in system or local directories
-    const char* model_path = find_vosk_model_path();
+    const char* model_path = path ? path : find_vosk_model_path();
     if (!model_path) {
-        fprintf(stderr, "Could not find Vosk model in any of the following locations:\n");
-        fprintf(stderr, "  - /usr/local/share/vosk-models/vosk-model-en-in-0.5\n");
-        fprintf(stderr, "  - /opt/vosk-models/vosk-model-en-in-0.5\n");
-        fprintf(stderr, "  - /usr/share/vosk-models/vosk-model-en-in-0.5\n");
-        fprintf(stderr, "  - vosk-model (local directory)\n");
-        fprintf(stderr, "\nPlease run the setup script: ./setup_vosk_model.sh\n");
-        return 0;
+        log_error("Could not find Vosk model in any of the following locations:");
+        log_error("  - /usr/local/share/vosk-models/vosk-model-en-in-0.5");
+        log_error("  - /opt/vosk-models/vosk-model-en-in-0.5");
+        log_error("  - /usr/share/vosk-models/vosk-model-en-in-0.5");
+        log_error("  - vosk-model (local directory)");
+        log_error("Please run the setup script: ./setup_vosk_model.sh");
+        return NULL;
     }
     
+    SpeechModel *model = calloc(1, sizeof(SpeechModel));
+    if (!model) {
+        return NULL;
+    }
+
     // Initialize Vosk with found model path
-    g_vosk_model = vosk_model_new(model_path);
-    if (!g_vosk_model) {
-        fprintf(stderr, "Could not load model from %s\n", model_path);
-        fprintf(stderr, "Please ensure the model directory contains the required files\n");
-        return 0;
+    model->vosk = vosk_model_new(model_path);
+    if (!model->vosk) {
+        log_error("Could not load model from %s", model_path);
+        log_error("Please ensure the model directory contains the required files");
+        free(model);
+        return NULL;
     }
     
-    printf("Speech recognition model loaded successfully from: %s\n", model_path);
-    return 1;
+    log_info("Speech recognition model loaded successfully from: %s", model_path);
+    return model;
 }
 
-void cleanup_vosk_model(void) {
-    if (g_vosk_model) {
-        vosk_model_free(g_vosk_model);
-        g_vosk_model = NULL;
+void free_speech_model(SpeechModel *model) {
+    if (model) {
+        vosk_model_free(model->vosk);
+        free(model);
     }
 }
 
+SpeechSession *create_speech_session(SpeechModel *model) {
+    if (!model) {
+        return NULL;
+    }
+
+    SpeechSession *session = calloc(1, sizeof(SpeechSession));
+    if (!session) {
+        return NULL;
+    }
+    session->model = model;
+    default_speech_config(&session->config);
+
+    // Create recognizer with improved settings
+    session->recognizer = vosk_recognizer_new(model->vosk, SAMPLE_RATE);
+    if (!session->recognizer) {
+        log_error("Could not create recognizer");
+        free(session);
+        return NULL;
+    }
+
+    // Enable words with times
+    vosk_recognizer_set_words(session->recognizer, 1);
+
+    // Every utterance is recorded into the same buffer
+    session->audio = alloc_audio_buffer();
+    if (!session->audio) {
+        log_error("Failed to allocate memory for audio buffer");
+        vosk_recognizer_free(session->recognizer);
+        free(session);
+        return NULL;
+    }
+    return session;
+}
+
+void destroy_speech_session(SpeechSession *session) {
+    if (!session) return;
+    vosk_recognizer_free(session->recognizer);
+    destroy_audio_capture(session->capture);
+    free_audio_buffer(session->audio);
+    free(session);
+}
+
+void default_speech_config(SpeechConfig *config) {
+    default_capture_config(&config->capture);
+    config->partial_interval_ms = PARTIAL_INTERVAL_MS;
+    config->decode_cpu = DECODE_CPU;
+}
+
+void set_speech_session_config(SpeechSession *session, const SpeechConfig *config) {
+    session->config = *config;
+    if (session->capture) {
+        set_audio_capture_config(session->capture, &config->capture);
+    }
+}
+
+void reset_speech_session(SpeechSession *session) {
+    vosk_recognizer_reset(session->recognizer);
+    session->partial[0] = '\0';
+    session->result[0] = '\0';
+    session->text[0] = '\0';
+}
+
+int speech_session_accept(SpeechSession *session, const int16_t *samples, size_t count) {
+    int endpoint = vosk_recognizer_accept_waveform_s(session->recognizer, samples, (int)count);
+    if (endpoint > 0) {
+        extract_result_text(vosk_recognizer_result(session->recognizer), "text",
+                            session->result, sizeof(session->result));
+    }
+    return endpoint > 0;
+}
+
+const char *speech_session_partial(SpeechSession *session) {
+    extract_result_text(vosk_recognizer_partial_result(session->recognizer), "partial",
+                        session->partial, sizeof(session->partial));
+    return session->partial;
+}
+
+const char *speech_session_result(SpeechSession *session) {
+    return session->result;
+}
+
+const int16_t *speech_session_audio(const SpeechSession *session, size_t *samples) {
+    *samples = session->audio_samples;
+    return session->audio;
+}
+
+void get_speech_timings(const SpeechSession *session, SpeechTimings *timings) {
+    *timings = session->timings;
+}
+
+void set_speech_session_source(SpeechSession *session, AudioSource *source) {
+    destroy_audio_capture(session->capture);
+    session->capture = NULL;
+    session->source = source;
+}
+
+const char *speech_session_final(SpeechSession *session) {
+    extract_result_text(vosk_recognizer_final_result(session->recognizer), "text",
+                        session->result, sizeof(session->result));
+    return session->result;
+}
+
+void default_tts_config(TtsConfig *config) {
+    snprintf(config->voice, sizeof(config->voice), "%s", TTS_VOICE);
+    config->cpu = TTS_CPU;
+}
+
+void set_tts_config(const TtsConfig *config) {
+    pthread_mutex_lock(&tts_config_lock);
+    tts_config = *config;
+    pthread_mutex_unlock(&tts_config_lock);
+}
+
+// Festival reads its commands from a file on stdin rather than through a
+// shell, so nothing in text can reach one
 void text_to_speech(const char *text) {
     char escaped_text[1024];
-    char command[2048];
+    char script_path[64];
+    cpu_set_t saved_affinity;
+    TtsConfig config;
     
     // Escape special characters in the text
     escape_text_for_festival(text, escaped_text, sizeof(escaped_text));
     
-    // Use Festival with configurable female voice (defined in speech_processor.h)
-    // To change voice: modify TTS_VOICE constant in include/speech_processor.h
-    snprintf(command, sizeof(command), 
-             "echo '(%s) (SayText \"%s\")' | festival", TTS_VOICE, escaped_text);
-    system(command);
+    // Use Festival with the configured voice (TTS_VOICE unless set_tts_config changed it)
+    get_tts_config(&config);
+    snprintf(script_path, sizeof(script_path), "%s/vaani-say-XXXXXX", TTS_PREPARE_DIR);
+    int script = mkstemp(script_path);
+    if (script < 0) {
+        log_error("Could not create a Festival script in %s", TTS_PREPARE_DIR);
+        return;
+    }
+    unlink(script_path);
+    dprintf(script, "(%s) (SayText \"%s\")\n", config.voice, escaped_text);
+    lseek(script, 0, SEEK_SET);
+
+    // Festival inherits the affinity of this thread, keeping it off the capture core
+    int pinned = pin_thread_to_cpu(config.cpu, &saved_affinity) == 0;
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(script, STDIN_FILENO);
+        close(script);
+        execlp("festival", "festival", (char *)NULL);
+        _exit(127);
+    }
+    close(script);
+    if (pid < 0) {
+        log_error("Could not start Festival");
+    } else {
+        while (waitpid(pid, NULL, 0) < 0 && errno == EINTR) {
+        }
+    }
+    if (pinned) {
+        restore_thread_affinity(&saved_affinity);
+    }
 }
 
-const char* speech_to_text(void) {
-    VoskRecognizer *recognizer;
-    size_t nsamps;
-    int16_t *audio_buffer;
+static void *synthesize_clip(void *arg) {
+    TtsClip *clip = arg;
+    char command[512];
+    TtsConfig config;
 
-    // Clear previous result
-    g_last_recognized_text[0] = '\0';
+    // Keep synthesis off the capture core like text_to_speech
+    get_tts_config(&config);
+    pin_thread_to_cpu(config.cpu, NULL);
+    snprintf(command, sizeof(command), "text2wave -eval '(%s)' -o %s %s",
+             config.voice, clip->wav_path, clip->text_path);
+    clip->status = system(command);
+    unlink(clip->text_path);
 
-    // Create recognizer with improved settings
-    recognizer = vosk_recognizer_new(g_vosk_model, SAMPLE_RATE);
-    if (!recognizer) {
-        fprintf(stderr, "Could not create recognizer\n");
+    // Replace the estimate with what was rendered
+    struct stat wav;
+    size_t bytes = stat(clip->wav_path, &wav) == 0 ? (size_t)wav.st_size : 0;
+    if (bytes > clip->bytes) {
+        memory_charge(MEMORY_TTS, bytes - clip->bytes);
+    } else {
+        memory_release(MEMORY_TTS, clip->bytes - bytes);
+    }
+    clip->bytes = bytes;
+    atomic_store(&clip->done, 1);
+    return NULL;
+}
+
+// An optional clip (prepared ahead of need) is refused over the TTS budget;
+// one that is about to be spoken is always made
+static TtsClip *prepare_clip(const char *text, bool optional) {
+    size_t estimate = strlen(text) * TTS_BYTES_PER_CHAR;
+    if (optional && !memory_reserve(MEMORY_TTS, estimate)) {
+        log_debug("Not preparing speech: over the TTS memory budget");
         return NULL;
     }
+    if (!optional) {
+        memory_charge(MEMORY_TTS, estimate);
+    }
 
-    // Enable words with times
-    vosk_recognizer_set_words(recognizer, 1);
+    TtsClip *clip = calloc(1, sizeof(TtsClip));
+    if (!clip) {
+        memory_release(MEMORY_TTS, estimate);
+        return NULL;
+    }
+    clip->bytes = estimate;
+    snprintf(clip->text, sizeof(clip->text), "%s", text);
+    snprintf(clip->text_path, sizeof(clip->text_path), "%s/vaani-tts-XXXXXX", TTS_PREPARE_DIR);
+    snprintf(clip->wav_path, sizeof(clip->wav_path), "%s/vaani-tts-XXXXXX", TTS_PREPARE_DIR);
 
-    printf("\nRecording... Speak clearly.\n");
+    // The text goes through a file, so it needs no shell or Scheme escaping
+    int text_fd = mkstemp(clip->text_path);
+    int wav_fd = text_fd >= 0 ? mkstemp(clip->wav_path) : -1;
+    if (wav_fd < 0) {
+        if (text_fd >= 0) {
+            close(text_fd);
+            unlink(clip->text_path);
+        }
+        memory_release(MEMORY_TTS, clip->bytes);
+        free(clip);
+        return NULL;
+    }
+    close(wav_fd);
 
-    // Record audio using ALSA
-    audio_buffer = record_audio(&nsamps);
-    if (!audio_buffer) {
-        fprintf(stderr, "Failed to record audio\n");
-        vosk_recognizer_free(recognizer);
+    size_t length = strlen(clip->text);
+    int written = write(text_fd, clip->text, length) == (ssize_t)length;
+    close(text_fd);
+    if (!written || pthread_create(&clip->thread, NULL, synthesize_clip, clip) != 0) {
+        unlink(clip->text_path);
+        unlink(clip->wav_path);
+        memory_release(MEMORY_TTS, clip->bytes);
+        free(clip);
         return NULL;
     }
+    return clip;
+}
+
+TtsClip *tts_prepare(const char *text) {
+    return prepare_clip(text, true);
+}
 
-    printf("Processing speech...\n");
+const char *tts_clip_text(const TtsClip *clip) {
+    return clip->text;
+}
+
+int tts_clip_done(const TtsClip *clip) {
+    return atomic_load(&clip->done);
+}
 
-    // Process the recorded audio in smaller chunks for better accuracy
-    const size_t chunk_size = SAMPLE_RATE / 2; // Process 0.5 second chunks
-    size_t processed = 0;
+int tts_play(TtsClip *clip, AudioSink *sink) {
+    char command[128];
+    cpu_set_t saved_affinity;
+    int rc = -1;
 
-    while (processed < nsamps) {
-        size_t current_chunk = (nsamps - processed < chunk_size) ? 
-                             (nsamps - processed) : chunk_size;
-        
-        vosk_recognizer_accept_waveform(recognizer, 
-                                      (const char *)(audio_buffer + processed),
-                                      current_chunk * sizeof(int16_t));
-        processed += current_chunk;
+    if (!clip) return -1;
+    pthread_join(clip->thread, NULL);
+    if (clip->status == 0 && sink) {
+        rc = audio_sink_play_file(sink, clip->wav_path);
+    } else if (clip->status == 0) {
+        TtsConfig config;
+        get_tts_config(&config);
+        snprintf(command, sizeof(command), "aplay -q %s", clip->wav_path);
+        int pinned = pin_thread_to_cpu(config.cpu, &saved_affinity) == 0;
+        rc = system(command) == 0 ? 0 : -1;
+        if (pinned) {
+            restore_thread_affinity(&saved_affinity);
+        }
     }
+    unlink(clip->wav_path);
+    memory_release(MEMORY_TTS, clip->bytes);
+    free(clip);
+    return rc;
+}
 
-    // Get and show final result
-    const char *final_result = vosk_recognizer_final_result(recognizer);
-    
-    // Simple parsing to extract just the text from JSON
-    const char *text_start = strstr(final_result, "\"text\" : \"");
-    if (text_start) {
-        text_start += 10; // Skip past "\"text\" : \""
-        const char *text_end = strchr(text_start, '\"');
-        if (text_end && text_end > text_start) {
-            size_t text_len = text_end - text_start;
-            if (text_len > 0) {
-                // Store the recognized text
-                size_t copy_len = text_len < MAX_TEXT_LENGTH - 1 ? text_len : MAX_TEXT_LENGTH - 1;
-                strncpy(g_last_recognized_text, text_start, copy_len);
-                g_last_recognized_text[copy_len] = '\0';
-            }
+void speak_text(AudioSink *sink, const char *text) {
+    if (!sink) {
+        text_to_speech(text);
+        return;
+    }
+    if (tts_play(prepare_clip(text, false), sink) < 0) {
+        log_error("Could not speak on the %s sink", sink->name);
+    }
+}
+
+void tts_discard(TtsClip *clip) {
+    if (!clip) return;
+    pthread_join(clip->thread, NULL);
+    unlink(clip->wav_path);
+    memory_release(MEMORY_TTS, clip->bytes);
+    free(clip);
+}
+
+size_t extract_result_text(const char *json, const char *key, char *out, size_t out_size) {
+    char pattern[64];
+
+    if (!json || !out || out_size == 0) {
+        return 0;
+    }
+    out[0] = '\0';
+
+    snprintf(pattern, sizeof(pattern), "\"%s\" : \"", key);
+    const char *text_start = strstr(json, pattern);
+    if (!text_start) {
+        return 0;
+    }
+    text_start += strlen(pattern);
+
+    const char *text_end = strchr(text_start, '\"');
+    if (!text_end || text_end <= text_start) {
+        return 0;
+    }
+
+    size_t text_len = text_end - text_start;
+    size_t copy_len = text_len < out_size - 1 ? text_len : out_size - 1;
+    memcpy(out, text_start, copy_len);
+    out[copy_len] = '\0';
+    return copy_len;
+}
+
+// Recognizer input for one utterance
+typedef struct {
+    SpeechSession *session;
+    PartialHandler handler;
+    void *user;
+    size_t samples;                         // Samples decoded so far
+    size_t next_partial;                    // Sample count at which to report the next partial
+    size_t partial_interval;                // Samples between partials
+} RecognizerFeed;
+
+// Streaming consumer: feed conditioned audio to the recognizer as it is captured
+static int feed_recognizer(const int16_t *frames, size_t count, void *user) {
+    RecognizerFeed *feed = user;
+    vosk_recognizer_accept_waveform_s(feed->session->recognizer, frames, (int)count);
+    feed->samples += count;
+
+    if (!feed->handler || feed->samples < feed->next_partial) {
+        return 0;
+    }
+    feed->next_partial = feed->samples + feed->partial_interval;
+
+    const char *partial = speech_session_partial(feed->session);
+    if (partial[0] == '\0') {
+        return 0;
+    }
+    return feed->handler(partial, feed->samples * 1000.0 / SAMPLE_RATE, feed->user);
+}
+
+// Add the text of a Vosk result to session->text and its per-word
+// confidences to *conf_sum / *words
+static void append_result(SpeechSession *session, const char *json, double *conf_sum, size_t *words) {
+    char segment[MAX_TEXT_LENGTH];
+
+    if (extract_result_text(json, "text", segment, sizeof(segment)) > 0) {
+        size_t used = strlen(session->text);
+        snprintf(session->text + used, sizeof(session->text) - used, "%s%s",
+                 used > 0 ? " " : "", segment);
+    }
+    for (const char *p = json; p && (p = strstr(p, "\"conf\" : ")) != NULL; p++) {
+        *conf_sum += strtod(p + 9, NULL);
+        (*words)++;
+    }
+}
+
+const char *transcribe_audio(SpeechSession *session, const int16_t *samples, size_t count,
+                             float *confidence) {
+    struct timespec started, finished;
+    double conf_sum = 0.0;
+    size_t words = 0;
+
+    reset_speech_session(session);
+    memset(&session->timings, 0, sizeof(session->timings));
+
+    // Keep (the start of) the audio in the session's buffer like speech_to_text does
+    session->audio_samples = count < BUFFER_SIZE ? count : BUFFER_SIZE;
+    if (session->audio != samples) {
+        memcpy(session->audio, samples, session->audio_samples * sizeof(int16_t));
+    }
+
+    // Feed in capture-sized chunks so every finalized segment is collected
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    for (size_t offset = 0; offset < count; offset += CAPTURE_CHUNK_FRAMES) {
+        size_t chunk = count - offset < CAPTURE_CHUNK_FRAMES ? count - offset : CAPTURE_CHUNK_FRAMES;
+        if (vosk_recognizer_accept_waveform_s(session->recognizer, samples + offset, (int)chunk) > 0) {
+            append_result(session, vosk_recognizer_result(session->recognizer), &conf_sum, &words);
+        }
+    }
+    append_result(session, vosk_recognizer_final_result(session->recognizer), &conf_sum, &words);
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    session->timings.finalize_ms = elapsed_ms(&started, &finished);
+
+    if (confidence) {
+        *confidence = words > 0 ? (float)(conf_sum / words) : 0.0f;
+    }
+    return session->text[0] != '\0' ? session->text : NULL;
+}
+
+const char* speech_to_text(SpeechSession *session) {
+    return speech_to_text_with_partials(session, NULL, NULL);
+}
+
+const char* speech_to_text_with_partials(SpeechSession *session, PartialHandler handler, void *user) {
+    size_t nsamps;
+    cpu_set_t saved_affinity;
+    struct timespec started, captured, finished;
+    RecognizerFeed feed = {
+        .session = session,
+        .handler = handler,
+        .user = user,
+        .partial_interval = (size_t)SAMPLE_RATE * session->config.partial_interval_ms / 1000,
+    };
+
+    // Clear previous result; the recognizer is reused across turns
+    reset_speech_session(session);
+    session->audio_samples = 0;
+    memset(&session->timings, 0, sizeof(session->timings));
+
+    if (!session->capture) {
+        if (!(session->capture = create_audio_capture(session->source))) {
+            return NULL;
         }
+        set_audio_capture_config(session->capture, &session->config.capture);
     }
 
-    // Cleanup
-    free(audio_buffer);
-    vosk_recognizer_free(recognizer);
+    log_info("Recording... Speak clearly.");
+
+    // Record audio from the source, decoding on this thread while capture continues
+    int pinned = pin_thread_to_cpu(session->config.decode_cpu, &saved_affinity) == 0;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    if (record_audio_into(session->capture, session->audio, BUFFER_SIZE, &nsamps,
+                          feed_recognizer, &feed) < 0) {
+        log_error("Failed to record audio");
+        if (pinned) {
+            restore_thread_affinity(&saved_affinity);
+        }
+        return NULL;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &captured);
+    log_debug("Processing speech...");
+
+    // Get the final result, keeping just the text from the JSON
+    extract_result_text(vosk_recognizer_final_result(session->recognizer), "text",
+                        session->text, sizeof(session->text));
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+
+    // Cleanup; the audio stays with the session until the next utterance
+    if (pinned) {
+        restore_thread_affinity(&saved_affinity);
+    }
+    session->audio_samples = nsamps;
+    session->timings.capture_ms = elapsed_ms(&started, &captured);
+    session->timings.finalize_ms = elapsed_ms(&captured, &finished);
 
-    return g_last_recognized_text[0] != '\0' ? g_last_recognized_text : NULL;
+    return session->text[0] != '\0' ? session->text : NULL;
 } 
\ No newline at end of file
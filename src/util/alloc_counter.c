@@ -0,0 +1,81 @@
+#include <stddef.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include "../../include/alloc_counter.h"
+
+#if ALLOC_COUNTING
+
+// glibc's own allocator, which the wrappers below forward to
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+static __thread unsigned long thread_count;
+static atomic_ulong total_count;
+
+static void count_allocation(void) {
+    thread_count++;
+    atomic_fetch_add_explicit(&total_count, 1, memory_order_relaxed);
+}
+
+void *malloc(size_t size) {
+    count_allocation();
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    count_allocation();
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    count_allocation();
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size) {
+    count_allocation();
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) {
+    if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    void *block = memalign(alignment, size);
+    if (!block && size > 0) {
+        return ENOMEM;
+    }
+    *ptr = block;
+    return 0;
+}
+
+void free(void *ptr) {
+    __libc_free(ptr);
+}
+
+unsigned long thread_allocations(void) {
+    return thread_count;
+}
+
+unsigned long total_allocations(void) {
+    return atomic_load_explicit(&total_count, memory_order_relaxed);
+}
+
+#else
+
+unsigned long thread_allocations(void) {
+    return 0;
+}
+
+unsigned long total_allocations(void) {
+    return 0;
+}
+
+#endif
@@ -0,0 +1,41 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../../include/arena.h"
+
+bool arena_init(Arena *arena, size_t size) {
+    memset(arena, 0, sizeof(*arena));
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    if (size > 0 && posix_memalign((void **)&arena->base, ARENA_ALIGNMENT, size) != 0) {
+        arena->base = NULL;
+        return false;
+    }
+    arena->size = size;
+    return true;
+}
+
+void arena_release(Arena *arena) {
+    free(arena->base);
+    memset(arena, 0, sizeof(*arena));
+}
+
+void *arena_alloc(Arena *arena, size_t bytes) {
+    size_t rounded = (bytes + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    if (!arena || rounded < bytes || rounded > arena->size - arena->used) {
+        return NULL;
+    }
+    void *block = arena->base + arena->used;
+    arena->used += rounded;
+    if (arena->used > arena->peak) {
+        arena->peak = arena->used;
+    }
+    return block;
+}
+
+void arena_reset(Arena *arena) {
+    arena->used = 0;
+}
+
+bool arena_owns(const Arena *arena, const void *ptr) {
+    const unsigned char *p = ptr;
+    return arena && arena->base && p >= arena->base && p < arena->base + arena->size;
+}
@@ -0,0 +1,394 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <sched.h>
+#include "../../include/config.h"
+#include "../../include/intent_processor.h"
+#include "../../include/model_manager.h"
+#include "../../include/batch_transcriber.h"
+
+#define LOG_MODULE LOG_MODULE_CONFIG
+#include "../../include/log.h"
+
+typedef enum {
+    KEY_INT,
+    KEY_UINT,
+    KEY_SIZE,
+    KEY_FLOAT,
+    KEY_DOUBLE,
+    KEY_BOOL,
+    KEY_STRING,
+    KEY_VOICE,          // Festival voice name, passed to a shell command
+    KEY_LOG_FILTER,
+} KeyType;
+
+typedef struct {
+    const char *name;
+    KeyType type;
+    size_t offset;
+    size_t size;
+    double min;         // Numeric keys only
+    double max;
+    bool restart;       // Read once at startup
+} ConfigKey;
+
+#define FIELD(member) offsetof(VaaniConfig, member), sizeof(((VaaniConfig *)0)->member)
+#define MAX_CPU (CPU_SETSIZE - 1)
+
+static const ConfigKey config_keys[] = {
+    { "audio.recording_ms",         KEY_UINT,   FIELD(speech.capture.recording_ms), 500, RECORDING_TIME_SEC * 1000, false },
+    { "audio.silence_threshold",    KEY_INT,    FIELD(speech.capture.silence_threshold), 0, 32767, false },
+    { "audio.silence_ms",           KEY_UINT,   FIELD(speech.capture.silence_ms), 250, RECORDING_TIME_SEC * 1000, false },
+    { "audio.period_ms",            KEY_UINT,   FIELD(speech.capture.period_ms), 1, 500, false },
+    { "audio.periods",              KEY_UINT,   FIELD(speech.capture.periods), 2, 64, false },
+    { "audio.noise_suppression",    KEY_BOOL,   FIELD(speech.capture.noise_suppression), 0, 0, false },
+    { "audio.rt_priority",          KEY_INT,    FIELD(speech.capture.rt_priority), 0, 99, false },
+    { "audio.capture_cpu",          KEY_INT,    FIELD(speech.capture.capture_cpu), -1, MAX_CPU, false },
+    { "speech.partial_interval_ms", KEY_UINT,   FIELD(speech.partial_interval_ms), 20, 5000, false },
+    { "speech.decode_cpu",          KEY_INT,    FIELD(speech.decode_cpu), -1, MAX_CPU, false },
+    { "tts.voice",                  KEY_VOICE,  FIELD(tts.voice), 0, 0, false },
+    { "tts.cpu",                    KEY_INT,    FIELD(tts.cpu), -1, MAX_CPU, false },
+    { "intent.min_similarity",      KEY_FLOAT,  FIELD(intent_min_similarity), 0, 1, false },
+    { "intent.group_fanout",        KEY_SIZE,   FIELD(intent_group_fanout), 0, 100000, false },
+    { "intent.csv",                 KEY_STRING, FIELD(intents_csv), 0, 0, true },
+    { "speculation.enabled",        KEY_BOOL,   FIELD(speculation_enabled), 0, 0, false },
+    { "speculation.min_similarity", KEY_FLOAT,  FIELD(speculation.min_similarity), 0, 1, false },
+    { "speculation.min_margin",     KEY_FLOAT,  FIELD(speculation.min_margin), 0, 1, false },
+    { "speculation.prepare_ms",     KEY_DOUBLE, FIELD(speculation.prepare_ms), 0, 60000, false },
+    { "speculation.endpoint_ms",    KEY_DOUBLE, FIELD(speculation.endpoint_ms), 0, 60000, false },
+    { "models.budget_mb",           KEY_SIZE,   FIELD(model_budget_mb), 0, 65536, true },
+    { "memory.intents_mb",          KEY_SIZE,   FIELD(intents_budget_mb), 0, 65536, false },
+    { "memory.audio_mb",            KEY_SIZE,   FIELD(audio_budget_mb), 0, 65536, false },
+    { "memory.tts_mb",              KEY_SIZE,   FIELD(tts_budget_mb), 0, 65536, false },
+    { "batch.jobs",                 KEY_SIZE,   FIELD(batch_jobs), 0, BATCH_MAX_JOBS, true },
+    { "main.start_delay_ms",        KEY_UINT,   FIELD(start_delay_ms), 0, 60000, false },
+    { "main.turn_pause_ms",         KEY_UINT,   FIELD(turn_pause_ms), 0, 60000, false },
+    { "log.filter",                 KEY_LOG_FILTER, FIELD(log_filter), 0, 0, false },
+};
+
+#define CONFIG_KEY_COUNT (sizeof(config_keys) / sizeof(config_keys[0]))
+
+void default_config(VaaniConfig *config) {
+    memset(config, 0, sizeof(*config));
+    default_speech_config(&config->speech);
+    default_tts_config(&config->tts);
+    config->intent_min_similarity = INTENT_MIN_SIMILARITY;
+    config->intent_group_fanout = INTENT_GROUP_FANOUT;
+    snprintf(config->intents_csv, sizeof(config->intents_csv), "%s", INTENTS_CSV_PATH);
+    config->speculation_enabled = true;
+    default_speculation_config(&config->speculation);
+    config->model_budget_mb = 0;
+    config->start_delay_ms = CONFIG_START_DELAY_MS;
+    config->turn_pause_ms = CONFIG_TURN_PAUSE_MS;
+}
+
+static const ConfigKey *find_key(const char *name) {
+    for (size_t i = 0; i < CONFIG_KEY_COUNT; i++) {
+        if (strcmp(config_keys[i].name, name) == 0) {
+            return &config_keys[i];
+        }
+    }
+    return NULL;
+}
+
+// Strip leading and trailing whitespace in place
+static char *trim(char *text) {
+    while (isspace((unsigned char)*text)) {
+        text++;
+    }
+    size_t length = strlen(text);
+    while (length > 0 && isspace((unsigned char)text[length - 1])) {
+        text[--length] = '\0';
+    }
+    return text;
+}
+
+static bool parse_bool(const char *value, bool *out) {
+    static const char *const yes[] = { "true", "yes", "on", "1" };
+    static const char *const no[] = { "false", "no", "off", "0" };
+
+    for (size_t i = 0; i < 4; i++) {
+        if (strcasecmp(value, yes[i]) == 0) {
+            *out = true;
+            return true;
+        }
+        if (strcasecmp(value, no[i]) == 0) {
+            *out = false;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool valid_voice(const char *value) {
+    if (!*value) {
+        return false;
+    }
+    for (const char *c = value; *c; c++) {
+        if (!isalnum((unsigned char)*c) && *c != '_' && *c != '-') {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Store value for key in config. Returns false after logging why it is invalid.
+static bool set_key(const ConfigKey *key, const char *value, VaaniConfig *config,
+                    const char *path, int line) {
+    char *target = (char *)config + key->offset;
+    char *end;
+    double number;
+
+    switch (key->type) {
+        case KEY_BOOL: {
+            bool flag;
+            if (!parse_bool(value, &flag)) {
+                log_error("%s:%d: %s must be true or false, not \"%s\"", path, line, key->name, value);
+                return false;
+            }
+            *(bool *)target = flag;
+            return true;
+        }
+
+        case KEY_STRING:
+        case KEY_VOICE:
+        case KEY_LOG_FILTER:
+            if (strlen(value) >= key->size) {
+                log_error("%s:%d: %s is longer than %zu characters", path, line, key->name, key->size - 1);
+                return false;
+            }
+            if (key->type == KEY_VOICE && !valid_voice(value)) {
+                log_error("%s:%d: %s must be a Festival voice name (letters, digits, _ and -)",
+                          path, line, key->name);
+                return false;
+            }
+            if (key->type == KEY_LOG_FILTER && !check_log_filter(value)) {
+                log_error("%s:%d: %s \"%s\" has an unknown module or level", path, line, key->name, value);
+                return false;
+            }
+            memcpy(target, value, strlen(value) + 1);
+            return true;
+
+        default:
+            break;
+    }
+
+    // Numbers: integers must be whole, everything must be within range
+    errno = 0;
+    if (key->type == KEY_FLOAT || key->type == KEY_DOUBLE) {
+        number = strtod(value, &end);
+    } else {
+        number = (double)strtoll(value, &end, 10);
+    }
+    if (end == value || *end != '\0' || errno != 0 || !isfinite(number)) {
+        log_error("%s:%d: %s must be a%s number, not \"%s\"", path, line, key->name,
+                  key->type == KEY_FLOAT || key->type == KEY_DOUBLE ? "" : " whole", value);
+        return false;
+    }
+    if (number < key->min || number > key->max) {
+        log_error("%s:%d: %s must be between %g and %g, not %s", path, line, key->name,
+                  key->min, key->max, value);
+        return false;
+    }
+
+    switch (key->type) {
+        case KEY_INT:
+            *(int *)target = (int)number;
+            break;
+        case KEY_UINT:
+            *(unsigned int *)target = (unsigned int)number;
+            break;
+        case KEY_SIZE:
+            *(size_t *)target = (size_t)number;
+            break;
+        case KEY_FLOAT:
+            *(float *)target = (float)number;
+            break;
+        default:
+            *(double *)target = number;
+            break;
+    }
+    return true;
+}
+
+// Read the next line of in into line, without the comment and surrounding
+// whitespace. Returns NULL at the end of the file, or line with *too_long set.
+static char *read_line(FILE *in, char *line, size_t size, bool *too_long) {
+    if (!fgets(line, (int)size, in)) {
+        return NULL;
+    }
+    *too_long = false;
+    if (!strchr(line, '\n') && !feof(in)) {
+        int c;
+        while ((c = fgetc(in)) != '\n' && c != EOF) {
+        }
+        *too_long = true;
+    }
+    char *comment = strpbrk(line, "#;");
+    if (comment) {
+        *comment = '\0';
+    }
+    return trim(line);
+}
+
+// Parse a "[name]" header into name. Returns false if it is malformed.
+static bool parse_section(char *text, char *name, size_t size) {
+    size_t length = strlen(text);
+    if (length < 3 || text[length - 1] != ']') {
+        return false;
+    }
+    text[length - 1] = '\0';
+    char *inner = trim(text + 1);
+    if (!*inner || strlen(inner) >= size) {
+        return false;
+    }
+    snprintf(name, size, "%s", inner);
+    return true;
+}
+
+// First pass: the profile named before any section, and whether the section
+// of the active profile (profile, or else the named one) exists
+static void scan_profiles(FILE *in, char *named, size_t named_size,
+                          const char *profile, bool *found) {
+    char buffer[CONFIG_LINE_LENGTH];
+    char section[CONFIG_NAME_LENGTH] = "";
+    bool too_long;
+    char *line;
+
+    *found = false;
+    while ((line = read_line(in, buffer, sizeof(buffer), &too_long)) != NULL) {
+        if (*line == '[') {
+            if (parse_section(line, section, sizeof(section)) &&
+                strcmp(section, profile ? profile : named) == 0) {
+                *found = true;
+            }
+            continue;
+        }
+        char *equals = strchr(line, '=');
+        if (!section[0] && equals) {
+            *equals = '\0';
+            if (strcmp(trim(line), "profile") == 0) {
+                snprintf(named, named_size, "%s", trim(equals + 1));
+            }
+        }
+    }
+}
+
+bool load_config(const char *path, const char *profile, VaaniConfig *config) {
+    const char *file = path ? path : CONFIG_DEFAULT_PATH;
+    char named[CONFIG_NAME_LENGTH] = "";
+    char active[CONFIG_NAME_LENGTH];
+    char section[CONFIG_NAME_LENGTH] = "";
+    char buffer[CONFIG_LINE_LENGTH];
+    VaaniConfig updated = *config;
+    VaaniConfig scratch;
+    bool found, too_long;
+    int line_number = 0;
+    int errors = 0;
+    char *line;
+
+    FILE *in = fopen(file, "r");
+    if (!in) {
+        // Running without a config file is fine unless one was asked for
+        if (!path && !profile && errno == ENOENT) {
+            return true;
+        }
+        log_error("Cannot open config file %s: %s", file, strerror(errno));
+        return false;
+    }
+
+    // The profile from the command line wins over the one in the file
+    scan_profiles(in, named, sizeof(named), profile, &found);
+    snprintf(active, sizeof(active), "%s", profile ? profile : named);
+    if (active[0] && !found) {
+        log_error("%s: profile \"%s\" is not defined", file, active);
+        errors++;
+    }
+    rewind(in);
+
+    // Settings of other profiles are checked against a scratch copy
+    default_config(&scratch);
+    while ((line = read_line(in, buffer, sizeof(buffer), &too_long)) != NULL) {
+        line_number++;
+        if (too_long) {
+            log_error("%s:%d: line is longer than %d characters", file, line_number, CONFIG_LINE_LENGTH - 2);
+            errors++;
+            continue;
+        }
+        if (!*line) {
+            continue;
+        }
+        if (*line == '[') {
+            if (!parse_section(line, section, sizeof(section))) {
+                log_error("%s:%d: malformed section header", file, line_number);
+                section[0] = '\0';
+                errors++;
+            }
+            continue;
+        }
+
+        char *equals = strchr(line, '=');
+        if (!equals) {
+            log_error("%s:%d: expected key = value", file, line_number);
+            errors++;
+            continue;
+        }
+        *equals = '\0';
+        char *name = trim(line);
+        char *value = trim(equals + 1);
+
+        if (strcmp(name, "profile") == 0) {
+            if (section[0]) {
+                log_error("%s:%d: profile can only be chosen before the first section", file, line_number);
+                errors++;
+            }
+            continue;
+        }
+
+        const ConfigKey *key = find_key(name);
+        if (!key) {
+            log_error("%s:%d: unknown key %s", file, line_number, name);
+            errors++;
+            continue;
+        }
+        bool applies = !section[0] || strcmp(section, active) == 0;
+        if (!set_key(key, value, applies ? &updated : &scratch, file, line_number)) {
+            errors++;
+        }
+    }
+    fclose(in);
+
+    if (errors > 0) {
+        log_error("%s: %d error%s, settings not changed", file, errors, errors == 1 ? "" : "s");
+        return false;
+    }
+    snprintf(updated.profile, sizeof(updated.profile), "%s", active);
+    *config = updated;
+    log_info("Loaded %s%s%s", file, active[0] ? ", profile " : "", active);
+    return true;
+}
+
+bool keep_startup_settings(const VaaniConfig *running, VaaniConfig *loaded) {
+    bool changed = false;
+
+    for (size_t i = 0; i < CONFIG_KEY_COUNT; i++) {
+        const ConfigKey *key = &config_keys[i];
+        if (!key->restart) {
+            continue;
+        }
+        const char *old = (const char *)running + key->offset;
+        char *new_value = (char *)loaded + key->offset;
+        bool differs = key->type == KEY_STRING ? strcmp(old, new_value) != 0
+                                               : memcmp(old, new_value, key->size) != 0;
+        if (differs) {
+            log_warn("%s changed; it takes effect after a restart", key->name);
+            memcpy(new_value, old, key->size);
+            changed = true;
+        }
+    }
+    return changed;
+}
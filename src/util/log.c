@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include "../../include/log.h"
+
+// Bounded multi-producer, single-consumer ring. A slot's sequence equals its
+// position when free, position + 1 once filled, and is advanced by a lap
+// when the writer thread has consumed it.
+typedef struct {
+    atomic_size_t sequence;
+    struct timespec time;
+    unsigned char level;
+    unsigned char module;
+    char message[LOG_MESSAGE_LENGTH];
+} LogSlot;
+
+// The process has one log, like it has one stderr
+static struct {
+    LogSlot slots[LOG_RING_SLOTS];
+    atomic_size_t head;             // Next position to reserve
+    size_t tail;                    // Next position to write (writer thread only)
+    atomic_ulong dropped;
+    atomic_bool running;
+    atomic_bool initialized;
+    pthread_t thread;
+    atomic_uchar levels[LOG_MODULE_COUNT];
+    atomic_bool levels_set;
+} logger;
+
+static const char *const level_names[] = { "debug", "info", "warn", "error", "off" };
+static const char *const module_names[] = {
+    "main", "audio", "speech", "intent", "models", "service", "recorder", "batch", "config"
+};
+
+static void write_line(const struct timespec *time, int level, int module, const char *message) {
+    struct tm local;
+    localtime_r(&time->tv_sec, &local);
+    fprintf(stderr, "%02d:%02d:%02d.%03ld [%s] %s: %s\n", local.tm_hour, local.tm_min, local.tm_sec,
+            time->tv_nsec / 1000000, level_names[level], module_names[module], message);
+}
+
+// Write every filled slot; returns the number written
+static size_t drain_ring(void) {
+    size_t written = 0;
+
+    for (;;) {
+        LogSlot *slot = &logger.slots[logger.tail & (LOG_RING_SLOTS - 1)];
+        if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != logger.tail + 1) {
+            break;
+        }
+        write_line(&slot->time, slot->level, slot->module, slot->message);
+        atomic_store_explicit(&slot->sequence, logger.tail + LOG_RING_SLOTS, memory_order_release);
+        logger.tail++;
+        written++;
+    }
+
+    unsigned long dropped = atomic_exchange(&logger.dropped, 0);
+    if (dropped > 0) {
+        fprintf(stderr, "(%lu log messages dropped)\n", dropped);
+    }
+    if (written > 0 || dropped > 0) {
+        fflush(stderr);
+    }
+    return written;
+}
+
+static void *log_writer_main(void *arg) {
+    struct timespec interval = { 0, LOG_DRAIN_INTERVAL_MS * 1000000L };
+
+    (void)arg;
+    while (atomic_load(&logger.running)) {
+        if (drain_ring() == 0) {
+            nanosleep(&interval, NULL);
+        }
+    }
+    drain_ring();
+    return NULL;
+}
+
+static void init_levels(void) {
+    if (!atomic_exchange(&logger.levels_set, true)) {
+        for (int m = 0; m < LOG_MODULE_COUNT; m++) {
+            atomic_store(&logger.levels[m], LOG_DEFAULT_LEVEL);
+        }
+    }
+}
+
+bool start_logging(void) {
+    if (atomic_load(&logger.running)) {
+        return true;
+    }
+    init_levels();
+    if (!atomic_exchange(&logger.initialized, true)) {
+        for (size_t i = 0; i < LOG_RING_SLOTS; i++) {
+            atomic_init(&logger.slots[i].sequence, i);
+        }
+    }
+    atomic_store(&logger.running, true);
+    if (pthread_create(&logger.thread, NULL, log_writer_main, NULL) != 0) {
+        atomic_store(&logger.running, false);
+        return false;
+    }
+    return true;
+}
+
+void stop_logging(void) {
+    if (atomic_exchange(&logger.running, false)) {
+        pthread_join(logger.thread, NULL);
+        drain_ring();   // Messages queued while the thread was finishing
+    }
+}
+
+static int find_name(const char *const *names, size_t count, const char *name, size_t length) {
+    for (size_t i = 0; i < count; i++) {
+        if (strlen(names[i]) == length && strncmp(names[i], name, length) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+// Parse spec, applying the valid parts if apply is set
+static bool parse_log_filter(const char *spec, bool apply) {
+    bool valid = true;
+
+    while (spec && *spec) {
+        size_t length = strcspn(spec, ",");
+        const char *equals = memchr(spec, '=', length);
+        if (equals) {
+            int module = find_name(module_names, LOG_MODULE_COUNT, spec, equals - spec);
+            int level = find_name(level_names, LOG_LEVEL_OFF + 1, equals + 1, spec + length - equals - 1);
+            if (module >= 0 && level >= 0) {
+                if (apply) {
+                    set_log_level(module, level);
+                }
+            } else {
+                valid = false;
+            }
+        } else {
+            int level = find_name(level_names, LOG_LEVEL_OFF + 1, spec, length);
+            for (int m = 0; apply && level >= 0 && m < LOG_MODULE_COUNT; m++) {
+                set_log_level(m, level);
+            }
+            valid = valid && level >= 0;
+        }
+        spec += length + (spec[length] == ',');
+    }
+    return valid;
+}
+
+bool set_log_filter(const char *spec) {
+    init_levels();
+    return parse_log_filter(spec, true);
+}
+
+bool check_log_filter(const char *spec) {
+    return parse_log_filter(spec, false);
+}
+
+void set_log_level(LogModule module, LogLevel level) {
+    init_levels();
+    if (module < LOG_MODULE_COUNT) {
+        atomic_store(&logger.levels[module], level);
+    }
+}
+
+bool log_enabled(LogModule module, LogLevel level) {
+    if (!atomic_load_explicit(&logger.levels_set, memory_order_relaxed)) {
+        return level >= LOG_DEFAULT_LEVEL;
+    }
+    return level >= atomic_load_explicit(&logger.levels[module], memory_order_relaxed);
+}
+
+void log_write(LogModule module, LogLevel level, const char *format, ...) {
+    struct timespec now;
+    va_list args;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    if (!atomic_load_explicit(&logger.running, memory_order_acquire)) {
+        char message[LOG_MESSAGE_LENGTH];
+        va_start(args, format);
+        vsnprintf(message, sizeof(message), format, args);
+        va_end(args);
+        write_line(&now, level, module, message);
+        return;
+    }
+
+    // Reserve a slot; never wait for the writer
+    size_t position = atomic_load_explicit(&logger.head, memory_order_relaxed);
+    LogSlot *slot;
+    for (;;) {
+        slot = &logger.slots[position & (LOG_RING_SLOTS - 1)];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t lag = (intptr_t)sequence - (intptr_t)position;
+        if (lag == 0) {
+            if (atomic_compare_exchange_weak_explicit(&logger.head, &position, position + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (lag < 0) {
+            atomic_fetch_add_explicit(&logger.dropped, 1, memory_order_relaxed);
+            return;
+        } else {
+            position = atomic_load_explicit(&logger.head, memory_order_relaxed);
+        }
+    }
+
+    slot->time = now;
+    slot->level = (unsigned char)level;
+    slot->module = (unsigned char)module;
+    va_start(args, format);
+    vsnprintf(slot->message, sizeof(slot->message), format, args);
+    va_end(args);
+    atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+}
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <sys/resource.h>
+#include "../../include/memory_accounting.h"
+
+#define LOG_MODULE LOG_MODULE_MAIN
+#include "../../include/log.h"
+
+typedef struct {
+    atomic_size_t current;
+    atomic_size_t peak;
+    atomic_size_t budget;
+    atomic_ulong refused;
+} MemoryCounter;
+
+// One set of counters per process, like the log
+static MemoryCounter counters[MEMORY_SUBSYSTEM_COUNT];
+
+static const char *const subsystem_names[] = { "models", "intents", "audio", "tts" };
+
+static void raise_peak(MemoryCounter *counter, size_t current) {
+    size_t peak = atomic_load_explicit(&counter->peak, memory_order_relaxed);
+    while (current > peak &&
+           !atomic_compare_exchange_weak_explicit(&counter->peak, &peak, current,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+void memory_charge(MemorySubsystem subsystem, size_t bytes) {
+    MemoryCounter *counter = &counters[subsystem];
+    size_t current = atomic_fetch_add_explicit(&counter->current, bytes, memory_order_relaxed) + bytes;
+    raise_peak(counter, current);
+}
+
+void memory_release(MemorySubsystem subsystem, size_t bytes) {
+    atomic_fetch_sub_explicit(&counters[subsystem].current, bytes, memory_order_relaxed);
+}
+
+bool memory_reserve(MemorySubsystem subsystem, size_t bytes) {
+    MemoryCounter *counter = &counters[subsystem];
+    size_t budget = atomic_load_explicit(&counter->budget, memory_order_relaxed);
+    size_t current = atomic_load_explicit(&counter->current, memory_order_relaxed);
+
+    do {
+        if (budget > 0 && current + bytes > budget) {
+            atomic_fetch_add_explicit(&counter->refused, 1, memory_order_relaxed);
+            return false;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&counter->current, &current, current + bytes,
+                                                    memory_order_relaxed, memory_order_relaxed));
+    raise_peak(counter, current + bytes);
+    return true;
+}
+
+void set_memory_budget(MemorySubsystem subsystem, size_t bytes) {
+    atomic_store(&counters[subsystem].budget, bytes);
+}
+
+void get_memory_usage(MemorySubsystem subsystem, MemoryUsage *usage) {
+    MemoryCounter *counter = &counters[subsystem];
+    usage->current = atomic_load(&counter->current);
+    usage->peak = atomic_load(&counter->peak);
+    usage->budget = atomic_load(&counter->budget);
+    usage->refused = atomic_load(&counter->refused);
+}
+
+const char *memory_subsystem_name(MemorySubsystem subsystem) {
+    return subsystem < MEMORY_SUBSYSTEM_COUNT ? subsystem_names[subsystem] : "unknown";
+}
+
+// VmRSS and VmHWM of this process in kB, 0 if unavailable
+static void process_resident_kb(unsigned long *current, unsigned long *peak) {
+    char line[128];
+    FILE *status = fopen("/proc/self/status", "r");
+
+    *current = *peak = 0;
+    if (!status) {
+        return;
+    }
+    while (fgets(line, sizeof(line), status)) {
+        sscanf(line, "VmRSS: %lu", current);
+        sscanf(line, "VmHWM: %lu", peak);
+    }
+    fclose(status);
+}
+
+size_t format_memory_report(char *out, size_t size) {
+    size_t length = 0;
+    unsigned long resident_kb, resident_peak_kb;
+    struct rusage children;
+
+    if (size == 0) {
+        return 0;
+    }
+    out[0] = '\0';
+    for (int s = 0; s < MEMORY_SUBSYSTEM_COUNT && length < size; s++) {
+        MemoryUsage usage;
+        char budget[32] = "no budget";
+        get_memory_usage(s, &usage);
+        if (usage.budget > 0) {
+            snprintf(budget, sizeof(budget), "budget %.1f MB", usage.budget / 1048576.0);
+        }
+        length += snprintf(out + length, size - length,
+                           "%-8s %8.1f MB  peak %8.1f MB  %s, %lu refused\n",
+                           subsystem_names[s], usage.current / 1048576.0, usage.peak / 1048576.0,
+                           budget, usage.refused);
+    }
+
+    // Festival and aplay run as children; ru_maxrss is the largest one so far
+    process_resident_kb(&resident_kb, &resident_peak_kb);
+    if (getrusage(RUSAGE_CHILDREN, &children) != 0) {
+        children.ru_maxrss = 0;
+    }
+    if (length < size) {
+        length += snprintf(out + length, size - length,
+                           "process  %8.1f MB  peak %8.1f MB  resident; largest TTS child %.1f MB\n",
+                           resident_kb / 1024.0, resident_peak_kb / 1024.0, children.ru_maxrss / 1024.0);
+    }
+    return length < size ? length : size - 1;
+}
+
+void log_memory_report(const char *reason) {
+    char report[MEMORY_REPORT_LENGTH];
+
+    format_memory_report(report, sizeof(report));
+    log_info("Memory use (%s):", reason);
+    char *saved;
+    for (char *line = strtok_r(report, "\n", &saved); line; line = strtok_r(NULL, "\n", &saved)) {
+        log_info("  %s", line);
+    }
+}
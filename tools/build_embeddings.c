@@ -0,0 +1,355 @@
+// Offline builder for the semantic matcher.
+//
+// Converts a word vector model in text format (GloVe / fastText .vec:
+// "word v1 v2 ... vD" per line, optional "count dim" header) into the
+// compact int8 model read at runtime, then embeds every question of
+// Intents.csv and writes the int8 vectors with an IVF index.
+//
+// Usage: build/build_embeddings <vectors.txt> [max_words]
+// Run from the project root; writes EMBEDDING_MODEL_PATH and EMBEDDING_INDEX_PATH.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "../include/intent_processor.h"
+#include "../include/embedding_matcher.h"
+
+#define DEFAULT_MAX_WORDS 50000
+#define KMEANS_ITERATIONS 15
+#define MAX_LISTS 1024
+#define ALIGN16(n) (((n) + 15) & ~(size_t)15)
+
+typedef struct {
+    char* word;
+    float* vector;
+    size_t rank;      // Line order, i.e. frequency rank in GloVe/fastText files
+} WordEntry;
+
+static int compare_words(const void* a, const void* b) {
+    const WordEntry* x = a;
+    const WordEntry* y = b;
+    int cmp = strcmp(x->word, y->word);
+    return cmp ? cmp : (x->rank > y->rank) - (x->rank < y->rank);
+}
+
+static bool write_padding(FILE* out, size_t* offset) {
+    static const char zeros[16];
+    size_t pad = ALIGN16(*offset) - *offset;
+    *offset += pad;
+    return pad == 0 || fwrite(zeros, 1, pad, out) == pad;
+}
+
+static bool write_section(FILE* out, size_t* offset, const void* data, size_t size) {
+    if (!write_padding(out, offset)) return false;
+    *offset += size;
+    return size == 0 || fwrite(data, 1, size, out) == size;
+}
+
+// Read up to max_words vectors; returns the count and sets *dim
+static size_t read_text_vectors(const char* path, size_t max_words, WordEntry** out, size_t* dim) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        perror(path);
+        return 0;
+    }
+
+    size_t capacity = 1024, count = 0;
+    WordEntry* entries = malloc(sizeof(WordEntry) * capacity);
+    size_t line_size = 1 << 16;
+    char* line = malloc(line_size);
+    *dim = 0;
+
+    while (entries && line && count < max_words && fgets(line, (int)line_size, file)) {
+        char* saveptr = NULL;
+        char* word = strtok_r(line, " \t\n", &saveptr);
+        if (!word) continue;
+
+        float values[EMBEDDING_MAX_DIM];
+        size_t n = 0;
+        char* token;
+        while ((token = strtok_r(NULL, " \t\n", &saveptr)) && n < EMBEDDING_MAX_DIM) {
+            values[n++] = strtof(token, NULL);
+        }
+        if (n == 1 && count == 0 && *dim == 0) {
+            continue;   // "count dim" header line
+        }
+        if (*dim == 0) {
+            *dim = n;
+        }
+        if (n != *dim) {
+            continue;
+        }
+
+        if (count == capacity) {
+            capacity *= 2;
+            WordEntry* grown = realloc(entries, sizeof(WordEntry) * capacity);
+            if (!grown) break;
+            entries = grown;
+        }
+        for (char* p = word; *p; p++) *p = (char)tolower((unsigned char)*p);
+        entries[count].word = strdup(word);
+        entries[count].vector = malloc(sizeof(float) * n);
+        if (!entries[count].word || !entries[count].vector) break;
+        memcpy(entries[count].vector, values, sizeof(float) * n);
+        entries[count].rank = count;
+        count++;
+    }
+
+    free(line);
+    fclose(file);
+    *out = entries;
+    return count;
+}
+
+// Sort by word and drop case-folded duplicates, keeping the most frequent
+static size_t sort_unique_words(WordEntry* entries, size_t count) {
+    qsort(entries, count, sizeof(WordEntry), compare_words);
+    size_t unique = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (unique > 0 && strcmp(entries[unique - 1].word, entries[i].word) == 0) {
+            free(entries[i].word);
+            free(entries[i].vector);
+            continue;
+        }
+        entries[unique++] = entries[i];
+    }
+    return unique;
+}
+
+static bool write_word_vectors(const char* path, const WordEntry* entries, size_t unique,
+                               size_t total, size_t dim) {
+    size_t dim_padded = ALIGN16(dim);
+
+    uint32_t* offsets = malloc(sizeof(uint32_t) * (unique + 1));
+    float* scales = malloc(sizeof(float) * unique);
+    float* weights = malloc(sizeof(float) * unique);
+    int8_t* vectors = calloc(unique, dim_padded);
+    if (!offsets || !scales || !weights || !vectors) {
+        fprintf(stderr, "Out of memory\n");
+        return false;
+    }
+
+    // SIF weight a / (a + p(w)), with p(w) estimated from the Zipf rank
+    double harmonic = log((double)total) + 0.5772;
+    size_t blob_size = 0;
+    for (size_t i = 0; i < unique; i++) {
+        offsets[i] = (uint32_t)blob_size;
+        blob_size += strlen(entries[i].word) + 1;
+        float probability = (float)(1.0 / ((double)(entries[i].rank + 1) * harmonic));
+        weights[i] = EMBEDDING_SIF_A / (EMBEDDING_SIF_A + probability);
+        scales[i] = quantize_embedding(entries[i].vector, dim, vectors + i * dim_padded);
+    }
+    offsets[unique] = (uint32_t)blob_size;
+
+    char* blob = malloc(blob_size);
+    if (!blob) {
+        fprintf(stderr, "Out of memory\n");
+        return false;
+    }
+    for (size_t i = 0; i < unique; i++) {
+        memcpy(blob + offsets[i], entries[i].word, offsets[i + 1] - offsets[i]);
+    }
+
+    EmbeddingFileHeader header = {
+        .magic = WORD_VECTORS_MAGIC,
+        .dim = (uint32_t)dim,
+        .dim_padded = (uint32_t)dim_padded,
+        .count = (uint32_t)unique,
+        .blob_size = (uint32_t)blob_size,
+    };
+
+    char temp_path[512];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    FILE* out = fopen(temp_path, "wb");
+    size_t offset = 0;
+    bool ok = out &&
+        write_section(out, &offset, &header, sizeof(header)) &&
+        write_section(out, &offset, offsets, sizeof(uint32_t) * (unique + 1)) &&
+        write_section(out, &offset, blob, blob_size) &&
+        write_section(out, &offset, scales, sizeof(float) * unique) &&
+        write_section(out, &offset, weights, sizeof(float) * unique) &&
+        write_section(out, &offset, vectors, unique * dim_padded);
+    if (out && fclose(out) != 0) ok = false;
+    if (ok && rename(temp_path, path) != 0) ok = false;
+    if (!ok) {
+        perror(path);
+    } else {
+        printf("Wrote %zu word vectors (%zu dimensions) to %s\n", unique, dim, path);
+    }
+
+    free(offsets);
+    free(scales);
+    free(weights);
+    free(vectors);
+    free(blob);
+    return ok;
+}
+
+static float dot(const float* a, const float* b, size_t dim) {
+    float sum = 0.0f;
+    for (size_t d = 0; d < dim; d++) sum += a[d] * b[d];
+    return sum;
+}
+
+// Spherical k-means over unit vectors; fills assignment[row]
+static void train_lists(const float* vectors, size_t rows, size_t dim, size_t lists,
+                        float* centroids, uint32_t* assignment) {
+    for (size_t c = 0; c < lists; c++) {
+        memcpy(centroids + c * dim, vectors + (c * rows / lists) * dim, sizeof(float) * dim);
+    }
+
+    float* sums = malloc(sizeof(float) * lists * dim);
+    size_t* sizes = malloc(sizeof(size_t) * lists);
+    for (int iteration = 0; sums && sizes && iteration < KMEANS_ITERATIONS; iteration++) {
+        for (size_t r = 0; r < rows; r++) {
+            float best = -INFINITY;
+            for (size_t c = 0; c < lists; c++) {
+                float score = dot(vectors + r * dim, centroids + c * dim, dim);
+                if (score > best) {
+                    best = score;
+                    assignment[r] = (uint32_t)c;
+                }
+            }
+        }
+
+        memset(sums, 0, sizeof(float) * lists * dim);
+        memset(sizes, 0, sizeof(size_t) * lists);
+        for (size_t r = 0; r < rows; r++) {
+            float* sum = sums + assignment[r] * dim;
+            for (size_t d = 0; d < dim; d++) sum[d] += vectors[r * dim + d];
+            sizes[assignment[r]]++;
+        }
+        for (size_t c = 0; c < lists; c++) {
+            float norm = sqrtf(dot(sums + c * dim, sums + c * dim, dim));
+            if (sizes[c] == 0 || norm <= 0.0f) continue;   // Keep the old centroid
+            for (size_t d = 0; d < dim; d++) centroids[c * dim + d] = sums[c * dim + d] / norm;
+        }
+    }
+    free(sums);
+    free(sizes);
+}
+
+static bool write_embedding_index(const char* path, const WordVectors* model, IntentProcessor* intents) {
+    size_t dim = word_vectors_padded_dim(model);
+
+    unsigned int token = intent_read_lock(intents);
+    size_t rows = get_intent_count(intents);
+    float* vectors = calloc(rows ? rows : 1, sizeof(float) * dim);
+    int8_t* quantized = calloc(rows ? rows : 1, dim);
+    float* scales = malloc(sizeof(float) * (rows ? rows : 1));
+    uint64_t fingerprint = EMBEDDING_FINGERPRINT_SEED;
+    size_t unknown = 0;
+    for (size_t r = 0; vectors && quantized && scales && r < rows; r++) {
+        const IntentEntry* entry = get_intent_entry(intents, r);
+        fingerprint = embedding_fingerprint(fingerprint, entry->question);
+        if (embed_text(model, entry->question, vectors + r * dim)) {
+            scales[r] = quantize_embedding(vectors + r * dim, dim, quantized + r * dim);
+        } else {
+            scales[r] = 1.0f;   // No known words: a zero vector never matches
+            unknown++;
+        }
+    }
+    intent_read_unlock(intents, token);
+
+    size_t lists = (size_t)sqrt((double)rows);
+    if (lists < 1) lists = 1;
+    if (lists > MAX_LISTS) lists = MAX_LISTS;
+    float* centroids = calloc(lists, sizeof(float) * dim);
+    uint32_t* assignment = calloc(rows ? rows : 1, sizeof(uint32_t));
+    uint32_t* list_offsets = calloc(lists + 1, sizeof(uint32_t));
+    uint32_t* list_rows = malloc(sizeof(uint32_t) * (rows ? rows : 1));
+    if (!vectors || !quantized || !scales || !centroids || !assignment || !list_offsets || !list_rows) {
+        fprintf(stderr, "Out of memory\n");
+        return false;
+    }
+    if (rows > 0) {
+        train_lists(vectors, rows, dim, lists, centroids, assignment);
+    }
+
+    for (size_t r = 0; r < rows; r++) list_offsets[assignment[r] + 1]++;
+    for (size_t c = 0; c < lists; c++) list_offsets[c + 1] += list_offsets[c];
+    for (size_t r = 0; r < rows; r++) {
+        list_rows[list_offsets[assignment[r]]++] = (uint32_t)r;
+    }
+    for (size_t c = lists; c > 0; c--) list_offsets[c] = list_offsets[c - 1];
+    list_offsets[0] = 0;
+
+    EmbeddingFileHeader header = {
+        .magic = EMBEDDING_INDEX_MAGIC,
+        .dim = (uint32_t)word_vectors_dim(model),
+        .dim_padded = (uint32_t)dim,
+        .count = (uint32_t)rows,
+        .lists = (uint32_t)lists,
+        .fingerprint = fingerprint,
+    };
+
+    char temp_path[512];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    FILE* out = fopen(temp_path, "wb");
+    size_t offset = 0;
+    bool ok = out &&
+        write_section(out, &offset, &header, sizeof(header)) &&
+        write_section(out, &offset, centroids, sizeof(float) * lists * dim) &&
+        write_section(out, &offset, list_offsets, sizeof(uint32_t) * (lists + 1)) &&
+        write_section(out, &offset, list_rows, sizeof(uint32_t) * rows) &&
+        write_section(out, &offset, scales, sizeof(float) * rows) &&
+        write_section(out, &offset, quantized, rows * dim);
+    if (out && fclose(out) != 0) ok = false;
+    // Rename last so a running service reloads a complete file
+    if (ok && rename(temp_path, path) != 0) ok = false;
+    if (!ok) {
+        perror(path);
+    } else {
+        printf("Wrote embeddings for %zu questions (%zu lists, %zu without known words) to %s\n",
+               rows, lists, unknown, path);
+    }
+
+    free(vectors);
+    free(quantized);
+    free(scales);
+    free(centroids);
+    free(assignment);
+    free(list_offsets);
+    free(list_rows);
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <vectors.txt> [max_words]\n", argv[0]);
+        return 1;
+    }
+    size_t max_words = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_MAX_WORDS;
+
+    WordEntry* entries = NULL;
+    size_t dim = 0;
+    size_t count = read_text_vectors(argv[1], max_words, &entries, &dim);
+    if (count == 0 || dim == 0) {
+        fprintf(stderr, "No word vectors read from %s\n", argv[1]);
+        return 1;
+    }
+    size_t unique = sort_unique_words(entries, count);
+    bool ok = write_word_vectors(EMBEDDING_MODEL_PATH, entries, unique, count, dim);
+    for (size_t i = 0; i < unique; i++) {
+        free(entries[i].word);
+        free(entries[i].vector);
+    }
+    free(entries);
+    if (!ok) {
+        return 1;
+    }
+
+    // Embed the questions exactly as the runtime loads them
+    WordVectors* model = load_word_vectors(EMBEDDING_MODEL_PATH);
+    IntentProcessor* intents = model ? initialize_intent_processor(INTENTS_CSV_PATH) : NULL;
+    if (!intents) {
+        free_word_vectors(model);
+        return 1;
+    }
+    ok = write_embedding_index(EMBEDDING_INDEX_PATH, model, intents);
+    cleanup_intent_processor(intents);
+    free_word_vectors(model);
+    return ok ? 0 : 1;
+}